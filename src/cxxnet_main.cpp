@@ -9,6 +9,8 @@
 #include "nnet/nnet.h"
 #include "io/data.h"
 #include "utils/config.h"
+#include "utils/timer.h"
+#include "utils/io_profiler.h"
 
 namespace cxxnet{
 
@@ -77,6 +79,7 @@ class CXXNetLearnTask {
     if (task == "train" || task == "finetune") this->TaskTrain();
     if (task == "pred")   this->TaskPredict();
     if (task == "extract") this->TaskExtractFeature();
+    if (task == "iobench") this->TaskIOBench();
     return 0;
   }
 
@@ -106,6 +109,14 @@ class CXXNetLearnTask {
  private:
   // configure trainer
   inline void Init(void) {
+    if (task == "iobench" || test_io != 0) {
+      utils::IOProfiler::Get()->set_enabled(true);
+    }
+    if (task == "iobench") {
+      // only the data pipeline is needed
+      this->CreateIterators();
+      return;
+    }
     if (task == "train" && continue_training) {
       if (SyncLastestModel() == 0) {
         utils::Error("Init: Cannot find models for continue training. \
@@ -235,7 +246,7 @@ class CXXNetLearnTask {
           utils::Assert(itr_train == NULL, "can only have one data");
           itr_train = cxxnet::CreateIterator(itcfg);
         }
-        if (flag == 2 && task != "pred") {
+        if (flag == 2 && task != "pred" && task != "iobench") {
           itr_evals.push_back(cxxnet::CreateIterator(itcfg));
           eval_names.push_back(evname);
         }
@@ -371,6 +382,10 @@ class CXXNetLearnTask {
         int sample_counter = 0;
         net_trainer->StartRound(start_counter);
         itr_train->BeforeFirst();
+        // loaders keep running, measure the round from a snapshot of the counters
+        std::vector<utils::IOStage> io_begin;
+        if (test_io != 0) io_begin = utils::IOProfiler::Get()->Snapshot();
+        double round_start = utils::GetTime();
         while (itr_train->Next()) {
           if (test_io == 0) {
             net_trainer->Update(itr_train->Value());
@@ -385,6 +400,10 @@ class CXXNetLearnTask {
             }
           }
         }
+        if (test_io != 0) {
+          printf("\n");
+          utils::IOProfiler::Get()->Print(stdout, utils::GetTime() - round_start, io_begin);
+        }
 
         if (test_io == 0) {
           // code handling evaluation
@@ -411,6 +430,35 @@ class CXXNetLearnTask {
     }
   }
 
+  // run the training data pipeline without the network, and report the throughput of each stage
+  inline void TaskIOBench(void) {
+    utils::Check(itr_train != NULL, "iobench: must specify training data");
+    utils::IOProfiler *prof = utils::IOProfiler::Get();
+    for (int r = 0; r < num_round; ++r) {
+      itr_train->BeforeFirst();
+      // loaders may have buffered data before the round starts, it is counted in the round,
+      // the loaders are running, so the counters are not cleared but compared with a snapshot
+      std::vector<utils::IOStage> begin = prof->Snapshot();
+      double start = utils::GetTime();
+      unsigned long nbatch = 0, ninst = 0;
+      while (itr_train->Next()) {
+        const DataBatch &batch = itr_train->Value();
+        ninst += batch.batch_size - batch.num_batch_padd;
+        if (++nbatch % print_step == 0 && !silent) {
+          double elapsed = utils::GetTime() - start;
+          printf("\r                                                               \r");
+          printf("round %8d:[%8lu] %.1f images/sec, %g sec elapsed", r,
+                 nbatch, ninst / elapsed, elapsed);
+          fflush(stdout);
+        }
+      }
+      double elapsed = utils::GetTime() - start;
+      printf("\nround %d: %lu batches, %lu images in %g sec, %.1f images/sec\n",
+             r, nbatch, ninst, elapsed, elapsed > 0.0 ? ninst / elapsed : 0.0);
+      prof->Print(stdout, elapsed, begin);
+    }
+  }
+
   inline void CopyModel(void){
     FILE *fi = utils::FopenCheck(name_model_in.c_str(), "rb");
     utils::Assert(fread(&net_type, sizeof(int), 1, fi) > 0, "loading model");
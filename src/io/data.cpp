@@ -9,10 +9,15 @@
 #include "../utils/utils.h"
 #include "../utils/io.h"
 #include "iter_mnist-inl.hpp"
+#include "iter_libsvm-inl.hpp"
 #include "iter_augment_proc-inl.hpp"
 #include "iter_batch_proc-inl.hpp"
 #include "iter_mem_buffer-inl.hpp"
 #include "iter_attach_txt-inl.hpp"
+#include "iter_attach_bin-inl.hpp"
+#include "iter_shuffle_buffer-inl.hpp"
+#include "iter_mem_cache-inl.hpp"
+#include "iter_external-inl.hpp"
 #if CXXNET_USE_OPENCV
 #include "iter_thread_imbin-inl.hpp"
 #include "iter_thread_imbin_x-inl.hpp"
@@ -23,6 +28,13 @@ namespace cxxnet {
 IIterator<DataBatch> *CreateIterator(const std::vector< std::pair<std::string, std::string> > &cfg) {
   size_t i = 0;
   IIterator<DataBatch> *it = NULL;
+  // augmenter of image iterator, and the iterator it is created with
+  AugmentIterator *aug = NULL;
+  IIterator<DataBatch> *aug_chain = NULL;
+  // position of the iter entry that created the image iterator
+  size_t aug_begin = 0;
+  // external iterator, which must not be chained over
+  IIterator<DataBatch> *external = NULL;
   for (; i < cfg.size(); ++i) {
     const char *name = cfg[i].first.c_str();
     const char *val  = cfg[i].second.c_str();
@@ -31,24 +43,59 @@ IIterator<DataBatch> *CreateIterator(const std::vector< std::pair<std::string, s
         utils::Check(it == NULL, "mnist can not chain over other iterator");
         it = new MNISTIterator(); continue;
       }
+      if (!strcmp(val, "libsvm")) {
+        utils::Check(it == NULL, "libsvm can not chain over other iterator");
+        it = new LibSVMIterator(); continue;
+      }
+      if (!strcmp(val, "external")) {
+        utils::Check(it == NULL, "external can not chain over other iterator");
+        it = external = new ExternalIterator(); continue;
+      }
       #if CXXNET_USE_OPENCV
       if (!strcmp(val, "imgbinold")) {
         utils::Assert(it == NULL, "image binary can not chain over other iterator");
-        it = new BatchAdaptIterator(new AugmentIterator(new ThreadImagePageIterator()));
+        aug = new AugmentIterator(new ThreadImagePageIterator());
+        it = aug_chain = new BatchAdaptIterator(aug);
+        aug_begin = i;
         continue;
       }
       // redirect all io to new iterator
       if (!strcmp(val, "imgbinx") || !strcmp(val, "imgbin")) {
         utils::Assert(it == NULL, "image binary can not chain over other iterator");
-        it = new BatchAdaptIterator(new AugmentIterator(new ThreadImagePageIteratorX()));
+        aug = new AugmentIterator(new ThreadImagePageIteratorX());
+        it = aug_chain = new BatchAdaptIterator(aug);
+        aug_begin = i;
         continue;
       }
       if (!strcmp(val, "img")) {
         utils::Assert(it == NULL, "image list iterator can not chain over other iterator");
-        it = new BatchAdaptIterator(new AugmentIterator(new ImageIterator()));
+        aug = new AugmentIterator(new ImageIterator());
+        it = aug_chain = new BatchAdaptIterator(aug);
+        aug_begin = i;
         continue;
       }
       #endif
+      if (!strcmp(val, "shufflebuffer")) {
+        utils::Assert(aug != NULL && it == aug_chain,
+                      "shufflebuffer must directly follow an image iterator");
+        aug->set_base(new ShuffleBufferIterator(aug->base()));
+        continue;
+      }
+      if (!strcmp(val, "memcache")) {
+        utils::Assert(aug != NULL && it == aug_chain,
+                      "memcache must directly follow an image iterator");
+        // take the image iterator out of the chain, the cache makes its own augmenters
+        std::vector< std::pair<std::string, std::string> > given;
+        for (size_t j = aug_begin + 1; j < i; ++j) {
+          if (cfg[j].first != "iter") given.push_back(cfg[j]);
+        }
+        IIterator<DataInst> *base = aug->base();
+        aug->set_base(NULL);
+        delete it;
+        it = new MemCacheIterator(base, given);
+        aug = NULL; aug_chain = NULL;
+        continue;
+      }
       if (!strcmp(val, "threadbuffer")) {
         utils::Assert(it != NULL, "must specify input of threadbuffer");
         it = new ThreadBufferIterator(it);
@@ -64,6 +111,11 @@ IIterator<DataBatch> *CreateIterator(const std::vector< std::pair<std::string, s
         it = new AttachTxtIterator(it);
         continue;
       }
+      if (!strcmp(val, "attachbin")) {
+        utils::Assert(it != NULL, "must specify input of attach bin buffer");
+        it = new AttachBinIterator(it);
+        continue;
+      }
       utils::Error("unknown iterator type %s", val);
     }
     if (it != NULL) {
@@ -71,6 +123,8 @@ IIterator<DataBatch> *CreateIterator(const std::vector< std::pair<std::string, s
     }
   }
   utils::Assert(it != NULL, "must specify iterator by iter=itername");
+  utils::Check(external == NULL || external == it,
+               "external can not be chained by other iterator, it is already a queue");
   return it;
 }
 } // namespace cxxnet
@@ -7,6 +7,7 @@
  */
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <mshadow/tensor.h>
 #include "../utils/utils.h"
 
@@ -32,11 +33,62 @@ public:
   virtual bool Next(void) = 0;
   /*! \brief get current data */
   virtual const DType &Value(void) const = 0;
+  /*!
+   * \brief reserve the space where next call of Next writes its output,
+   *  so that the consumer do not need to copy Value, the reservation only holds for one call of Next;
+   *  even if supported, the iterator may choose not to use the slot, so the caller
+   *  still need to check whether the content of Value lies in the slot
+   * \param slot the space to write into, only the content fields(e.g. data) are used
+   * \return whether the iterator supports writing into slot
+   */
+  virtual bool ReserveSlot(const DType &slot) {
+    return false;
+  }
+  /*!
+   * \brief number of items in a round, e.g. to take a fraction of them
+   * \return the number, 0 if it is not known without going over the data
+   */
+  virtual size_t NumInst(void) const {
+    return 0;
+  }
+  /*!
+   * \brief get the position after the last item returned by Next, it can be given to Seek
+   *   of the same iterator over the same data, e.g. in a later run
+   * \param pos output position
+   * \return false if it is not supported, or no item is returned since BeforeFirst
+   */
+  virtual bool Tell(std::vector<uint64_t> *pos) const {
+    return false;
+  }
+  /*!
+   * \brief move to a position given by Tell, the next call of Next returns the item after it;
+   *   the iterator starts from the beginning again after BeforeFirst
+   * \param pos position to move to
+   * \return false if it is not supported, the iterator is not changed then
+   */
+  virtual bool Seek(const std::vector<uint64_t> &pos) {
+    return false;
+  }
 public:
   /*! \brief constructor */
   virtual ~IIterator(void) {}
 }; // class IIterator
 
+/*!
+ * \brief normalization of uint8 data, applied when the data is converted into float
+ *   as input of the network: out = (data - mean) * scale
+ */
+struct DataNorm {
+  /*! \brief mean to be substracted, in (channel, height, width) */
+  mshadow::Tensor<mshadow::cpu, 3> mean;
+  /*! \brief scale after mean substraction */
+  float scale;
+  /*! \brief constructor */
+  DataNorm(void) : scale(1.0f) {
+    mean.dptr_ = NULL;
+  }
+}; // struct DataNorm
+
 /*! \brief a single data instance */
 struct DataInst {
   /*! \brief unique id for instance */
@@ -45,6 +97,24 @@ struct DataInst {
   mshadow::Tensor<mshadow::cpu, 1> label;
   /*! \brief content of data */
   mshadow::Tensor<mshadow::cpu, 3> data;
+  /*!
+   * \brief decoded image in (height, width, channel), used when data.dptr_ is NULL,
+   *  the conversion into float is left to the augmentation stage
+   */
+  mshadow::Tensor<mshadow::cpu, 3, unsigned char> raw;
+  /*!
+   * \brief content of data in uint8, in (channel, height, width), used when data.dptr_ is NULL
+   *  and raw.dptr_ is NULL, the data is normalized by norm in the network
+   */
+  mshadow::Tensor<mshadow::cpu, 3, unsigned char> data_uint8;
+  /*! \brief normalization of data_uint8 */
+  DataNorm norm;
+  /*! \brief constructor */
+  DataInst(void) {
+    data.dptr_ = NULL;
+    raw.dptr_ = NULL;
+    data_uint8.dptr_ = NULL;
+  }
 }; // struct DataInst
 
 /*! \brief a sparse data instance, in sparse vector */
@@ -78,6 +148,15 @@ struct SparseInst {
  */
 struct DataBatch {
 public:
+  /*! \brief type of dense data */
+  enum DataType {
+    /*! \brief data is stored in data */
+    kFloat32 = 0,
+    /*! \brief data is stored in data_uint8, data only holds the shape */
+    kUInt8 = 1
+  };
+  /*! \brief type of dense data, one of DataType */
+  int data_type;
   /*! \brief unique id for instance, can be NULL, sometimes is useful */
   unsigned *inst_index;
   /*! \brief number of instance */
@@ -92,6 +171,10 @@ public:
   mshadow::Tensor<mshadow::cpu, 4> data;
   /*! \brief extra data to be fed to the network */
   std::vector<mshadow::Tensor<mshadow::cpu, 4> > extra_data;
+  /*! \brief content of dense data in uint8, if data_type is kUInt8 */
+  mshadow::Tensor<mshadow::cpu, 4, unsigned char> data_uint8;
+  /*! \brief normalization applied to data_uint8 when it is fed to the network */
+  DataNorm norm;
 public:
   // sparse part of the DataBatch, in CSR format
   /*! \brief array[batch_size+1], row pointer of each of the elements */
@@ -104,6 +187,8 @@ public:
     label.dptr_ = NULL;
     inst_index = NULL;
     data.dptr_ = NULL;
+    data_uint8.dptr_ = NULL;
+    data_type = kFloat32;
     batch_size = 0; num_batch_padd = 0;
     sparse_row_ptr = NULL;
     sparse_data = NULL;
@@ -119,6 +204,33 @@ public:
     inst_index = new unsigned[batch_size];
     this->batch_size = batch_size;
   }
+  /*!
+   * \brief auxiliary function to allocate space of uint8 batch,
+   *  data keeps the shape of batch, but does not hold any content
+   */
+  inline void AllocSpaceUInt8(mshadow::Shape<4> shape,
+                              mshadow::index_t batch_size,
+                              mshadow::index_t label_width) {
+    data_uint8 = mshadow::NewTensor<mshadow::cpu>(shape, static_cast<unsigned char>(0), false);
+    data = mshadow::Tensor<mshadow::cpu, 4>(NULL, shape);
+    mshadow::Shape<2> lshape = mshadow::Shape2(batch_size, label_width);
+    label = mshadow::NewTensor<mshadow::cpu>(lshape, 0.0f, false);
+    inst_index = new unsigned[batch_size];
+    this->batch_size = batch_size;
+    data_type = kUInt8;
+  }
+  /*! \brief allocate space of same type and shape as src */
+  inline void AllocSpaceLike(const DataBatch &src) {
+    utils::Check(!src.is_sparse(), "DataBatch: can not allocate space of sparse batch");
+    if (src.data_type == kUInt8) {
+      this->AllocSpaceUInt8(src.data.shape_, src.batch_size, src.label.size(1));
+    } else {
+      this->AllocSpaceDense(src.data.shape_, src.batch_size, src.label.size(1));
+    }
+    for (mshadow::index_t i = 0; i < src.extra_data.size(); ++i) {
+      extra_data.push_back(mshadow::NewTensor<mshadow::cpu>(src.extra_data[i].shape_, 0.0f));
+    }
+  }
   /*! \brief auxiliary  functionto allocate space, if needed */
   inline void AllocSpaceDense(mshadow::Shape<4> shape,
                               mshadow::index_t batch_size,
@@ -135,7 +247,11 @@ public:
     if (label.dptr_ != NULL) {
       delete [] inst_index;
       mshadow::FreeSpace(&label);
-      mshadow::FreeSpace(&data);
+      if (data_type == kUInt8) {
+        mshadow::FreeSpace(&data_uint8);
+      } else {
+        mshadow::FreeSpace(&data);
+      }
       label.dptr_ = NULL;
     }
     for (mshadow::index_t i = 0; i < extra_data.size(); ++i){
@@ -150,8 +266,14 @@ public:
     memcpy(inst_index, src.inst_index, batch_size * sizeof(unsigned));
     utils::Assert(data.shape_ == src.data.shape_, "DataBatch: data shape mismatch");
     utils::Assert(label.shape_ == src.label.shape_, "DataBatch: label shape mismatch");
+    utils::Assert(data_type == src.data_type, "DataBatch: data type mismatch");
     mshadow::Copy(label, src.label);
-    mshadow::Copy(data, src.data);
+    if (data_type == kUInt8) {
+      mshadow::Copy(data_uint8, src.data_uint8);
+      norm = src.norm;
+    } else {
+      mshadow::Copy(data, src.data);
+    }
     utils::Assert(extra_data.size() == src.extra_data.size(),
       "DataBatch: extra data number mismatch");
     for (mshadow::index_t i = 0; i < extra_data.size(); ++i){
@@ -161,6 +283,32 @@ public:
     }
   }
 public:
+  /*!
+   * \brief get a view of instances [begin, end) of the batch, no content is copied
+   * \param begin beginning of index
+   * \param end end of index
+   */
+  inline DataBatch Slice(mshadow::index_t begin, mshadow::index_t end) const {
+    DataBatch ret = *this;
+    ret.batch_size = end - begin;
+    // padding instances are at the tail of batch
+    mshadow::index_t nvalid = batch_size - num_batch_padd;
+    ret.num_batch_padd = end > nvalid ? end - std::max(begin, nvalid) : 0;
+    if (inst_index != NULL) ret.inst_index = inst_index + begin;
+    if (label.dptr_ != NULL) ret.label = label.Slice(begin, end);
+    if (data.dptr_ != NULL) {
+      ret.data = data.Slice(begin, end);
+    } else {
+      ret.data.shape_[0] = end - begin;
+    }
+    if (data_uint8.dptr_ != NULL) ret.data_uint8 = data_uint8.Slice(begin, end);
+    for (size_t i = 0; i < extra_data.size(); ++i) {
+      ret.extra_data[i] = extra_data[i].Slice(begin, end);
+    }
+    // the entries are not moved, row pointers are offsets into sparse_data
+    if (sparse_row_ptr != NULL) ret.sparse_row_ptr = sparse_row_ptr + begin;
+    return ret;
+  }
   /*! \brief helper function to check if a element is sparse */
   inline bool is_sparse(void) const {
     return sparse_row_ptr != NULL;
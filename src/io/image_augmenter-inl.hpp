@@ -2,11 +2,19 @@
 #define IMAGE_AUGMENTER_OPENCV_HPP_
 /*!
  * \file image_augmenter_opencv.hpp
- * \brief threaded version of page iterator
+ * \brief affine augmentation of images, sampled directly from the decoded image
  * \author Naiyan Wang, Tianqi Chen
  */
-#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <mshadow/tensor.h>
+#include "../global.h"
+#include "../utils/utils.h"
 #include "../utils/random.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace cxxnet {
 /*! \brief helper class to do image augmentation */
@@ -14,8 +22,8 @@ class ImageAugmenter {
  public:
   // contructor
   ImageAugmenter(void)
-      : tmpres(false),
-        rotateM(2, 3, CV_32F) {
+      : tmpres(false), tmpsrc_(false), outimg_(false) {
+    interp_ = kBicubic;
     rand_crop_ = 0;
     crop_y_start_ = -1;
     crop_x_start_ = -1;
@@ -53,6 +61,17 @@ class ImageAugmenter {
     if (!strcmp(name, "fill_value")) fill_value_ = atoi(val);
     if (!strcmp(name, "mirror")) mirror_ = atoi(val);
     if (!strcmp(name, "rotate")) rotate_ = atoi(val);
+    if (!strcmp(name, "interpolation")) {
+      if (!strcmp(val, "nearest")) {
+        interp_ = kNearest;
+      } else if (!strcmp(val, "bilinear")) {
+        interp_ = kBilinear;
+      } else if (!strcmp(val, "bicubic")) {
+        interp_ = kBicubic;
+      } else {
+        utils::Error("ImageAugmenter: unknown interpolation %s", val);
+      }
+    }
     if (!strcmp(name, "rotate_list")) {
       const char *end = val + strlen(val);
       char buf[128];
@@ -64,22 +83,28 @@ class ImageAugmenter {
     }
   }
   /*!
-   * \brief augment src image, store result into dst
-   *   this function is not thread safe, and will only be called by one thread
-   *   however, it will tries to re-use memory space as much as possible
-   * \param src the source image
-   * \param source of random number
-   * \param dst the pointer to the place where we want to store the result
+   * \brief augment decoded image without converting it into float,
+   *   the rotation, shear, scale, aspect ratio and crop are combined into one affine transform,
+   *   and only the pixels of the output crop are sampled from the source image.
+   *   The result is a view of internal space, and is valid until next call of Process,
+   *   no allocation happens once the space is large enough for the output
+   * \param data the decoded image, in (height, width, channel)
+   * \param prnd source of random number
+   * \return the augmented image, in shape (height, width * channel), stride_ is the row pitch
    */
-  virtual cv::Mat Process(const cv::Mat &src,
-                          utils::RandomSampler *prnd) {
+  inline mshadow::Tensor<cpu, 2, unsigned char>
+  Process(mshadow::Tensor<cpu, 3, unsigned char> data,
+          utils::PhiloxSampler *prnd) {
+    const index_t nchannel = data.size(2);
+    utils::Check(nchannel == 1 || nchannel == 3,
+                 "ImageAugmenter: only support image of 1 or 3 channels");
     // shear
     float s = prnd->NextDouble() * max_shear_ratio_ * 2 - max_shear_ratio_;
     // rotate
     int angle = prnd->NextUInt32(max_rotate_angle_ * 2) - max_rotate_angle_;
     if (rotate_ > 0) angle = rotate_;
     if (rotate_list_.size() > 0) {
-      angle = rotate_list_[prnd->NextUInt32(rotate_list_.size() - 1)];
+      angle = rotate_list_[prnd->NextUInt32(rotate_list_.size())];
     }
     float a = cos(angle / 180.0 * M_PI);
     float b = sin(angle / 180.0 * M_PI);
@@ -89,82 +114,354 @@ class ImageAugmenter {
     float ratio = prnd->NextDouble() * max_aspect_ratio_ * 2 - max_aspect_ratio_ + 1;
     float hs = 2 * scale / (1 + ratio);
     float ws = ratio * hs;
-    // new width and height
-    float new_width = std::max(min_img_size_, std::min(max_img_size_, scale * src.cols));
-    float new_height = std::max(min_img_size_, std::min(max_img_size_, scale * src.rows));
-    //printf("%f %f %f %f %f %f %f %f %f\n", s, a, b, scale, ratio, hs, ws, new_width, new_height);
-    cv::Mat M(2, 3, CV_32F);
-    M.at<float>(0, 0) = hs * a - s * b * ws;
-    M.at<float>(1, 0) = -b * ws;
-    M.at<float>(0, 1) = hs * b + s * a * ws;
-    M.at<float>(1, 1) = a * ws;
-    float ori_center_width = M.at<float>(0, 0) * src.cols + M.at<float>(0, 1) * src.rows;
-    float ori_center_height = M.at<float>(1, 0) * src.cols + M.at<float>(1, 1) * src.rows;
-    M.at<float>(0, 2) = (new_width - ori_center_width) / 2;
-    M.at<float>(1, 2) = (new_height - ori_center_height) / 2;
-    cv::warpAffine(src, temp, M, cv::Size(new_width, new_height),
-                     cv::INTER_CUBIC,
-                     cv::BORDER_CONSTANT,
-                     cv::Scalar(fill_value_, fill_value_, fill_value_));
-    cv::Mat res = temp;
-    mshadow::index_t y = res.rows - shape_[2];
-    mshadow::index_t x = res.cols - shape_[1];
-    if (rand_crop_ != 0) {
+    const float src_width = static_cast<float>(data.size(1));
+    const float src_height = static_cast<float>(data.size(0));
+    // size of the transformed image, the crop is taken from it
+    int new_width = static_cast<int>(std::max(min_img_size_, std::min(max_img_size_, scale * src_width)));
+    int new_height = static_cast<int>(std::max(min_img_size_, std::min(max_img_size_, scale * src_height)));
+    // forward map from source to transformed image
+    float m[6];
+    m[0] = hs * a - s * b * ws;
+    m[3] = -b * ws;
+    m[1] = hs * b + s * a * ws;
+    m[4] = a * ws;
+    m[2] = (new_width - (m[0] * src_width + m[1] * src_height)) / 2;
+    m[5] = (new_height - (m[3] * src_width + m[4] * src_height)) / 2;
+    // crop of transformed image
+    const int crop_height = static_cast<int>(shape_[1]), crop_width = static_cast<int>(shape_[2]);
+    int y = new_height - crop_height;
+    int x = new_width - crop_width;
+    if (rand_crop_ != 0 && y >= 0 && x >= 0) {
       y = prnd->NextUInt32(y + 1);
       x = prnd->NextUInt32(x + 1);
     } else {
       y /= 2; x /= 2;
     }
-    cv::Rect roi(x, y, shape_[1], shape_[2]);
-    res = res(roi);
-    return res;
+    // inverse map from output crop to source, with the crop offset folded in
+    const float det = m[0] * m[4] - m[1] * m[3];
+    utils::Check(fabs(det) > 1e-6f, "ImageAugmenter: degenerated transform");
+    AffineMap inv;
+    inv.dxdj = m[4] / det; inv.dxdi = -m[1] / det;
+    inv.dydj = -m[3] / det; inv.dydi = m[0] / det;
+    inv.x0 = inv.dxdj * (x - m[2]) + inv.dxdi * (y - m[5]);
+    inv.y0 = inv.dydj * (x - m[2]) + inv.dydi * (y - m[5]);
+    outimg_.Resize(mshadow::Shape3(crop_height, crop_width, nchannel));
+    mshadow::Tensor<cpu, 2, unsigned char> src(
+        data.dptr_, mshadow::Shape2(data.size(0), data.size(1) * nchannel),
+        data.size(1) * data.stride_, NULL);
+    mshadow::Tensor<cpu, 2, unsigned char> dst(
+        outimg_.dptr_, mshadow::Shape2(crop_height, crop_width * nchannel),
+        crop_width * nchannel, NULL);
+    if (nchannel == 1) {
+      this->Sample<1>(src, inv, dst);
+    } else {
+      this->Sample<3>(src, inv, dst);
+    }
+    return dst;
   }
   /*!
-   * \brief augment src image, store result into dst
-   *   this function is not thread safe, and will only be called by one thread
-   *   however, it will tries to re-use memory space as much as possible
-   * \param src the source image
-   * \param source of random number
-   * \param dst the pointer to the place where we want to store the result
+   * \brief augment image in float, store result into internal space,
+   *   the image is converted into bytes and processed by the uint8 version
+   * \param data the image, in (channel, height, width)
+   * \param prnd source of random number
+   * \return the augmented image, valid until next call of Process
    */
-  virtual mshadow::Tensor<cpu, 3> Process(mshadow::Tensor<cpu, 3> data,
-                                          utils::RandomSampler *prnd) {
+  inline mshadow::Tensor<cpu, 3> Process(mshadow::Tensor<cpu, 3> data,
+                                         utils::PhiloxSampler *prnd) {
     if (!NeedProcess()) return data;
-    cv::Mat res(data.size(1), data.size(2), CV_8UC3);
+    const index_t nchannel = data.size(0);
+    utils::Check(nchannel == 1 || nchannel == 3,
+                 "ImageAugmenter: only support image of 1 or 3 channels");
+    tmpsrc_.Resize(mshadow::Shape3(data.size(1), data.size(2), nchannel));
     for (index_t i = 0; i < data.size(1); ++i) {
-      for (index_t j = 0; j < data.size(2); ++j) {
-        res.at<cv::Vec3b>(i, j)[0] = data[2][i][j];
-        res.at<cv::Vec3b>(i, j)[1] = data[1][i][j];
-        res.at<cv::Vec3b>(i, j)[2] = data[0][i][j];
+      unsigned char *row = tmpsrc_[i].dptr_;
+      for (index_t c = 0; c < nchannel; ++c) {
+        const real_t *srow = data[c][i].dptr_;
+        for (index_t j = 0; j < data.size(2); ++j) {
+          row[j * nchannel + c] = static_cast<unsigned char>(srow[j]);
+        }
       }
     }
-    res = this->Process(res, prnd);
-    tmpres.Resize(mshadow::Shape3(3, res.rows, res.cols));
-    for (index_t i = 0; i < tmpres.size(1); ++i) {
-      for (index_t j = 0; j < tmpres.size(2); ++j) {
-        cv::Vec3b bgr = res.at<cv::Vec3b>(i, j);
-        tmpres[0][i][j] = bgr[2];
-        tmpres[1][i][j] = bgr[1];
-        tmpres[2][i][j] = bgr[0];
+    mshadow::Tensor<cpu, 2, unsigned char> res = this->Process(tmpsrc_, prnd);
+    const index_t width = res.size(1) / nchannel;
+    tmpres.Resize(mshadow::Shape3(nchannel, res.size(0), width));
+    for (index_t i = 0; i < res.size(0); ++i) {
+      const unsigned char *row = res[i].dptr_;
+      for (index_t c = 0; c < nchannel; ++c) {
+        real_t *drow = tmpres[c][i].dptr_;
+        for (index_t j = 0; j < width; ++j) {
+          drow[j] = row[j * nchannel + c];
+        }
       }
     }
     return tmpres;
   }
-
- private:
-  // whether skip processing
+  /*! \brief whether Process changes the image, if not, Process can be skipped */
   inline bool NeedProcess(void) const {
     if (max_rotate_angle_ > 0 || max_shear_ratio_ > 0.0f
         || rotate_ > 0 || rotate_list_.size() > 0) return true;
     if (min_crop_size_ > 0 && max_crop_size_ > 0) return true;
     return false;
   }
+
+ private:
+  /*! \brief interpolation method */
+  enum InterpMethod {
+    kNearest,
+    kBilinear,
+    kBicubic
+  };
+  /*!
+   * \brief map from output pixel (i, j) to source position,
+   *   x = x0 + dxdj * j + dxdi * i, y = y0 + dydj * j + dydi * i
+   */
+  struct AffineMap {
+    float x0, y0, dxdj, dxdi, dydj, dydi;
+  };
+  // sample the output image from src, pixels outside src are fill_value
+  template<int nchannel>
+  inline void Sample(mshadow::Tensor<cpu, 2, unsigned char> src,
+                     const AffineMap &inv,
+                     mshadow::Tensor<cpu, 2, unsigned char> dst) const {
+    switch (interp_) {
+      case kNearest: this->SampleRows<nchannel, kNearest>(src, inv, dst); break;
+      case kBilinear: this->SampleRows<nchannel, kBilinear>(src, inv, dst); break;
+      default: this->SampleRows<nchannel, kBicubic>(src, inv, dst);
+    }
+  }
+  // sample with the interpolation method fixed at compile time, each output row is split into
+  // the span of pixels whose taps all lie in src, which is sampled without boundary check,
+  // and the border on both sides of it
+  template<int nchannel, int method>
+  inline void SampleRows(mshadow::Tensor<cpu, 2, unsigned char> src,
+                         const AffineMap &inv,
+                         mshadow::Tensor<cpu, 2, unsigned char> dst) const {
+    const int height = static_cast<int>(src.size(0));
+    const int width = static_cast<int>(src.size(1)) / nchannel;
+    const int owidth = static_cast<int>(dst.size(1)) / nchannel;
+    for (index_t i = 0; i < dst.size(0); ++i) {
+      const float rx = inv.x0 + inv.dxdi * i;
+      const float ry = inv.y0 + inv.dydi * i;
+      unsigned char *out = dst[i].dptr_;
+      int begin, end;
+      this->InteriorSpan<method>(rx, ry, inv, height, width, owidth, &begin, &end);
+      int j = 0;
+      for (; j < begin; ++j) {
+        this->SamplePixel<nchannel, method, false>(src, height, width, rx + inv.dxdj * j,
+                                                   ry + inv.dydj * j, out + j * nchannel);
+      }
+#if defined(__SSE2__)
+      if (method != kNearest) {
+        j = this->SampleSpanSSE<nchannel, method>(src, rx, ry, inv, j, end, out);
+      }
+#endif
+      for (; j < end; ++j) {
+        this->SamplePixel<nchannel, method, true>(src, height, width, rx + inv.dxdj * j,
+                                                  ry + inv.dydj * j, out + j * nchannel);
+      }
+      for (; j < owidth; ++j) {
+        this->SamplePixel<nchannel, method, false>(src, height, width, rx + inv.dxdj * j,
+                                                   ry + inv.dydj * j, out + j * nchannel);
+      }
+    }
+  }
+  // whether the taps of sample position (sx, sy) lie in the image, with one pixel of margin,
+  // so that a position computed in another order can not step out of the image
+  template<int method>
+  inline static bool TapsInside(float sx, float sy, int height, int width) {
+    const float m = method == kNearest ? 0.5f : (method == kBilinear ? 1.0f : 2.0f);
+    return sx >= m && sx < width - 1 - m && sy >= m && sy < height - 1 - m;
+  }
+  // find [begin, end) of output pixels in row starting at (rx, ry) whose taps lie in the image
+  template<int method>
+  inline static void InteriorSpan(float rx, float ry, const AffineMap &inv,
+                                  int height, int width, int owidth, int *begin, int *end) {
+    const float m = method == kNearest ? 0.5f : (method == kBilinear ? 1.0f : 2.0f);
+    double lo = 0.0, hi = owidth;
+    ClipSpan(rx, inv.dxdj, m, width - 1 - m, &lo, &hi);
+    ClipSpan(ry, inv.dydj, m, height - 1 - m, &lo, &hi);
+    if (!(lo < hi)) {
+      *begin = *end = 0; return;
+    }
+    // lo and hi are in [0, owidth] here
+    int b = static_cast<int>(std::ceil(lo)), e = static_cast<int>(std::ceil(hi));
+    // the positions are rounded, the span is a guess and is shrunk until both ends are
+    // inside, pixels between two inside pixels are inside, as the positions are monotonic
+    while (b < e && !TapsInside<method>(rx + inv.dxdj * b, ry + inv.dydj * b, height, width)) ++b;
+    while (e > b && !TapsInside<method>(rx + inv.dxdj * (e - 1), ry + inv.dydj * (e - 1),
+                                        height, width)) --e;
+    *begin = b; *end = e;
+  }
+  // clip [lo, hi) to the j that satisfy vmin <= v0 + dv * j < vmax
+  inline static void ClipSpan(float v0, float dv, float vmin, float vmax,
+                              double *lo, double *hi) {
+    if (dv == 0.0f) {
+      if (v0 < vmin || v0 >= vmax) *hi = *lo;
+      return;
+    }
+    double a = (vmin - v0) / static_cast<double>(dv);
+    double b = (vmax - v0) / static_cast<double>(dv);
+    if (dv < 0.0f) std::swap(a, b);
+    *lo = std::max(*lo, a);
+    *hi = std::min(*hi, b);
+  }
+  // sample one output pixel at (sx, sy), boundary is not checked if inside is set
+  template<int nchannel, int method, bool inside>
+  inline void SamplePixel(mshadow::Tensor<cpu, 2, unsigned char> src, int height, int width,
+                          float sx, float sy, unsigned char *out) const {
+    if (method == kNearest) {
+      const int x = static_cast<int>(floor(sx + 0.5f)), y = static_cast<int>(floor(sy + 0.5f));
+      for (int c = 0; c < nchannel; ++c) {
+        out[c] = inside ? src[y][x * nchannel + c] :
+            this->Pixel<nchannel>(src, height, width, y, x, c);
+      }
+      return;
+    }
+    const int x = static_cast<int>(floor(sx)), y = static_cast<int>(floor(sy));
+    const float fx = sx - x, fy = sy - y;
+    if (method == kBilinear) {
+      const float wx[2] = {1.0f - fx, fx}, wy[2] = {1.0f - fy, fy};
+      this->Filter<nchannel, 2, inside>(src, height, width, y, x, wy, wx, out);
+    } else {
+      float wx[4], wy[4];
+      CubicWeight(fx, wx); CubicWeight(fy, wy);
+      this->Filter<nchannel, 4, inside>(src, height, width, y - 1, x - 1, wy, wx, out);
+    }
+  }
+  // weighted sum of ntap * ntap pixels starting at (y, x)
+  template<int nchannel, int ntap, bool inside>
+  inline void Filter(mshadow::Tensor<cpu, 2, unsigned char> src, int height, int width,
+                     int y, int x, const float *wy, const float *wx,
+                     unsigned char *out) const {
+    float sum[nchannel];
+    for (int c = 0; c < nchannel; ++c) sum[c] = 0.0f;
+    for (int ty = 0; ty < ntap; ++ty) {
+      float rsum[nchannel];
+      for (int c = 0; c < nchannel; ++c) rsum[c] = 0.0f;
+      if (inside) {
+        const unsigned char *p = src[y + ty].dptr_ + x * nchannel;
+        for (int tx = 0; tx < ntap; ++tx) {
+          for (int c = 0; c < nchannel; ++c) {
+            rsum[c] += wx[tx] * p[tx * nchannel + c];
+          }
+        }
+      } else {
+        for (int tx = 0; tx < ntap; ++tx) {
+          for (int c = 0; c < nchannel; ++c) {
+            rsum[c] += wx[tx] * this->Pixel<nchannel>(src, height, width, y + ty, x + tx, c);
+          }
+        }
+      }
+      for (int c = 0; c < nchannel; ++c) sum[c] += wy[ty] * rsum[c];
+    }
+    for (int c = 0; c < nchannel; ++c) {
+      const float v = sum[c] + 0.5f;
+      out[c] = static_cast<unsigned char>(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+    }
+  }
+#if defined(__SSE2__)
+  // sample pixels [begin, end) of the interior span, 4 output pixels at a time, the positions,
+  // weights and sums are computed in vector, the taps are gathered one by one,
+  // return the first pixel that is left to the scalar loop
+  template<int nchannel, int method>
+  inline int SampleSpanSSE(mshadow::Tensor<cpu, 2, unsigned char> src, float rx, float ry,
+                           const AffineMap &inv, int begin, int end,
+                           unsigned char *out) const {
+    const int ntap = method == kBilinear ? 2 : 4;
+    // offset of first tap to the sample position
+    const int off = method == kBilinear ? 0 : 1;
+    const __m128 vrx = _mm_set1_ps(rx), vry = _mm_set1_ps(ry);
+    const __m128 vdx = _mm_set1_ps(inv.dxdj), vdy = _mm_set1_ps(inv.dydj);
+    const __m128 vhalf = _mm_set1_ps(0.5f), vzero = _mm_setzero_ps();
+    const __m128 vmax = _mm_set1_ps(255.0f);
+    int j = begin;
+    for (; j + 4 <= end; j += 4) {
+      const __m128 vj = _mm_cvtepi32_ps(_mm_setr_epi32(j, j + 1, j + 2, j + 3));
+      const __m128 sx = _mm_add_ps(vrx, _mm_mul_ps(vdx, vj));
+      const __m128 sy = _mm_add_ps(vry, _mm_mul_ps(vdy, vj));
+      // positions in the interior are positive, truncation is floor
+      const __m128i ix = _mm_cvttps_epi32(sx), iy = _mm_cvttps_epi32(sy);
+      __m128 wx[ntap], wy[ntap];
+      VecWeight<method>(_mm_sub_ps(sx, _mm_cvtepi32_ps(ix)), wx);
+      VecWeight<method>(_mm_sub_ps(sy, _mm_cvtepi32_ps(iy)), wy);
+      int xs[4], ys[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(xs), ix);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(ys), iy);
+      __m128 sum[nchannel];
+      for (int c = 0; c < nchannel; ++c) sum[c] = vzero;
+      for (int ty = 0; ty < ntap; ++ty) {
+        const unsigned char *p[4];
+        for (int k = 0; k < 4; ++k) {
+          p[k] = src[ys[k] - off + ty].dptr_ + (xs[k] - off) * nchannel;
+        }
+        __m128 rsum[nchannel];
+        for (int c = 0; c < nchannel; ++c) rsum[c] = vzero;
+        for (int tx = 0; tx < ntap; ++tx) {
+          for (int c = 0; c < nchannel; ++c) {
+            const int o = tx * nchannel + c;
+            const __m128 v = _mm_setr_ps(p[0][o], p[1][o], p[2][o], p[3][o]);
+            rsum[c] = _mm_add_ps(rsum[c], _mm_mul_ps(wx[tx], v));
+          }
+        }
+        for (int c = 0; c < nchannel; ++c) {
+          sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(wy[ty], rsum[c]));
+        }
+      }
+      for (int c = 0; c < nchannel; ++c) {
+        const __m128 v = _mm_min_ps(_mm_max_ps(_mm_add_ps(sum[c], vhalf), vzero), vmax);
+        int r[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r), _mm_cvttps_epi32(v));
+        for (int k = 0; k < 4; ++k) {
+          out[(j + k) * nchannel + c] = static_cast<unsigned char>(r[k]);
+        }
+      }
+    }
+    return j;
+  }
+  // weights of taps for fraction t of 4 positions, same as the scalar version
+  template<int method>
+  inline static void VecWeight(__m128 t, __m128 *w) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    if (method == kBilinear) {
+      w[0] = _mm_sub_ps(one, t); w[1] = t;
+      return;
+    }
+    const float A = -0.75f;
+    const __m128 t1 = _mm_add_ps(t, one), s = _mm_sub_ps(one, t);
+    const __m128 va = _mm_set1_ps(A), va2 = _mm_set1_ps(A + 2), va3 = _mm_set1_ps(A + 3);
+    w[0] = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(va, t1),
+                                                                  _mm_set1_ps(5 * A)), t1),
+                                            _mm_set1_ps(8 * A)), t1), _mm_set1_ps(4 * A));
+    w[1] = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(va2, t), va3), t), t), one);
+    w[2] = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(va2, s), va3), s), s), one);
+    w[3] = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, w[0]), w[1]), w[2]);
+  }
+#endif
+  // pixel of src, fill_value if it is outside
+  template<int nchannel>
+  inline unsigned char Pixel(mshadow::Tensor<cpu, 2, unsigned char> src, int height, int width,
+                             int y, int x, int c) const {
+    if (y < 0 || y >= height || x < 0 || x >= width) {
+      return static_cast<unsigned char>(fill_value_);
+    }
+    return src[y][x * nchannel + c];
+  }
+  // weights of the 4 taps of bicubic interpolation, same kernel as opencv
+  inline static void CubicWeight(float t, float *w) {
+    const float A = -0.75f;
+    w[0] = ((A * (t + 1) - 5 * A) * (t + 1) + 8 * A) * (t + 1) - 4 * A;
+    w[1] = ((A + 2) * t - (A + 3)) * t * t + 1;
+    w[2] = ((A + 2) * (1 - t) - (A + 3)) * (1 - t) * (1 - t) + 1;
+    w[3] = 1.0f - w[0] - w[1] - w[2];
+  }
+  // interpolation used in sampling
+  int interp_;
   // temp input space
   mshadow::TensorContainer<cpu, 3> tmpres;
-  // temporal space
-  cv::Mat temp0, temp, temp2;
-  // rotation param
-  cv::Mat rotateM;
+  // decoded image of float input
+  mshadow::TensorContainer<cpu, 3, unsigned char> tmpsrc_;
+  // output of uint8 process, in (height, width, channel)
+  mshadow::TensorContainer<cpu, 3, unsigned char> outimg_;
   // parameters
   /*! \brief input shape */
   mshadow::Shape<4> shape_;
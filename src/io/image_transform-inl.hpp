@@ -0,0 +1,204 @@
+#ifndef CXXNET_IO_IMAGE_TRANSFORM_INL_HPP_
+#define CXXNET_IO_IMAGE_TRANSFORM_INL_HPP_
+/*!
+ * \file image_transform-inl.hpp
+ * \brief fused kernel that turns a decoded uint8 image into network input,
+ *   crop, mirror, mean substraction and scaling are done in a single pass
+ */
+#include <algorithm>
+#include <mshadow/tensor.h>
+#include "../global.h"
+#include "../utils/utils.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace cxxnet {
+/*!
+ * \brief parameters of the fused transform, the output is
+ *   out[c][i][j] = (src[y + i][x + j'][c] - mean) * alpha + beta,
+ *   where j' = j, or width - 1 - j when mirror is set
+ */
+struct ImageTransform {
+  /*! \brief crop offset in source image */
+  index_t y, x;
+  /*! \brief whether flip the output horizontally */
+  bool mirror;
+  /*! \brief scale and shift after mean substraction */
+  real_t alpha, beta;
+  /*! \brief mean value of each output channel, can be NULL */
+  const real_t *mean_value;
+  /*! \brief mean image, in (channel, height, width), unused when dptr_ is NULL */
+  mshadow::Tensor<cpu, 3> mean_img;
+  /*!
+   * \brief true if mean_img has the size of source image and is cropped, mirrored together with it,
+   *   false if mean_img has the size of output, it is substracted after crop and mirrored with the result
+   */
+  bool mean_full;
+  ImageTransform(void)
+      : y(0), x(0), mirror(false), alpha(1.0f), beta(0.0f),
+        mean_value(NULL), mean_full(false) {
+    mean_img.dptr_ = NULL;
+  }
+};
+
+/*!
+ * \brief dst[j] = (src[j] - (mean == NULL ? mean_const : mean[j])) * alpha + beta
+ */
+inline void TransformRow(const unsigned char *src, const real_t *mean,
+                         real_t mean_const, real_t alpha, real_t beta,
+                         real_t *dst, index_t n) {
+  index_t j = 0;
+#if defined(__AVX2__)
+  {
+    const __m256 valpha = _mm256_set1_ps(alpha);
+    const __m256 vbeta = _mm256_set1_ps(beta);
+    const __m256 vmconst = _mm256_set1_ps(mean_const);
+    for (; j + 8 <= n; j += 8) {
+      __m128i u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + j));
+      __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(u8));
+      __m256 m = mean == NULL ? vmconst : _mm256_loadu_ps(mean + j);
+      v = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(v, m), valpha), vbeta);
+      _mm256_storeu_ps(dst + j, v);
+    }
+  }
+#elif defined(__SSE2__)
+  {
+    const __m128 valpha = _mm_set1_ps(alpha);
+    const __m128 vbeta = _mm_set1_ps(beta);
+    const __m128 vmconst = _mm_set1_ps(mean_const);
+    const __m128i zero = _mm_setzero_si128();
+    for (; j + 16 <= n; j += 16) {
+      __m128i u8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+      __m128i u16[2];
+      u16[0] = _mm_unpacklo_epi8(u8, zero);
+      u16[1] = _mm_unpackhi_epi8(u8, zero);
+      for (int k = 0; k < 4; ++k) {
+        __m128i u32 = (k % 2 == 0) ?
+            _mm_unpacklo_epi16(u16[k / 2], zero) : _mm_unpackhi_epi16(u16[k / 2], zero);
+        __m128 v = _mm_cvtepi32_ps(u32);
+        __m128 m = mean == NULL ? vmconst : _mm_loadu_ps(mean + j + k * 4);
+        v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, m), valpha), vbeta);
+        _mm_storeu_ps(dst + j + k * 4, v);
+      }
+    }
+  }
+#endif
+  for (; j < n; ++j) {
+    real_t m = mean == NULL ? mean_const : mean[j];
+    dst[j] = (static_cast<real_t>(src[j]) - m) * alpha + beta;
+  }
+}
+
+/*!
+ * \brief crop, mirror and normalize a decoded image into out in one pass
+ * \param src decoded image, in shape (height, width * nchannel), pixels are stored
+ *        in interleaved channel order, stride_ of src is the pitch of rows
+ * \param nchannel number of channels in the source image, if the source has one channel
+ *        and out has more channels, the channel is copied to all output channels
+ * \param param parameters of the transform
+ * \param out output tensor in (channel, height, width), the crop region must lie in src
+ */
+inline void TransformImage(mshadow::Tensor<cpu, 2, unsigned char> src,
+                           index_t nchannel,
+                           const ImageTransform &param,
+                           mshadow::Tensor<cpu, 3> out) {
+  const index_t oh = out.size(1), ow = out.size(2);
+  utils::Assert(param.y + oh <= src.size(0) &&
+                (param.x + ow) * nchannel <= src.size(1),
+                "TransformImage: crop region exceed image boundary");
+  utils::Assert(nchannel == 1 || nchannel == out.size(0),
+                "TransformImage: channel number mismatch");
+  // process rows in blocks, so that temporal space is on stack
+  const index_t kBlock = 256;
+  unsigned char buf[kBlock];
+  real_t mbuf[kBlock];
+  for (index_t c = 0; c < out.size(0); ++c) {
+    const index_t sc = nchannel == 1 ? 0 : c;
+    const real_t mconst = param.mean_value == NULL ? 0.0f : param.mean_value[c];
+    for (index_t i = 0; i < oh; ++i) {
+      const unsigned char *srow = src[param.y + i].dptr_ + sc;
+      real_t *drow = out[c][i].dptr_;
+      for (index_t j0 = 0; j0 < ow; j0 += kBlock) {
+        const index_t n = std::min(kBlock, ow - j0);
+        // gather one channel of the block, in output order
+        for (index_t j = 0; j < n; ++j) {
+          const index_t sx = param.x + (param.mirror ? ow - 1 - (j0 + j) : j0 + j);
+          buf[j] = srow[sx * nchannel];
+        }
+        const real_t *mrow = NULL;
+        if (param.mean_img.dptr_ != NULL) {
+          // the mean row, in the coordinate of the unmirrored crop
+          const real_t *mcrop = param.mean_full ?
+              param.mean_img[c][param.y + i].dptr_ + param.x : param.mean_img[c][i].dptr_;
+          if (!param.mirror) {
+            mrow = mcrop + j0;
+          } else {
+            for (index_t j = 0; j < n; ++j) {
+              mbuf[j] = mcrop[ow - 1 - (j0 + j)];
+            }
+            mrow = mbuf;
+          }
+        }
+        TransformRow(buf, mrow, mconst, param.alpha, param.beta, drow + j0, n);
+      }
+    }
+  }
+}
+
+/*!
+ * \brief crop and mirror a decoded image into uint8 (channel, height, width) tensor,
+ *   normalization fields of param are ignored, they are left to the consumer
+ * \param src decoded image, same layout as TransformImage
+ * \param nchannel number of channels in the source image
+ * \param param parameters of the transform, only y, x and mirror are used
+ * \param out output tensor in (channel, height, width), the crop region must lie in src
+ */
+inline void CropImage(mshadow::Tensor<cpu, 2, unsigned char> src,
+                      index_t nchannel,
+                      const ImageTransform &param,
+                      mshadow::Tensor<cpu, 3, unsigned char> out) {
+  const index_t oh = out.size(1), ow = out.size(2);
+  utils::Assert(param.y + oh <= src.size(0) &&
+                (param.x + ow) * nchannel <= src.size(1),
+                "CropImage: crop region exceed image boundary");
+  utils::Assert(nchannel == 1 || nchannel == out.size(0),
+                "CropImage: channel number mismatch");
+  for (index_t c = 0; c < out.size(0); ++c) {
+    const index_t sc = nchannel == 1 ? 0 : c;
+    for (index_t i = 0; i < oh; ++i) {
+      const unsigned char *srow = src[param.y + i].dptr_ + sc;
+      unsigned char *drow = out[c][i].dptr_;
+      if (param.mirror) {
+        for (index_t j = 0; j < ow; ++j) {
+          drow[j] = srow[(param.x + ow - 1 - j) * nchannel];
+        }
+      } else {
+        for (index_t j = 0; j < ow; ++j) {
+          drow[j] = srow[(param.x + j) * nchannel];
+        }
+      }
+    }
+  }
+}
+
+/*!
+ * \brief convert a decoded image into (channel, height, width) float tensor without any transform
+ * \param src decoded image in (height, width, channel)
+ * \param nchannel number of output channels, a single channel image is copied to all of them
+ * \param out the output, will be resized
+ */
+inline void ConvertImage(mshadow::Tensor<cpu, 3, unsigned char> src,
+                         index_t nchannel,
+                         mshadow::TensorContainer<cpu, 3> *out) {
+  out->Resize(mshadow::Shape3(nchannel, src.size(0), src.size(1)));
+  mshadow::Tensor<cpu, 2, unsigned char> src2d(
+      src.dptr_, mshadow::Shape2(src.size(0), src.size(1) * src.size(2)),
+      src.size(1) * src.stride_, NULL);
+  TransformImage(src2d, src.size(2), ImageTransform(), *out);
+}
+}  // namespace cxxnet
+#endif  // CXXNET_IO_IMAGE_TRANSFORM_INL_HPP_
@@ -0,0 +1,98 @@
+#ifndef CXXNET_ATTACH_BIN_ITER_INL_HPP_
+#define CXXNET_ATTACH_BIN_ITER_INL_HPP_
+/*!
+ * \file iter_attach_bin-inl.hpp
+ * \brief iterator that attach additional data stored in binary attach file,
+ *   the binary version of AttachTxtIterator, see tools/txt2attbin.cpp
+ */
+#include <vector>
+#include <cstring>
+#include <mshadow/tensor.h>
+#include "./data.h"
+#include "../utils/utils.h"
+#include "../utils/io.h"
+
+namespace cxxnet {
+class AttachBinIterator : public IIterator<DataBatch> {
+ public:
+  AttachBinIterator(IIterator<DataBatch> *base)
+      : base_(base) {
+    batch_size_ = 0;
+    extra_data_.dptr_ = NULL;
+  }
+  virtual void SetParam(const char *name, const char *val) {
+    base_->SetParam(name, val);
+    if (!strcmp(name, "filename")) filename_ = val;
+    if (!strcmp(name, "batch_size"))  batch_size_ = (index_t)atoi(val);
+  }
+  virtual ~AttachBinIterator(void) {
+    delete base_;
+    if (extra_data_.dptr_ != NULL) mshadow::FreeSpace(&extra_data_);
+  }
+  virtual void Init(void) {
+    base_->Init();
+    file_.Open(filename_.c_str());
+    extra_data_ = mshadow::NewTensor<cpu>(
+        mshadow::Shape4(batch_size_, 1, 1, file_.dim()), 0.0f, false);
+    rows_.resize(batch_size_);
+  }
+  virtual void BeforeFirst(void) {
+    base_->BeforeFirst();
+  }
+  virtual bool Next(void) {
+    if (base_->Next()) {
+      out_ = base_->Value();
+      utils::Check(out_.batch_size == batch_size_ && out_.inst_index != NULL,
+                   "AttachBin: batch_size mismatch with input");
+      out_.extra_data.clear();
+      out_.extra_data.push_back(extra_data_);
+      this->Gather();
+      return true;
+    } else {
+      return false;
+    }
+  }
+  virtual const DataBatch &Value(void) const {
+    return out_;
+  }
+
+ private:
+  // copy the rows of instances in the batch into extra data
+  inline void Gather(void) {
+    // resolve all rows first, so that the copy is a tight loop over contiguous rows
+    for (index_t top = 0; top < batch_size_; ++top) {
+      rows_[top] = file_.Find(out_.inst_index[top]);
+    }
+    const size_t nbytes = sizeof(float) * file_.dim();
+    for (index_t top = 0; top < batch_size_; ++top) {
+#if defined(__GNUC__)
+      if (top + 1 < batch_size_ && rows_[top + 1] != NULL) {
+        __builtin_prefetch(rows_[top + 1]);
+      }
+#endif
+      real_t *dst = extra_data_[top][0][0].dptr_;
+      if (rows_[top] != NULL) {
+        memcpy(dst, rows_[top], nbytes);
+      } else {
+        // instance without extra data
+        memset(dst, 0, nbytes);
+      }
+    }
+  }
+  /*! \brief batch size */
+  index_t batch_size_;
+  /*! \brief the output data batch */
+  DataBatch out_;
+  /*! \brief filename of the extra data */
+  std::string filename_;
+  /*! \brief the binary attach file */
+  utils::BinaryAttachFile file_;
+  /*! \brief space of extra data */
+  mshadow::Tensor<cpu, 4> extra_data_;
+  /*! \brief rows of instances in current batch */
+  std::vector<const float*> rows_;
+  /*! \brief base iterator */
+  IIterator<DataBatch> *base_;
+};
+}  // namespace cxxnet
+#endif  // CXXNET_ATTACH_BIN_ITER_INL_HPP_
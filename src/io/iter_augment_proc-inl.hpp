@@ -11,10 +11,11 @@
 #include "../utils/io.h"
 #include "../utils/random.h"
 #include "../utils/thread_buffer.h"
+#include "../utils/thread_pool.h"
+#include "../utils/io_profiler.h"
+#include "./image_transform-inl.hpp"
 
-#if CXXNET_USE_OPENCV
 #include "./image_augmenter-inl.hpp"
-#endif
 
 namespace cxxnet {
 /*! \brief create a batch iterator from single instance iterator */
@@ -35,42 +36,78 @@ public:
     mean_r_ = 0.0f;
     mean_g_ = 0.0f;
     mean_b_ = 0.0f;
+    mean_value_[0] = mean_value_[1] = mean_value_[2] = 0.0f;
     mirror_ = 0;
     max_random_illumination_ = 0.0f;
     max_random_contrast_ = 0.0f;
-    rnd.Seed(kRandMagic);
+    slot_.dptr_ = NULL;
+    slot_uint8_.dptr_ = NULL;
+    dtype_ = DataBatch::kFloat32;
+    output_uint8_ = false;
+    shuffle_ = 0;
+    mean_nthread_ = 4;
+    mean_samples_ = 0;
+    mean_checkpoint_ = 0;
+    stage_ = NULL;
+    seed_ = kRandMagic;
+    epoch_ = 0;
   }
   virtual ~AugmentIterator(void) {
     delete base_;
   }
   virtual void SetParam(const char *name, const char *val) {
     base_->SetParam(name, val);
+    cfg_.push_back(std::make_pair(std::string(name), std::string(val)));
     if (!strcmp(name, "input_shape")) {
       utils::Check(sscanf(val, "%u,%u,%u", &shape_[0], &shape_[1], &shape_[2]) == 3,
                    "input_shape must be three consecutive integers without space example: 1,1,200 ");
     }
-    if (!strcmp(name, "seed_data")) rnd.Seed(kRandMagic + atoi(val));
+    if (!strcmp(name, "seed_data")) seed_ = kRandMagic + atoi(val);
+    if (!strcmp(name, "shuffle") || !strcmp(name, "global_shuffle")) {
+      shuffle_ = shuffle_ || atoi(val) != 0;
+    }
     if (!strcmp(name, "rand_crop")) rand_crop_ = atoi(val);
     if (!strcmp(name, "silent")) silent_ = atoi(val);
     if (!strcmp(name, "divideby")) scale_ = static_cast<real_t>(1.0f / atof(val));
     if (!strcmp(name, "scale")) scale_ = static_cast<real_t>(atof(val));
     if (!strcmp(name, "image_mean")) name_meanimg_ = val;
+    if (!strcmp(name, "image_mean_nthread")) mean_nthread_ = atoi(val);
+    if (!strcmp(name, "image_mean_samples")) mean_samples_ = strtoul(val, NULL, 10);
+    if (!strcmp(name, "image_mean_checkpoint")) mean_checkpoint_ = strtoul(val, NULL, 10);
     if (!strcmp(name, "crop_y_start")) crop_y_start_ = atoi(val);
     if (!strcmp(name, "crop_x_start")) crop_x_start_ = atoi(val);
     if (!strcmp(name, "rand_mirror")) rand_mirror_ = atoi(val);
     if (!strcmp(name, "mirror")) mirror_ = atoi(val);
     if (!strcmp(name, "max_random_contrast")) max_random_contrast_ = atof(val);
     if (!strcmp(name, "max_random_illumination")) max_random_illumination_ = atof(val);
+    if (!strcmp(name, "dtype")) {
+      if (!strcmp(val, "uint8")) {
+        dtype_ = DataBatch::kUInt8;
+      } else {
+        utils::Check(!strcmp(val, "float32"), "unknown dtype %s, can be float32 or uint8", val);
+        dtype_ = DataBatch::kFloat32;
+      }
+    }
     if (!strcmp(name, "mean_value")) {
-      utils::Check(sscanf(val, "%f,%f,%f", &mean_b_, &mean_g_, &mean_r_) == 3,
-                   "mean value must be three consecutive float without space example: 128,127.5,128.2 ");
+      int n = sscanf(val, "%f,%f,%f", &mean_b_, &mean_g_, &mean_r_);
+      utils::Check(n == 3 || n == 1,
+                   "mean value must be three consecutive float without space example: 128,127.5,128.2, "\
+                   "or one float for single channel image");
+      if (n == 1) mean_g_ = mean_r_ = mean_b_;
+      mean_value_[0] = mean_b_; mean_value_[1] = mean_g_; mean_value_[2] = mean_r_;
     }
-#if CXXNET_USE_OPENCV
     aug.SetParam(name, val);
-#endif
   }
   virtual void Init(void) {
     base_->Init();
+    if (mean_r_ > 0.0f || mean_g_ > 0.0f || mean_b_ > 0.0f) {
+      utils::Check(shape_[1] == 1 || shape_[0] == 1 || shape_[0] == 3,
+                   "mean_value only supports image of 1 or 3 channels");
+    } else if (dtype_ == DataBatch::kUInt8 && name_meanimg_.length() != 0) {
+      // the network substracts the mean image after the crop is mirrored, the mean is not mirrored
+      utils::Check(rand_mirror_ == 0 && mirror_ == 0,
+                   "dtype=uint8 does not support image_mean with rand_mirror or mirror, use mean_value");
+    }
     meanfile_ready_ = false;
     if (name_meanimg_.length() != 0) {
       FILE *fi = fopen64(name_meanimg_.c_str(), "rb");
@@ -86,30 +123,64 @@ public:
         meanfile_ready_ = true;
       }
     }
+    // mean image is always created in float
+    if (dtype_ == DataBatch::kUInt8) this->InitNorm();
+    // registered after the mean image is created, which is not counted
+    stage_ = utils::IOProfiler::Get()->Register("AugmentIterator");
   }
   virtual void BeforeFirst(void) {
     base_->BeforeFirst();
+    epoch_ += 1;
   }
   virtual const DataInst &Value(void) const {
     return out_;
   }
+  virtual bool ReserveSlot(const DataInst &slot) {
+    slot_ = slot.data;
+    slot_uint8_ = slot.data_uint8;
+    return true;
+  }
+  /*!
+   * \brief set the round of data, the augmentation of an instance is decided by
+   *   seed_data, round and index of instance; the round is counted by BeforeFirst,
+   *   set it when BeforeFirst is called for other purpose
+   */
+  inline void set_epoch(unsigned epoch) {
+    epoch_ = epoch;
+  }
+  /*! \return the base iterator */
+  inline IIterator<DataInst> *base(void) const {
+    return base_;
+  }
+  /*!
+   * \brief replace the base iterator, e.g. by an iterator that wraps the current base,
+   *   must be called before Init
+   */
+  inline void set_base(IIterator<DataInst> *base) {
+    base_ = base;
+  }
 
 private:
   inline void SetData(const DataInst &d) {
     using namespace mshadow::expr;
     out_.label = d.label;
     out_.index = d.index;
+    if (d.data.dptr_ == NULL) {
+      this->SetRawData(d); return;
+    }
+    utils::Check(!output_uint8_, "dtype=uint8 requires an iterator that outputs decoded image, e.g. imgbinx");
     mshadow::Tensor<cpu, 3> data = d.data;
-#if CXXNET_USE_OPENCV
     data = aug.Process(data, &rnd);
-#endif
 
-    img_.Resize(mshadow::Shape3(data.shape_[0], shape_[1], shape_[2]));    
+    mshadow::Tensor<cpu, 3> dst = this->OutSpace(data.shape_[0]);
     if (shape_[1] == 1) {
-      img_ = data * scale_;
+      dst = data * scale_;
     } else {
       utils::Assert(data.size(1) >= shape_[1] && data.size(2) >= shape_[2],
                     "Data size must be bigger than the input size to net.");
+      utils::Check(data.size(0) == shape_[0],
+                   "image of %u channels can not be used as input_shape of %u channels",
+                   data.size(0), shape_[0]);
       mshadow::index_t yy = data.size(1) - shape_[1];
       mshadow::index_t xx = data.size(2) - shape_[2];
       if (rand_crop_ != 0 && (yy != 0 || xx != 0)) {
@@ -128,77 +199,472 @@ private:
       float illumination = rnd.NextDouble() * max_random_illumination_ * 2 - max_random_illumination_;
       if (mean_r_ > 0.0f || mean_g_ > 0.0f || mean_b_ > 0.0f) {
         // substract mean value
-        d.data[0] -= mean_b_; d.data[1] -= mean_g_; d.data[2] -= mean_r_;
+        for (index_t c = 0; c < d.data.size(0); ++c) {
+          d.data[c] -= mean_value_[c];
+        }
         if ((rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) || mirror_ == 1) {
-          img_ = mirror(crop(d.data * contrast + illumination, img_[0].shape_, yy, xx)) * scale_;
+          dst = mirror(crop(d.data * contrast + illumination, dst[0].shape_, yy, xx)) * scale_;
         } else {
-          img_ = crop(d.data * contrast + illumination, img_[0].shape_, yy, xx) * scale_ ;
+          dst = crop(d.data * contrast + illumination, dst[0].shape_, yy, xx) * scale_ ;
         }
       } else if (!meanfile_ready_ || name_meanimg_.length() == 0) {
         // do not substract anything
         if (rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) {
-          img_ = mirror(crop(d.data, img_[0].shape_, yy, xx)) * scale_;
+          dst = mirror(crop(d.data, dst[0].shape_, yy, xx)) * scale_;
         } else {
-          img_ = crop(d.data, img_[0].shape_, yy, xx) * scale_ ;
+          dst = crop(d.data, dst[0].shape_, yy, xx) * scale_ ;
         }
       } else {
         // substract mean image
         if ((rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) || mirror_ == 1) {
           if (d.data.shape_ == meanimg_.shape_){
-            img_ = mirror(crop((d.data - meanimg_) * contrast + illumination, img_[0].shape_, yy, xx)) * scale_;
+            dst = mirror(crop((d.data - meanimg_) * contrast + illumination, dst[0].shape_, yy, xx)) * scale_;
           } else {
-            img_ = (mirror(crop(d.data, img_[0].shape_, yy, xx) - meanimg_) * contrast + illumination) * scale_;
+            dst = (mirror(crop(d.data, dst[0].shape_, yy, xx) - meanimg_) * contrast + illumination) * scale_;
           }
         } else {
           if (d.data.shape_ == meanimg_.shape_){
-            img_ = crop((d.data - meanimg_) * contrast + illumination, img_[0].shape_, yy, xx) * scale_ ;
+            dst = crop((d.data - meanimg_) * contrast + illumination, dst[0].shape_, yy, xx) * scale_ ;
           } else {
-            img_ = ((crop(d.data, img_[0].shape_, yy, xx) - meanimg_) * contrast + illumination) * scale_;
+            dst = ((crop(d.data, dst[0].shape_, yy, xx) - meanimg_) * contrast + illumination) * scale_;
           }
         }
       }
     }
-    out_.data = img_;
+    out_.data = dst;
+  }
+  // set data from decoded image, crop, mirror and normalization are done in one pass
+  inline void SetRawData(const DataInst &d) {
+    if (shape_[1] == 1) {
+      ConvertImage(d.raw, d.raw.size(2), &rawimg_);
+      DataInst dfloat = d;
+      dfloat.data = rawimg_;
+      this->SetData(dfloat); return;
+    }
+    mshadow::Tensor<cpu, 2, unsigned char> src(
+        d.raw.dptr_, mshadow::Shape2(d.raw.size(0), d.raw.size(1) * d.raw.size(2)),
+        d.raw.size(1) * d.raw.stride_, NULL);
+    if (aug.NeedProcess()) src = aug.Process(d.raw, &rnd);
+    const index_t nchannel = d.raw.size(2);
+    const index_t height = src.size(0), width = src.size(1) / nchannel;
+    utils::Check(nchannel == 1 || nchannel == shape_[0],
+                 "image of %u channels can not be used as input_shape of %u channels",
+                 nchannel, shape_[0]);
+    mshadow::Tensor<cpu, 3> dst = this->OutSpace(shape_[0]);
+    utils::Assert(height >= shape_[1] && width >= shape_[2],
+                  "Data size must be bigger than the input size to net.");
+    ImageTransform param;
+    // same order of random numbers as SetData
+    param.y = height - shape_[1];
+    param.x = width - shape_[2];
+    if (rand_crop_ != 0 && (param.y != 0 || param.x != 0)) {
+      param.y = rnd.NextUInt32(param.y + 1);
+      param.x = rnd.NextUInt32(param.x + 1);
+    } else {
+      param.y /= 2; param.x /= 2;
+    }
+    if (height != shape_[1] && crop_y_start_ != -1) {
+      param.y = crop_y_start_;
+    }
+    if (width != shape_[2] && crop_x_start_ != -1) {
+      param.x = crop_x_start_;
+    }
+    float contrast = rnd.NextDouble() * max_random_contrast_ * 2 - max_random_contrast_ + 1;
+    float illumination = rnd.NextDouble() * max_random_illumination_ * 2 - max_random_illumination_;
+    if (output_uint8_) {
+      // normalization is done in the network, only the crop and mirror decisions are needed
+      if (mean_r_ > 0.0f || mean_g_ > 0.0f || mean_b_ > 0.0f || meanfile_ready_) {
+        param.mirror = (rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) || mirror_ == 1;
+      } else {
+        param.mirror = rand_mirror_ != 0 && rnd.NextDouble() < 0.5f;
+      }
+      mshadow::Tensor<cpu, 3, unsigned char> dst8 = this->OutSpaceUInt8(shape_[0]);
+      CropImage(src, nchannel, param, dst8);
+      out_.data_uint8 = dst8;
+      out_.norm = norm_;
+      return;
+    }
+    param.alpha = contrast * scale_;
+    param.beta = illumination * scale_;
+    if (mean_r_ > 0.0f || mean_g_ > 0.0f || mean_b_ > 0.0f) {
+      param.mean_value = mean_value_;
+      param.mirror = (rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) || mirror_ == 1;
+    } else if (!meanfile_ready_ || name_meanimg_.length() == 0) {
+      // contrast and illumination are not used when nothing is substracted
+      param.alpha = scale_; param.beta = 0.0f;
+      param.mirror = rand_mirror_ != 0 && rnd.NextDouble() < 0.5f;
+    } else {
+      param.mirror = (rand_mirror_ != 0 && rnd.NextDouble() < 0.5f) || mirror_ == 1;
+      param.mean_img = meanimg_;
+      param.mean_full = meanimg_.size(1) == height && meanimg_.size(2) == width;
+      utils::Assert(param.mean_full || (meanimg_.size(1) == shape_[1] &&
+                                        meanimg_.size(2) == shape_[2]),
+                    "mean image shape mismatch with input");
+    }
+    TransformImage(src, nchannel, param, dst);
+    out_.data = dst;
+  }
+  // get the space to write output into, use the reserved slot if its shape matches
+  inline mshadow::Tensor<cpu, 3> OutSpace(index_t nchannel) {
+    mshadow::Shape<3> oshape = mshadow::Shape3(nchannel, shape_[1], shape_[2]);
+    if (slot_.dptr_ != NULL && slot_.shape_ == oshape) {
+      return slot_;
+    }
+    img_.Resize(oshape);
+    return img_;
+  }
+  // same as OutSpace, for uint8 output
+  inline mshadow::Tensor<cpu, 3, unsigned char> OutSpaceUInt8(index_t nchannel) {
+    mshadow::Shape<3> oshape = mshadow::Shape3(nchannel, shape_[1], shape_[2]);
+    if (slot_uint8_.dptr_ != NULL && slot_uint8_.shape_ == oshape) {
+      return slot_uint8_;
+    }
+    img_uint8_.Resize(oshape);
+    return img_uint8_;
   }
   inline bool Next(void) {
+    utils::IOStageTimer timer(stage_);
     if (!base_->Next()){
       return false;
     }
+    timer.Wait();
     const DataInst &d = base_->Value();
+    rnd.Seed(seed_, epoch_, d.index);
     this->SetData(d);
+    timer.Busy(1);
+    // reservation only holds for one instance
+    slot_.dptr_ = NULL;
+    slot_uint8_.dptr_ = NULL;
     return true;
   }
+  // setup the normalization that the network applies to uint8 output
+  inline void InitNorm(void) {
+    utils::Check(max_random_contrast_ == 0.0f && max_random_illumination_ == 0.0f,
+                 "dtype=uint8 does not support max_random_contrast and max_random_illumination");
+    utils::Check(shape_[1] != 1, "dtype=uint8 only supports image input");
+    normmean_.Resize(mshadow::Shape3(shape_[0], shape_[1], shape_[2]));
+    if (mean_r_ > 0.0f || mean_g_ > 0.0f || mean_b_ > 0.0f) {
+      for (index_t c = 0; c < shape_[0]; ++c) {
+        normmean_[c] = mean_value_[c];
+      }
+    } else if (meanfile_ready_) {
+      utils::Check(meanimg_.shape_ == normmean_.shape_,
+                   "dtype=uint8 requires the mean image to be of input_shape");
+      mshadow::Copy(normmean_, meanimg_);
+    } else {
+      normmean_ = 0.0f;
+    }
+    norm_.mean = normmean_;
+    norm_.scale = scale_;
+    output_uint8_ = true;
+  }
+  /*! \brief copy of an instance of base iterator, to be augmented by a mean worker */
+  struct MeanInst {
+    unsigned index;
+    // whether the instance is a decoded image in raw, instead of data
+    bool is_raw;
+    mshadow::TensorContainer<cpu, 3, unsigned char> raw;
+    mshadow::TensorContainer<cpu, 3> data;
+    MeanInst(void) : is_raw(false), raw(false), data(false) {}
+    inline void CopyFrom(const DataInst &d) {
+      index = d.index;
+      is_raw = d.data.dptr_ == NULL;
+      if (is_raw) {
+        raw.Resize(d.raw.shape_);
+        mshadow::Copy(raw, d.raw);
+      } else {
+        data.Resize(d.data.shape_);
+        mshadow::Copy(data, d.data);
+      }
+    }
+  };
+  /*! \brief iterator over the instances of a chunk taken by one mean worker */
+  class MeanReader: public IIterator<DataInst> {
+   public:
+    MeanReader(void) : chunk_(NULL), count_(0), pos_(0), step_(1) {}
+    virtual void SetParam(const char *name, const char *val) {}
+    virtual void Init(void) {}
+    virtual void BeforeFirst(void) {}
+    virtual bool Next(void) {
+      if (pos_ >= count_) return false;
+      const MeanInst &e = *(*chunk_)[pos_];
+      out_.index = e.index;
+      if (e.is_raw) {
+        out_.data.dptr_ = NULL;
+        out_.raw = e.raw;
+      } else {
+        out_.data = e.data;
+      }
+      pos_ += step_;
+      return true;
+    }
+    virtual const DataInst &Value(void) const {
+      return out_;
+    }
+    /*! \brief read instance begin, begin + step, ... of the first count instances of chunk */
+    inline void SetRange(const std::vector<MeanInst*> *chunk, size_t count,
+                         size_t begin, size_t step) {
+      chunk_ = chunk; count_ = count; pos_ = begin; step_ = step;
+    }
+
+   private:
+    const std::vector<MeanInst*> *chunk_;
+    size_t count_, pos_, step_;
+    DataInst out_;
+  };
+  /*!
+   * \brief job of mean workers, worker tid augments instance tid, tid + nthread, ... of
+   *   the chunk by its own augmenter, and adds them into its own sum in double
+   */
+  struct MeanJob {
+    // chunk to be added, and number of instances in it
+    const std::vector<MeanInst*> *chunk;
+    size_t count;
+    // shape of mean image
+    mshadow::Shape<3> mshape;
+    // reader, augmenter and sum of each worker
+    std::vector<MeanReader*> readers;
+    std::vector<AugmentIterator*> augs;
+    std::vector< std::vector<double> > sum;
+    inline void operator()(int tid, int nthread) {
+      readers[tid]->SetRange(chunk, count, tid, nthread);
+      std::vector<double> &acc = sum[tid];
+      while (augs[tid]->Next()) {
+        const mshadow::Tensor<cpu, 3> &img = augs[tid]->Value().data;
+        utils::Check(img.shape_ == mshape, "image_mean: output image shape mismatch");
+        for (index_t c = 0, j = 0; c < mshape[0]; ++c) {
+          for (index_t y = 0; y < mshape[1]; ++y) {
+            const real_t *row = img[c][y].dptr_;
+            for (index_t x = 0; x < mshape[2]; ++x, ++j) {
+              acc[j] += row[x];
+            }
+          }
+        }
+      }
+    }
+    // reduce sum of all workers into total
+    inline void Reduce(std::vector<double> *total) const {
+      for (size_t t = 0; t < sum.size(); ++t) {
+        for (size_t j = 0; j < total->size(); ++j) {
+          (*total)[j] += sum[t][j];
+        }
+      }
+    }
+  };
+  // create augmenter of each mean worker, with the same parameters except the mean image,
+  // so that a worker outputs the augmented image in float, like this iterator does before
+  // the mean image is ready
+  inline void InitMeanWorkers(MeanJob *job) {
+    for (int i = 0; i < mean_nthread_; ++i) {
+      MeanReader *reader = new MeanReader();
+      AugmentIterator *aug = new AugmentIterator(reader);
+      for (size_t j = 0; j < cfg_.size(); ++j) {
+        const char *name = cfg_[j].first.c_str();
+        if (!strcmp(name, "image_mean") || !strcmp(name, "dtype")) continue;
+        aug->SetParam(name, cfg_[j].second.c_str());
+      }
+      aug->SetParam("silent", "1");
+      aug->Init();
+      job->readers.push_back(reader);
+      job->augs.push_back(aug);
+      job->sum.push_back(std::vector<double>(job->mshape.Size(), 0.0));
+    }
+  }
+  /*! \brief progress of mean image creation, saved in checkpoint */
+  struct MeanProgress {
+    // number of images summed
+    uint64_t imcnt;
+    // number of instances read from base, up to the last one summed
+    uint64_t nread;
+    // position of base after these instances, empty if base can not tell
+    std::vector<uint64_t> pos;
+    MeanProgress(void) : imcnt(0), nread(0) {}
+  };
+  // create the mean image from the output of augmentation, the calling thread copies chunks
+  // of instances out of base, while image_mean_nthread workers augment the last chunk and sum
+  // the images in double; with image_mean_samples=N, each instance is taken with probability
+  // N / (number of instances), decided by seed_data and the instance index, so the subset is
+  // random in any input order, and is the same when resumed from checkpoint
   inline void CreateMeanImg(void) {
     if (silent_ == 0) {
       printf("cannot find %s: create mean image, this will take some time...\n", name_meanimg_.c_str());
     }
+    // the shuffled order of a round is not kept across runs, the skipped images would not match
+    utils::Check(mean_checkpoint_ == 0 || shuffle_ == 0,
+                 "image_mean_checkpoint can not be used together with shuffle or global_shuffle");
+    utils::Check(mean_nthread_ > 0, "image_mean_nthread must be positive");
+    double ratio = 1.0;
+    if (mean_samples_ != 0) {
+      const size_t total = base_->NumInst();
+      utils::Check(total != 0, "image_mean_samples requires an input iterator "\
+                   "that knows the number of images, e.g. imgbin or img");
+      ratio = static_cast<double>(mean_samples_) / total;
+    }
     time_t start = time(NULL);
     unsigned long elapsed = 0;
-    size_t imcnt = 1;
-
-    utils::Assert(this->Next(), "input iterator failed.");
-    meanimg_.Resize(mshadow::Shape3(shape_[0], shape_[1], shape_[2]));
-    mshadow::Copy(meanimg_, img_);
-    while (this->Next()) {
-      meanimg_ += img_; imcnt += 1;
-      elapsed = (long)(time(NULL) - start);
-      if (imcnt % 1000 == 0 && silent_ == 0) {
-        printf("\r                                                               \r");
-        printf("[%8lu] images processed, %ld sec elapsed", imcnt, elapsed);
-        fflush(stdout);
-      }
-    }
-    meanimg_ *= (1.0f / imcnt);
+    const mshadow::Shape<3> mshape = mshadow::Shape3(shape_[0], shape_[1], shape_[2]);
+    const index_t npixel = mshape.Size();
+    // sum of images before the checkpoint we resume from
+    std::vector<double> resumed(npixel, 0.0);
+    MeanProgress done;
+    if (this->LoadMeanCheckpoint(mshape, &done, &resumed)) {
+      if (silent_ == 0) {
+        printf("resume mean image from %lu images in %s.part\n",
+               static_cast<unsigned long>(done.imcnt), name_meanimg_.c_str());
+      }
+      // seek to the position in checkpoint, e.g. imgbin moves to the page of it; otherwise
+      // read past the instances, which decodes them again
+      if (done.pos.size() == 0 || !base_->Seek(done.pos)) {
+        for (uint64_t i = 0; i < done.nread; ++i) {
+          utils::Check(base_->Next(), "image_mean: checkpoint has more images than input iterator");
+        }
+      }
+    }
+    MeanJob job;
+    job.mshape = mshape;
+    this->InitMeanWorkers(&job);
+    utils::ThreadPool<MeanJob> pool;
+    pool.Init(mean_nthread_, &job);
+    // one chunk is filled while the other is augmented
+    std::vector<MeanInst*> chunks[2];
+    for (int k = 0; k < 2; ++k) {
+      for (size_t i = 0; i < kMeanChunk; ++i) {
+        chunks[k].push_back(new MeanInst());
+      }
+    }
+    utils::PhiloxSampler sampler;
+    // progress after the chunk being summed is added
+    MeanProgress next = done;
+    uint64_t nread = done.nread;
+    uint64_t ncheck = mean_checkpoint_ != 0 ? done.imcnt / mean_checkpoint_ : 0;
+    bool running = false, end = false;
+    int cur = 0;
+    while (true) {
+      size_t count = 0;
+      while (!end && count < kMeanChunk) {
+        if (!base_->Next()) {
+          end = true; break;
+        }
+        nread += 1;
+        const DataInst &d = base_->Value();
+        if (ratio < 1.0) {
+          sampler.Seed(seed_ ^ kMeanMagic, 0, d.index);
+          if (sampler.NextDouble() >= ratio) continue;
+        }
+        chunks[cur][count]->CopyFrom(d);
+        count += 1;
+      }
+      if (running) {
+        pool.Wait();
+        running = false;
+        done = next;
+        elapsed = (long)(time(NULL) - start);
+        if (silent_ == 0) {
+          printf("\r                                                               \r");
+          printf("[%8lu] images processed, %ld sec elapsed",
+                 static_cast<unsigned long>(done.imcnt), elapsed);
+          fflush(stdout);
+        }
+        if (mean_checkpoint_ != 0 && done.imcnt / mean_checkpoint_ != ncheck) {
+          ncheck = done.imcnt / mean_checkpoint_;
+          std::vector<double> total = resumed;
+          job.Reduce(&total);
+          this->SaveMeanCheckpoint(mshape, done, total);
+        }
+      }
+      if (count == 0) break;
+      job.chunk = &chunks[cur];
+      job.count = count;
+      next.imcnt = done.imcnt + count;
+      next.nread = nread;
+      if (!base_->Tell(&next.pos)) next.pos.clear();
+      pool.Start();
+      running = true;
+      cur = 1 - cur;
+    }
+    pool.Destroy();
+    const size_t imcnt = static_cast<size_t>(done.imcnt);
+    utils::Check(imcnt != 0, "input iterator failed.");
+    std::vector<double> total = resumed;
+    job.Reduce(&total);
+    for (int i = 0; i < mean_nthread_; ++i) {
+      delete job.augs[i];
+    }
+    for (int k = 0; k < 2; ++k) {
+      for (size_t i = 0; i < kMeanChunk; ++i) {
+        delete chunks[k][i];
+      }
+    }
+    meanimg_.Resize(mshape);
+    for (index_t c = 0, j = 0; c < mshape[0]; ++c) {
+      for (index_t y = 0; y < mshape[1]; ++y) {
+        for (index_t x = 0; x < mshape[2]; ++x, ++j) {
+          meanimg_[c][y][x] = static_cast<real_t>(total[j] / imcnt);
+        }
+      }
+    }
     utils::StdFile fo(name_meanimg_.c_str(), "wb");
     meanimg_.SaveBinary(fo);
+    fo.Close();
+    if (mean_checkpoint_ != 0) {
+      std::remove((name_meanimg_ + ".part").c_str());
+    }
     if (silent_ == 0) {
-      printf("save mean image to %s..\n", name_meanimg_.c_str());
+      printf("\nsave mean image of %lu images to %s..\n", imcnt, name_meanimg_.c_str());
     }
     this->BeforeFirst();
   }
+  // load progress and sum of images in checkpoint of mean image, return false if there is none
+  inline bool LoadMeanCheckpoint(mshadow::Shape<3> mshape, MeanProgress *done,
+                                 std::vector<double> *sum) {
+    if (mean_checkpoint_ == 0) return false;
+    std::string path = name_meanimg_ + ".part";
+    FILE *fp = fopen64(path.c_str(), "rb");
+    if (fp == NULL) return false;
+    utils::FileStream fs(fp);
+    utils::IStream &fi = fs;
+    uint32_t head[4];
+    MeanProgress progress;
+    std::vector<double> tmp;
+    bool ok = fi.Read(head, sizeof(head)) != 0 && head[0] == kMeanMagic &&
+        head[1] == mshape[0] && head[2] == mshape[1] && head[3] == mshape[2] &&
+        fi.Read(&progress.imcnt, sizeof(progress.imcnt)) != 0 &&
+        fi.Read(&progress.nread, sizeof(progress.nread)) != 0 &&
+        fi.Read(&progress.pos) && fi.Read(&tmp) && tmp.size() == sum->size();
+    fs.Close();
+    if (!ok) {
+      if (silent_ == 0) printf("ignore invalid mean image checkpoint %s\n", path.c_str());
+      return false;
+    }
+    *done = progress;
+    *sum = tmp;
+    return true;
+  }
+  // save sum of images as checkpoint, written to a temp file first so that a crash keeps the old one
+  inline void SaveMeanCheckpoint(mshadow::Shape<3> mshape, const MeanProgress &done,
+                                 const std::vector<double> &sum) {
+    std::string path = name_meanimg_ + ".part";
+    std::string tmp = path + ".tmp";
+    {
+      utils::StdFile fs(tmp.c_str(), "wb");
+      utils::IStream &fo = fs;
+      uint32_t head[4];
+      head[0] = kMeanMagic; head[1] = mshape[0]; head[2] = mshape[1]; head[3] = mshape[2];
+      fo.Write(head, sizeof(head));
+      fo.Write(&done.imcnt, sizeof(done.imcnt));
+      fo.Write(&done.nread, sizeof(done.nread));
+      fo.Write(done.pos);
+      fo.Write(sum);
+      fs.Close();
+    }
+    utils::Check(std::rename(tmp.c_str(), path.c_str()) == 0,
+                 "image_mean: fail to write checkpoint %s", path.c_str());
+  }
 private:
   /*! \brief base iterator */
   IIterator<DataInst> *base_;
+  /*! \brief all parameters, given to the augmenters of mean workers */
+  std::vector< std::pair<std::string, std::string> > cfg_;
   /*! \brief input shape */
   mshadow::Shape<4> shape_;
   /*! \brief output data */
@@ -219,6 +685,24 @@ private:
   mshadow::TensorContainer<cpu, 3> meanimg_;
   /*! \brief temp space */
   mshadow::TensorContainer<cpu, 3> img_;
+  /*! \brief space reserved by the consumer for next output, NULL if not reserved */
+  mshadow::Tensor<cpu, 3> slot_;
+  /*! \brief decoded image converted into float, only used when input is not an image */
+  mshadow::TensorContainer<cpu, 3> rawimg_;
+  /*! \brief uint8 output space, used when dtype is uint8 */
+  mshadow::TensorContainer<cpu, 3, unsigned char> img_uint8_;
+  /*! \brief uint8 space reserved by the consumer for next output, NULL if not reserved */
+  mshadow::Tensor<cpu, 3, unsigned char> slot_uint8_;
+  /*! \brief type of output data */
+  int dtype_;
+  /*! \brief whether output is in uint8, set after mean image is ready */
+  bool output_uint8_;
+  /*! \brief mean of uint8 output, in input_shape */
+  mshadow::TensorContainer<cpu, 3> normmean_;
+  /*! \brief normalization of uint8 output */
+  DataNorm norm_;
+  /*! \brief mean value of each channel, in channel order */
+  real_t mean_value_[3];
   /*! \brief mean image file, if specified, will generate mean image file, and substract by mean */
   std::string name_meanimg_;
   /*! \brief mean value for r channel */
@@ -235,12 +719,28 @@ private:
   int mirror_;
   /*! \brief whether mean file is ready */
   bool meanfile_ready_;
+  /*! \brief whether the input is shuffled */
+  int shuffle_;
+  /*! \brief number of threads to augment and sum images when creating mean image */
+  int mean_nthread_;
+  /*! \brief number of images used to create mean image, 0 means all */
+  size_t mean_samples_;
+  /*! \brief number of images between checkpoints of mean image, 0 means no checkpoint */
+  size_t mean_checkpoint_;
+  /*! \brief profiling counters */
+  utils::IOStage *stage_;
+  /*! \brief number of images in a chunk given to mean workers at a time */
+  static const size_t kMeanChunk = 256;
+  /*! \brief magic number of mean image checkpoint */
+  static const uint32_t kMeanMagic = 0xced72311;
   // augmenter
-#if CXXNET_USE_OPENCV
   ImageAugmenter aug;
-#endif
-  // random sampler
-  utils::RandomSampler rnd;
+  // random sampler, restarted for each instance
+  utils::PhiloxSampler rnd;
+  // seed of random augmentation
+  unsigned seed_;
+  // number of rounds started
+  unsigned epoch_;
   // random magic number of this iterator
   static const int kRandMagic = 0;
 };  // class AugmentIterator
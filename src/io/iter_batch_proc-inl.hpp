@@ -9,7 +9,8 @@
 #include "./data.h"
 #include "../utils/utils.h"
 #include "../utils/io.h"
-#include "../utils/thread_buffer.h"
+#include "../utils/thread_ring_buffer.h"
+#include "../utils/io_profiler.h"
 
 namespace cxxnet {
 /*! \brief create a batch iterator from single instance iterator */
@@ -26,10 +27,14 @@ public:
     silent_ = 0;
     // label width
     label_width_ = 1;
+    // output data type
+    dtype_ = DataBatch::kFloat32;
+    slot_.data.dptr_ = NULL;
+    stage_ = NULL;
   }
   virtual ~BatchAdaptIterator(void) {
     delete base_;
-    out_.FreeSpaceDense();
+    space_.FreeSpaceDense();
   }
   virtual void SetParam(const char *name, const char *val) {
     base_->SetParam(name, val);
@@ -44,9 +49,13 @@ public:
     if (!strcmp(name, "round_batch")) round_batch_ = atoi(val);
     if (!strcmp(name, "silent")) silent_ = atoi(val);
     if (!strcmp(name, "test_skipread")) test_skipread_ = atoi(val);
+    if (!strcmp(name, "dtype")) {
+      dtype_ = !strcmp(val, "uint8") ? DataBatch::kUInt8 : DataBatch::kFloat32;
+    }
   }
   virtual void Init(void) {
     base_->Init();
+    stage_ = utils::IOProfiler::Get()->Register("BatchAdaptIterator");
     mshadow::Shape<4> tshape = shape_;
     if (tshape[2] == 1 && tshape[1] == 1) {
       // what is this for?
@@ -54,7 +63,12 @@ public:
     } else {
       tshape[0] = batch_size_;
     }
-    out_.AllocSpaceDense(tshape, batch_size_, label_width_, false);
+    if (dtype_ == DataBatch::kUInt8) {
+      space_.AllocSpaceUInt8(tshape, batch_size_, label_width_);
+    } else {
+      space_.AllocSpaceDense(tshape, batch_size_, label_width_, false);
+    }
+    out_ = space_;
   }
 
   virtual void BeforeFirst(void) {
@@ -67,6 +81,22 @@ public:
     head_ = 1;
   }
   virtual bool Next(void) {
+    utils::IOStageTimer timer(stage_);
+    bool ret = this->LoadBatch(&timer);
+    timer.Busy(ret ? 1 : 0);
+    return ret;
+  }
+  virtual const DataBatch &Value(void) const {
+    utils::Assert(head_ == 0, "must call Next to get value");
+    return out_;
+  }
+  virtual bool ReserveSlot(const DataBatch &slot) {
+    slot_ = slot;
+    return true;
+  }
+private:
+  // fill out_ with next batch, time spent in base iterator is counted as waiting
+  inline bool LoadBatch(utils::IOStageTimer *timer) {
     out_.num_batch_padd = 0;
 
     // skip read if in head version
@@ -75,15 +105,10 @@ public:
 
     // if overflow from previous round, directly return false, until before first is called
     if (num_overflow_ != 0) return false;
+    this->SetOutSpace();
     index_t top = 0;
 
-    while (base_->Next()) {
-      const DataInst& d = base_->Value();
-      mshadow::Copy(out_.label[top], d.label);
-      out_.inst_index[top] = d.index;
-      //out_.data[top] = d.data;
-      Copy(out_.data[top], d.data);
-
+    while (this->LoadSlot(top, timer)) {
       if (++ top >= batch_size_) return true;
     }
     if (top != 0) {
@@ -91,11 +116,7 @@ public:
         num_overflow_ = 0;
         base_->BeforeFirst();
         for (; top < batch_size_; ++top, ++num_overflow_) {
-          utils::Assert(base_->Next(), "number of input must be bigger than batch size");
-          const DataInst& d = base_->Value();
-          mshadow::Copy(out_.label[top], d.label);
-          out_.inst_index[top] = d.index;
-          out_.data[top] = d.data;
+          utils::Assert(this->LoadSlot(top, timer), "number of input must be bigger than batch size");
         }
         out_.num_batch_padd = num_overflow_;
       } else {
@@ -105,11 +126,58 @@ public:
     }
     return false;
   }
-  virtual const DataBatch &Value(void) const {
-    utils::Assert(head_ == 0, "must call Next to get value");
-    return out_;
+  // decide where this batch is written, the reserved slot is used if it fits
+  inline void SetOutSpace(void) {
+    bool reserved = dtype_ == DataBatch::kUInt8 ?
+        slot_.data_uint8.dptr_ != NULL : slot_.data.dptr_ != NULL;
+    if (test_skipread_ == 0 && reserved &&
+        slot_.data_type == space_.data_type &&
+        slot_.inst_index != NULL && slot_.batch_size == space_.batch_size &&
+        slot_.data.shape_ == space_.data.shape_ &&
+        slot_.label.shape_ == space_.label.shape_) {
+      out_.data = slot_.data;
+      out_.data_uint8 = slot_.data_uint8;
+      out_.label = slot_.label;
+      out_.inst_index = slot_.inst_index;
+    } else {
+      out_.data = space_.data;
+      out_.data_uint8 = space_.data_uint8;
+      out_.label = space_.label;
+      out_.inst_index = space_.inst_index;
+    }
+    // reservation only holds for one batch
+    slot_.data.dptr_ = NULL;
+    slot_.data_uint8.dptr_ = NULL;
+  }
+  // read next instance into top-th slot of the batch, return false if end of data
+  inline bool LoadSlot(index_t top, utils::IOStageTimer *timer) {
+    DataInst slot;
+    if (dtype_ == DataBatch::kUInt8) {
+      slot.data_uint8 = out_.data_uint8[top];
+    } else {
+      slot.data = out_.data[top];
+    }
+    base_->ReserveSlot(slot);
+    timer->Busy();
+    bool ret = base_->Next();
+    timer->Wait();
+    if (!ret) return false;
+    const DataInst& d = base_->Value();
+    mshadow::Copy(out_.label[top], d.label);
+    out_.inst_index[top] = d.index;
+    // copy only when base did not write into the slot
+    if (dtype_ == DataBatch::kUInt8) {
+      utils::Check(d.data_uint8.dptr_ != NULL,
+                   "BatchAdaptIterator: input iterator do not support dtype=uint8");
+      out_.norm = d.norm;
+      if (d.data_uint8.dptr_ != slot.data_uint8.dptr_) {
+        mshadow::Copy(out_.data_uint8[top], d.data_uint8);
+      }
+    } else if (d.data.dptr_ != slot.data.dptr_) {
+      mshadow::Copy(out_.data[top], d.data);
+    }
+    return true;
   }
-private:
   /*! \brief base iterator */
   IIterator<DataInst> *base_;
   /*! \brief batch size */
@@ -118,8 +186,14 @@ private:
   mshadow::Shape<4> shape_;
   /*! \brief label width */
   index_t label_width_;
-  /*! \brief output data */
+  /*! \brief type of output data */
+  int dtype_;
+  /*! \brief output data, points to space_ or the reserved slot */
   DataBatch out_;
+  /*! \brief space allocated by this iterator */
+  DataBatch space_;
+  /*! \brief space reserved by the consumer for next batch */
+  DataBatch slot_;
   /*! \brief on first */
   int head_;
   /*! \brief skip read */
@@ -130,6 +204,8 @@ private:
   int round_batch_;
   /*! \brief number of overflow instances that readed in round_batch mode */
   int num_overflow_;
+  /*! \brief profiling counters */
+  utils::IOStage *stage_;
 }; // class BatchAdaptIterator
 
 /*! \brief thread buffer iterator */
@@ -139,8 +215,12 @@ public :
     silent_ = 0;
     itr.get_factory().base_ = base;
     itr.SetParam("buffer_size", "2");
+    itr.set_stage_name("ThreadBufferIterator");
   }
   virtual ~ThreadBufferIterator() {
+    if (silent_ == 0) {
+      printf("ThreadBufferIterator: waited %g sec for data\n", itr.wait_time());
+    }
     itr.Destroy();
   }
   virtual void SetParam(const char *name, const char *val) {
@@ -181,7 +261,10 @@ private:
     inline bool Init() {
       base_->Init();
       utils::Assert(base_->Next(), "ThreadBufferIterator: input can not be empty");
+      utils::Check(!base_->Value().is_sparse(),
+                   "ThreadBufferIterator: sparse batch is not supported, libsvm iterator keeps data in memory");
       oshape_ = base_->Value().data.shape_;
+      data_type_ = base_->Value().data_type;
       batch_size_ = base_->Value().batch_size;
       label_width_ = base_->Value().label.size(1);
       for (size_t i = 0; i < base_->Value().extra_data.size(); ++i){
@@ -191,15 +274,32 @@ private:
       return true;
     }
     inline bool LoadNext(DataBatch &val) {
+      // let base write into val directly, copy only if it did not
+      base_->ReserveSlot(val);
       if (base_->Next()) {
-        val.CopyFromDense(base_->Value());
+        const DataBatch &batch = base_->Value();
+        bool inplace = val.data_type == DataBatch::kUInt8 ?
+            batch.data_uint8.dptr_ == val.data_uint8.dptr_ :
+            batch.data.dptr_ == val.data.dptr_;
+        if (!inplace) {
+          val.CopyFromDense(batch);
+        } else {
+          val.num_batch_padd = batch.num_batch_padd;
+          val.norm = batch.norm;
+        }
         return true;
       } else {
         return false;
       }
     }
     inline DataBatch Create(void) {
-      DataBatch a; a.AllocSpaceDense(oshape_, batch_size_, label_width_, extra_shape_);
+      DataBatch a;
+      if (data_type_ == DataBatch::kUInt8) {
+        utils::Check(extra_shape_.size() == 0, "ThreadBufferIterator: dtype=uint8 do not support extra data");
+        a.AllocSpaceUInt8(oshape_, batch_size_, label_width_);
+      } else {
+        a.AllocSpaceDense(oshape_, batch_size_, label_width_, extra_shape_);
+      }
       return a;
     }
     inline void FreeSpace(DataBatch &a) {
@@ -214,13 +314,14 @@ private:
   private:
     mshadow::index_t batch_size_;
     mshadow::index_t label_width_;
+    int data_type_;
     mshadow::Shape<4> oshape_;
     std::vector<mshadow::Shape<4> > extra_shape_;
   };
 private:
   int silent_;
   DataBatch out_;
-  utils::ThreadBuffer<DataBatch, Factory> itr;
+  utils::ThreadRingBuffer<DataBatch, Factory> itr;
 }; // class ThreadBufferIterator
 }  // namespace cxxnet
 #endif  // CXXNET_ITER_BATCH_PROC_INL_HPP_
@@ -0,0 +1,206 @@
+#ifndef CXXNET_ITER_EXTERNAL_INL_HPP_
+#define CXXNET_ITER_EXTERNAL_INL_HPP_
+/*!
+ * \file iter_external-inl.hpp
+ * \brief iterator over batches pushed by threads of the host program
+ */
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <mshadow/tensor.h>
+#include "./data.h"
+#include "../global.h"
+#include "../utils/utils.h"
+#include "../utils/thread_ring_buffer.h"
+
+namespace cxxnet {
+/*!
+ * \brief batches are pushed into a bounded ring by any number of producer threads, and popped
+ *   by Next in the order producers entered Push. A batch is either copied into the space of its
+ *   slot, or handed over, i.e. the iterator refers to the memory of the producer and calls the
+ *   release callback once the consumer moves past it. Push blocks while the ring is full.
+ *   A round of data ends when a producer calls PushEnd; the data can not be rewound, so
+ *   BeforeFirst starts the next round from the next batch in the ring
+ */
+class ExternalIterator: public IIterator<DataBatch> {
+ public:
+  /*! \brief callback that gives back the memory of a handed over batch */
+  typedef void (*ReleaseFunc)(void *arg);
+  ExternalIterator(void) {
+    queue_size_ = 8;
+    silent_ = 0;
+    cur_slot_ = -1;
+    end_of_data_ = false;
+    out_ = NULL;
+  }
+  virtual ~ExternalIterator(void) {
+    // producers must have returned from Push, release the batches that are not consumed
+    if (cur_slot_ != -1) this->Release(ring_[cur_slot_]);
+    while (ring_.size() != 0) {
+      int slot = ring_.BeginPop();
+      if (!ring_.IsEnd(slot)) this->Release(ring_[slot]);
+      ring_.EndPop(slot);
+    }
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i]->space.FreeSpaceDense();
+      delete ring_[i];
+    }
+    ring_.Destroy();
+  }
+  virtual void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "external_queue_size")) queue_size_ = atoi(val);
+    if (!strcmp(name, "silent")) silent_ = atoi(val);
+  }
+  virtual void Init(void) {
+    utils::Check(queue_size_ > 1, "ExternalIterator: external_queue_size must be bigger than 1");
+    ring_.Init(queue_size_);
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i] = new Item();
+    }
+    if (silent_ == 0) {
+      printf("ExternalIterator: external_queue_size=%d\n", queue_size_);
+    }
+  }
+  virtual void BeforeFirst(void) {
+    end_of_data_ = false;
+  }
+  virtual bool Next(void) {
+    if (end_of_data_) return false;
+    if (cur_slot_ != -1) {
+      this->Release(ring_[cur_slot_]);
+      ring_.EndPop(cur_slot_);
+    }
+    cur_slot_ = ring_.BeginPop();
+    if (ring_.IsEnd(cur_slot_)) {
+      ring_.EndPop(cur_slot_);
+      cur_slot_ = -1;
+      out_ = NULL;
+      end_of_data_ = true;
+      return false;
+    }
+    out_ = &ring_[cur_slot_]->out;
+    return true;
+  }
+  virtual const DataBatch &Value(void) const {
+    utils::Assert(out_ != NULL, "ExternalIterator: must call Next to get value");
+    return *out_;
+  }
+  /*!
+   * \brief producer: copy a batch into the queue, can be called by multiple threads
+   * \param batch dense float batch, the memory can be reused once the call returns
+   */
+  inline void Push(const DataBatch &batch) {
+    this->CheckBatch(batch);
+    unsigned long ticket;
+    int slot = ring_.BeginPush(&ticket);
+    Item *it = ring_[slot];
+    DataBatch &space = it->space;
+    if (!SameShape(space, batch)) {
+      space.FreeSpaceDense();
+      space.extra_data.clear();
+      std::vector< mshadow::Shape<4> > extra_shape;
+      for (size_t i = 0; i < batch.extra_data.size(); ++i) {
+        extra_shape.push_back(batch.extra_data[i].shape_);
+      }
+      space.AllocSpaceDense(batch.data.shape_, batch.batch_size,
+                            batch.label.size(1), extra_shape);
+    }
+    mshadow::Copy(space.data, batch.data);
+    mshadow::Copy(space.label, batch.label);
+    for (size_t i = 0; i < batch.extra_data.size(); ++i) {
+      mshadow::Copy(space.extra_data[i], batch.extra_data[i]);
+    }
+    this->SetIndex(space.inst_index, batch, ticket);
+    space.num_batch_padd = batch.num_batch_padd;
+    it->out = space;
+    it->release = NULL;
+    ring_.EndPush(slot);
+  }
+  /*!
+   * \brief producer: hand a batch over to the queue without copy, can be called by
+   *   multiple threads. The memory of batch must stay valid until release is called,
+   *   which happens on the consumer thread, when it moves to the next batch or frees the iterator
+   * \param batch dense float batch
+   * \param release callback to give back the memory, can be NULL
+   * \param arg argument of release
+   */
+  inline void PushHandover(const DataBatch &batch, ReleaseFunc release, void *arg) {
+    this->CheckBatch(batch);
+    unsigned long ticket;
+    int slot = ring_.BeginPush(&ticket);
+    Item *it = ring_[slot];
+    it->index.resize(batch.batch_size);
+    this->SetIndex(&it->index[0], batch, ticket);
+    it->out = batch;
+    it->out.inst_index = &it->index[0];
+    it->release = release;
+    it->arg = arg;
+    ring_.EndPush(slot);
+  }
+  /*! \brief producer: mark the end of current round, Next returns false after the batches before it */
+  inline void PushEnd(void) {
+    int slot = ring_.BeginPush();
+    ring_.EndPush(slot, true);
+  }
+
+ private:
+  /*! \brief a slot of queue */
+  struct Item {
+    // space of copied batch
+    DataBatch space;
+    // instance index of handed over batch
+    std::vector<unsigned> index;
+    // the batch given to consumer
+    DataBatch out;
+    // release callback of handed over batch, NULL if copied
+    ReleaseFunc release;
+    void *arg;
+    Item(void) : release(NULL), arg(NULL) {}
+  };
+  inline static bool SameShape(const DataBatch &a, const DataBatch &b) {
+    if (a.label.dptr_ == NULL || !(a.data.shape_ == b.data.shape_) ||
+        !(a.label.shape_ == b.label.shape_) || a.extra_data.size() != b.extra_data.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.extra_data.size(); ++i) {
+      if (!(a.extra_data[i].shape_ == b.extra_data[i].shape_)) return false;
+    }
+    return true;
+  }
+  inline static void CheckBatch(const DataBatch &batch) {
+    utils::Check(batch.data_type == DataBatch::kFloat32 && !batch.is_sparse(),
+                 "ExternalIterator: only dense float batch can be pushed");
+    utils::Check(batch.data.dptr_ != NULL && batch.label.dptr_ != NULL,
+                 "ExternalIterator: batch must have data and label");
+    utils::Check(batch.batch_size != 0 && batch.batch_size == batch.data.size(0) &&
+                 batch.batch_size == batch.label.size(0),
+                 "ExternalIterator: batch_size mismatch with data or label");
+    utils::Check(batch.num_batch_padd <= batch.batch_size,
+                 "ExternalIterator: num_batch_padd exceeds batch_size");
+  }
+  // index of instances, if batch does not have it, instances are numbered by ticket of the slot
+  inline static void SetIndex(unsigned *dst, const DataBatch &batch, unsigned long ticket) {
+    for (index_t i = 0; i < batch.batch_size; ++i) {
+      dst[i] = batch.inst_index != NULL ? batch.inst_index[i] :
+          static_cast<unsigned>(ticket * batch.batch_size + i);
+    }
+  }
+  inline static void Release(Item *it) {
+    if (it->release != NULL) it->release(it->arg);
+    it->release = NULL;
+  }
+  /*! \brief number of slots */
+  int queue_size_;
+  /*! \brief silent */
+  int silent_;
+  /*! \brief queue of batches */
+  utils::ThreadRing<Item*> ring_;
+  /*! \brief slot held by consumer, -1 if none */
+  int cur_slot_;
+  /*! \brief batch held by consumer */
+  const DataBatch *out_;
+  /*! \brief whether consumer reaches end of round */
+  bool end_of_data_;
+};
+}  // namespace cxxnet
+#endif  // CXXNET_ITER_EXTERNAL_INL_HPP_
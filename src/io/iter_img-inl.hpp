@@ -10,36 +10,125 @@
 #include "data.h"
 #include <mshadow/tensor.h>
 #include <opencv2/opencv.hpp>
+#include "../utils/io.h"
+#include "../utils/random.h"
+#include "../utils/thread_pool.h"
+#include "../utils/thread_ring_buffer.h"
 
 namespace cxxnet{
-  /*! \brief simple image iterator that only loads data instance */
+/*!
+ * \brief image iterator that loads the images in the list, files are read and decoded
+ *   by decode_nthread workers, each worker takes the next image of the round and puts it
+ *   into a bounded ring, which hands the images to the consumer in the order of the list
+ *   (or the shuffled order), so the output does not depend on the number of workers.
+ *   The images are given in bytes as DataInst::raw, the conversion into float is left
+ *   to the augmentation stage
+ */
 class ImageIterator : public IIterator< DataInst >{
 public:
   ImageIterator(void) {
-    img_.set_pad(false);
     fplst_ = NULL;
     silent_ = 0;
     path_imgdir_ = "";
     path_imglst_ = "img.lst";
     shuffle_ = 0;
-    data_index_ = 0;
     label_width_ = 1;
+    nchannel_ = 3;
+    decode_nthread_ = 4;
+    running_ = false;
+    stop_signal_ = false;
+    end_of_data_ = false;
+    cur_slot_ = -1;
+    num_pop_ = 0;
+    round_begin_ = 0;
+    num_end_ = 0;
+    seed_ = 0;
+    epoch_ = 0;
   }
   virtual ~ImageIterator(void) {
+    if (running_) this->StopRound();
+    pool_.Destroy();
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      delete ring_[i];
+    }
+    ring_.Destroy();
     if(fplst_ != NULL) fclose(fplst_);
   }
   virtual void SetParam(const char *name, const char *val) {
     if(!strcmp(name, "image_list"))  path_imglst_ = val;
+    if(!strcmp(name, "image_label"))  path_imglbl_ = val;
     if(!strcmp(name, "image_root"))   path_imgdir_ = val;
     if(!strcmp(name, "silent"  ))  silent_ = atoi(val);
     if(!strcmp(name, "shuffle"  ))  shuffle_ = atoi(val);
     if(!strcmp(name, "label_width"  ))  label_width_ = atoi(val);
+    if(!strcmp(name, "decode_nthread"))  decode_nthread_ = atoi(val);
+    if(!strcmp(name, "seed_data"))  seed_ = static_cast<unsigned>(atoi(val));
+    if(!strcmp(name, "input_shape")) {
+      // single channel network input is loaded in grayscale
+      unsigned nchannel;
+      if (sscanf(val, "%u", &nchannel) == 1) nchannel_ = nchannel == 1 ? 1 : 3;
+    }
   }
   virtual void Init(void) {
+    utils::Check(decode_nthread_ > 0, "ImageIterator: decode_nthread must be positive");
     fplst_  = utils::FopenCheck(path_imglst_.c_str(), "r");
     if(silent_ == 0) {
-      printf("ImageIterator:image_list=%s\n", path_imglst_.c_str());
+      printf("ImageIterator:image_list=%s, decode_nthread=%d\n",
+             path_imglst_.c_str(), decode_nthread_);
+    }
+    if (path_imglbl_.length() != 0) {
+      this->LoadLabelBin();
+    } else {
+      this->LoadLabelTxt();
+    }
+    for (size_t i = 0; i < index_list_.size(); ++i) {
+      order_.push_back(i);
+    }
+    ring_.Init(decode_nthread_ * kQueuePerThread);
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i] = new ImageEntry();
+    }
+    job_.self = this;
+    pool_.Init(decode_nthread_, &job_);
+    this->BeforeFirst();
+  }
+  virtual void BeforeFirst(void) {
+    if (running_) this->StopRound();
+    epoch_ += 1;
+    // the order of each round is shuffled from the original order
+    if (shuffle_) {
+      for (size_t i = 0; i < order_.size(); ++i) {
+        order_[i] = i;
+      }
+      rnd_.Seed(kRandMagic + seed_, static_cast<uint32_t>(epoch_), 0);
+      rnd_.Shuffle(order_);
     }
+    // all tickets of last round are popped, tickets of this round start from here
+    round_begin_ = num_pop_;
+    num_end_ = 0;
+    end_of_data_ = false;
+    running_ = true;
+    pool_.Start();
+  }
+  virtual bool Next(void) {
+    if (end_of_data_) return false;
+    if (!this->PopSlot()) return false;
+    const ImageEntry &e = *ring_[cur_slot_];
+    out_.index = index_list_[e.index];
+    out_.label = mshadow::Tensor<cpu, 1>(&(labels_[0]) + label_width_ * e.index,
+                                         mshadow::Shape1(label_width_));
+    out_.raw = e.img;
+    return true;
+  }
+  virtual const DataInst &Value(void) const{
+    return out_;
+  }
+  virtual size_t NumInst(void) const {
+    return index_list_.size();
+  }
+protected:
+  // load index, labels and file names from list
+  inline void LoadLabelTxt(void) {
     unsigned index;
     while (fscanf(fplst_, "%u", &index) == 1) {
       index_list_.push_back(index);
@@ -54,58 +143,102 @@ public:
       utils::Assert(fscanf(fplst_, "%s\n", name) == 1, "ImageList: no file name");
       filenames_.push_back(name);
     }
-    for (size_t i = 0; i < index_list_.size(); ++i) {
-      order_.push_back(i);
-    }
-    this->BeforeFirst();
   }
-  virtual void BeforeFirst(void) {
-    data_index_ = 0;
-    if (shuffle_) {
-      std::random_shuffle(order_.begin(), order_.end());
+  // load index and labels from binary label file, and only file names from list
+  inline void LoadLabelBin(void) {
+    utils::BinaryLabelFile flabel;
+    flabel.Open(path_imglbl_.c_str(), label_width_);
+    size_t n = static_cast<size_t>(flabel.NumRecord());
+    std::vector<unsigned> index(n);
+    labels_.resize(n * label_width_);
+    flabel.Read(n, BeginPtr(index), BeginPtr(labels_));
+    flabel.Close();
+    index_list_.assign(index.begin(), index.end());
+    // file name is the last tab separated field of each line
+    char line[1024];
+    for (size_t i = 0; i < n; ++i) {
+      utils::Check(fgets(line, sizeof(line), fplst_) != NULL,
+                   "ImageList: %s has less lines than %s",
+                   path_imglst_.c_str(), path_imglbl_.c_str());
+      char *end = line + strlen(line);
+      while (end != line && (end[-1] == '\n' || end[-1] == '\r')) *(--end) = '\0';
+      const char *name = strrchr(line, '\t');
+      filenames_.push_back(name != NULL ? name + 1 : line);
     }
   }
-  virtual bool Next(void) {
-    if (data_index_ < static_cast<int>(order_.size())) {
-      size_t index = order_[data_index_];
-      if (path_imgdir_.length() == 0) {
-        LoadImage(img_, out_, filenames_[index].c_str());
-      } else {
-        char sname[256];
-        sprintf(sname, "%s%s", path_imgdir_.c_str(), filenames_[index].c_str());
-        LoadImage(img_, out_, sname);
+  /*! \brief decoded image in ring */
+  struct ImageEntry {
+    // index of image in list
+    size_t index;
+    // decoded image, in (height, width, channel) and RGB order
+    mshadow::TensorContainer<cpu, 3, unsigned char> img;
+    ImageEntry(void) : index(0), img(false) {}
+  };
+  /*! \brief job of workers, each worker loads images until end of round */
+  struct LoadJob {
+    ImageIterator *self;
+    inline void operator()(int tid, int nthread) {
+      self->RunWorker();
+    }
+  };
+  // take tickets and load images of current round, push one end mark when done
+  inline void RunWorker(void) {
+    while (true) {
+      unsigned long ticket;
+      int slot = ring_.BeginPush(&ticket);
+      const size_t pos = ticket - round_begin_;
+      if (stop_signal_ || pos >= order_.size()) {
+        ring_.EndPush(slot, true); return;
       }
-      out_.index = index_list_[index];
-      mshadow::Tensor<cpu, 1> label_(&(labels_[0]) + label_width_ * index,
-        mshadow::Shape1(label_width_));
-      out_.label = label_;
-      ++data_index_;
-      return true;
+      this->LoadImage(order_[pos], ring_[slot]);
+      ring_.EndPush(slot);
     }
-    return false;
   }
-  virtual const DataInst &Value(void) const{
-    return out_;
+  // move to next slot of ring, return false if reaches end of round
+  inline bool PopSlot(void) {
+    if (cur_slot_ != -1) ring_.EndPop(cur_slot_);
+    cur_slot_ = ring_.BeginPop();
+    num_pop_ += 1;
+    if (ring_.IsEnd(cur_slot_)) {
+      ring_.EndPop(cur_slot_);
+      cur_slot_ = -1;
+      num_end_ += 1;
+      end_of_data_ = true;
+      return false;
+    }
+    return true;
   }
-protected:
-  inline static void LoadImage(mshadow::TensorContainer<cpu,3> &img, 
-          DataInst &out,
-          const char *fname) {
-    cv::Mat res = cv::imread(fname);
-    utils::Assert(res.data != NULL, "LoadImage: Reading image %s failed.\n", fname);
-    img.Resize(mshadow::Shape3(3, res.rows, res.cols));
-    for(index_t y = 0; y < img.size(1); ++y) {
-      for(index_t x = 0; x < img.size(2); ++x) {
-        cv::Vec3b bgr = res.at<cv::Vec3b>(y, x);
-        // store in RGB order
-        img[2][y][x] = bgr[0];
-        img[1][y][x] = bgr[1];
-        img[0][y][x] = bgr[2];
+  // stop the workers, drop the loaded images, until every worker pushed its end mark
+  inline void StopRound(void) {
+    stop_signal_ = true;
+    end_of_data_ = false;
+    while (num_end_ < pool_.nthread()) {
+      this->PopSlot();
+    }
+    pool_.Wait();
+    stop_signal_ = false;
+    running_ = false;
+  }
+  // read and decode index-th image in list
+  inline void LoadImage(size_t index, ImageEntry *e) {
+    std::string fname = path_imgdir_ + filenames_[index];
+    cv::Mat res = cv::imread(fname.c_str(), nchannel_ == 1 ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    utils::Check(res.data != NULL, "LoadImage: Reading image %s failed.\n", fname.c_str());
+    e->index = index;
+    e->img.Resize(mshadow::Shape3(res.rows, res.cols, nchannel_));
+    for (int y = 0; y < res.rows; ++y) {
+      const unsigned char *src = res.ptr(y);
+      unsigned char *dst = e->img[y].dptr_;
+      if (nchannel_ == 1) {
+        memcpy(dst, src, res.cols); continue;
+      }
+      // store in RGB order
+      for (int x = 0; x < res.cols; ++x) {
+        dst[x * 3 + 0] = src[x * 3 + 2];
+        dst[x * 3 + 1] = src[x * 3 + 1];
+        dst[x * 3 + 2] = src[x * 3 + 0];
       }
     }
-    out.data = img;
-    // free memory
-    res.release();
   }
 protected:
   // output data
@@ -116,22 +249,53 @@ protected:
   FILE *fplst_;
   // prefix path of image folder, path to input lst, format: imageid label path
   std::string path_imgdir_, path_imglst_;
-  // temp storage for image
-  mshadow::TensorContainer<cpu, 3> img_;
+  // path to binary label file, if set, labels are loaded from it instead of list
+  std::string path_imglbl_;
   // whether the data will be shuffled in each epoch
   int shuffle_;
   // denotes the number of labels
   int label_width_;
-  // denotes the current data index
-  int data_index_;
+  // number of channels of loaded image
+  int nchannel_;
+  // number of threads that read and decode images
+  int decode_nthread_;
   // stores the reading orders
-  std::vector<int> order_;
+  std::vector<size_t> order_;
   // stores the labels of data
   std::vector<float> labels_;
   // stores the file names of the images
   std::vector<std::string> filenames_;
   // stores the index list of images
   std::vector<int> index_list_;
+  // ring that puts the images loaded by workers back in order
+  utils::ThreadRing<ImageEntry*> ring_;
+  // slot held by consumer, -1 if none
+  int cur_slot_;
+  // number of slots popped so far, equals to number of tickets taken when workers are idle
+  unsigned long num_pop_;
+  // first ticket of current round
+  unsigned long round_begin_;
+  // number of end marks popped in current round
+  int num_end_;
+  // whether workers are running a round
+  bool running_;
+  // whether consumer reaches end of round
+  bool end_of_data_;
+  // signal workers to stop current round
+  volatile bool stop_signal_;
+  // job and workers
+  LoadJob job_;
+  utils::ThreadPool<LoadJob> pool_;
+  // seed_data
+  unsigned seed_;
+  // number of rounds started
+  size_t epoch_;
+  // random number generator for shuffle, restarted in each round
+  utils::PhiloxSampler rnd_;
+  // magic number to setup randomness
+  static const int kRandMagic = 131;
+  // number of images in ring for each worker
+  static const int kQueuePerThread = 8;
   };
 };
 #endif
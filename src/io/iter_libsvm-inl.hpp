@@ -0,0 +1,311 @@
+#ifndef CXXNET_ITER_LIBSVM_INL_HPP_
+#define CXXNET_ITER_LIBSVM_INL_HPP_
+/*!
+ * \file iter_libsvm-inl.hpp
+ * \brief iterator that takes sparse dataset in libsvm format,
+ *   the whole dataset is kept in memory in CSR format, and output as sparse batch
+ */
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <mshadow/tensor.h>
+#include "./data.h"
+#include "../utils/utils.h"
+#include "../utils/io.h"
+#include "../utils/random.h"
+#include "../utils/thread_pool.h"
+
+namespace cxxnet {
+/*!
+ * \brief iterator over libsvm text file, each line is "label findex:fvalue findex:fvalue ...",
+ *   the file is parsed by multiple threads at Init, the batch is given by sparse_row_ptr and
+ *   sparse_data, data.shape_ gives the dense shape of the input with data.dptr_ = NULL
+ */
+class LibSVMIterator: public IIterator<DataBatch> {
+ public:
+  LibSVMIterator(void) {
+    silent_ = 0;
+    shuffle_ = 0;
+    nthread_ = 4;
+    batch_size_ = 0;
+    num_feature_ = 0;
+    round_batch_ = 0;
+    seed_ = 0;
+    epoch_ = 0;
+    num_overflow_ = 0;
+  }
+  virtual ~LibSVMIterator(void) {}
+  virtual void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "silent")) silent_ = atoi(val);
+    if (!strcmp(name, "batch_size")) batch_size_ = (index_t)atoi(val);
+    if (!strcmp(name, "shuffle")) shuffle_ = atoi(val);
+    if (!strcmp(name, "round_batch")) round_batch_ = atoi(val);
+    if (!strcmp(name, "nthread")) nthread_ = atoi(val);
+    if (!strcmp(name, "path_data")) path_data_ = val;
+    if (!strcmp(name, "seed_data")) seed_ = static_cast<unsigned>(atoi(val));
+    if (!strcmp(name, "input_shape")) {
+      unsigned z, y, x;
+      utils::Check(sscanf(val, "%u,%u,%u", &z, &y, &x) == 3 && z == 1 && y == 1,
+                   "LibSVMIterator: input_shape must be 1,1,num_feature");
+      num_feature_ = x;
+    }
+  }
+  virtual void Init(void) {
+    utils::Check(batch_size_ != 0, "LibSVMIterator: must set batch_size");
+    utils::Check(nthread_ > 0, "LibSVMIterator: nthread must be positive");
+    this->LoadData();
+    utils::Check(labels_.size() != 0, "LibSVMIterator: no instance in %s", path_data_.c_str());
+    order_.resize(labels_.size());
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = static_cast<unsigned>(i);
+    }
+    batch_label_.resize(batch_size_);
+    batch_index_.resize(batch_size_);
+    batch_row_ptr_.resize(batch_size_ + 1);
+    out_.batch_size = batch_size_;
+    out_.data.shape_ = mshadow::Shape4(batch_size_, 1, 1, num_feature_);
+    out_.data.stride_ = num_feature_;
+    out_.data.dptr_ = NULL;
+    out_.label.shape_ = mshadow::Shape2(batch_size_, 1);
+    out_.label.stride_ = 1;
+    if (silent_ == 0) {
+      printf("LibSVMIterator: load %lu instances, %lu entries, %u features, shuffle=%d\n",
+             static_cast<unsigned long>(labels_.size()),
+             static_cast<unsigned long>(entry_.size()), num_feature_, shuffle_);
+    }
+    this->BeforeFirst();
+  }
+  virtual void BeforeFirst(void) {
+    if (num_overflow_ != 0) {
+      // the round is already started by last batch, skip the instances it used
+      loc_ = num_overflow_;
+      num_overflow_ = 0;
+    } else {
+      this->StartRound();
+      loc_ = 0;
+    }
+  }
+  virtual bool Next(void) {
+    const size_t ndata = labels_.size();
+    if (loc_ >= ndata) return false;
+    out_.num_batch_padd = 0;
+    if (shuffle_ == 0 && loc_ + batch_size_ <= ndata) {
+      // rows are consecutive, point to the data directly
+      out_.sparse_row_ptr = &row_ptr_[loc_];
+      out_.sparse_data = entry_.size() != 0 ? &entry_[0] : NULL;
+      out_.label.dptr_ = &labels_[loc_];
+      out_.inst_index = &order_[loc_];
+    } else {
+      this->Gather();
+    }
+    loc_ += batch_size_;
+    return true;
+  }
+  virtual const DataBatch &Value(void) const {
+    return out_;
+  }
+
+ private:
+  /*! \brief job of parsing a part of file */
+  struct ParseJob {
+    LibSVMIterator *iter;
+    inline void operator()(int tid, int nthread) {
+      iter->ParseChunk(tid, nthread);
+    }
+  };
+  /*! \brief sparse rows parsed by one thread */
+  struct Chunk {
+    std::vector<size_t> row_ptr;
+    std::vector<SparseInst::Entry> entry;
+    std::vector<float> labels;
+    unsigned max_findex;
+  };
+  // start next round, the order of each round is shuffled from the original order
+  inline void StartRound(void) {
+    epoch_ += 1;
+    if (shuffle_ != 0) {
+      for (size_t i = 0; i < order_.size(); ++i) {
+        order_[i] = static_cast<unsigned>(i);
+      }
+      rnd.Seed(kRandMagic + seed_, static_cast<uint32_t>(epoch_), 0);
+      rnd.Shuffle(order_);
+    }
+  }
+  // copy rows of current batch into batch buffer, missing rows at the tail are empty,
+  // or taken from the beginning of next round in round_batch mode, same as BatchAdaptIterator
+  inline void Gather(void) {
+    const size_t ndata = labels_.size();
+    batch_entry_.clear();
+    batch_row_ptr_[0] = 0;
+    for (index_t top = 0; top < batch_size_; ++top) {
+      size_t i = loc_ + top;
+      if (i >= ndata) {
+        // round batch, pad with instances from beginning of next round,
+        // which are skipped by next BeforeFirst
+        if (round_batch_ != 0) {
+          if (num_overflow_ == 0) this->StartRound();
+          i -= ndata;
+          utils::Check(i < ndata, "LibSVMIterator: number of input must be bigger than batch size");
+          num_overflow_ += 1;
+        } else {
+          batch_row_ptr_[top + 1] = batch_row_ptr_[top];
+          batch_label_[top] = 0.0f;
+          batch_index_[top] = 0;
+          ++out_.num_batch_padd;
+          continue;
+        }
+        ++out_.num_batch_padd;
+      }
+      unsigned ridx = order_[i];
+      batch_entry_.insert(batch_entry_.end(),
+                          entry_.begin() + row_ptr_[ridx],
+                          entry_.begin() + row_ptr_[ridx + 1]);
+      batch_row_ptr_[top + 1] = batch_entry_.size();
+      batch_label_[top] = labels_[ridx];
+      batch_index_[top] = ridx;
+    }
+    out_.sparse_row_ptr = &batch_row_ptr_[0];
+    out_.sparse_data = batch_entry_.size() != 0 ? &batch_entry_[0] : NULL;
+    out_.label.dptr_ = &batch_label_[0];
+    out_.inst_index = &batch_index_[0];
+  }
+  // load the whole file, parse it in parallel and concatenate the results
+  inline void LoadData(void) {
+    file_.Open(path_data_.c_str());
+    file_.Advise(0, file_.Size(), utils::MMapFile::kSequential);
+    chunks_.clear();
+    chunks_.resize(nthread_);
+    ParseJob job; job.iter = this;
+    utils::ThreadPool<ParseJob> pool;
+    pool.Init(nthread_, &job);
+    pool.Run();
+    pool.Destroy();
+    file_.Close();
+    row_ptr_.clear(); entry_.clear(); labels_.clear();
+    row_ptr_.push_back(0);
+    unsigned max_findex = 0;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      Chunk &c = chunks_[i];
+      const size_t offset = entry_.size();
+      for (size_t j = 1; j < c.row_ptr.size(); ++j) {
+        row_ptr_.push_back(c.row_ptr[j] + offset);
+      }
+      entry_.insert(entry_.end(), c.entry.begin(), c.entry.end());
+      labels_.insert(labels_.end(), c.labels.begin(), c.labels.end());
+      max_findex = std::max(max_findex, c.max_findex);
+    }
+    chunks_.clear();
+    if (num_feature_ == 0) {
+      num_feature_ = max_findex + 1;
+    } else {
+      utils::Check(entry_.size() == 0 || max_findex < num_feature_,
+                   "LibSVMIterator: feature index %u exceed input_shape", max_findex);
+    }
+  }
+  // parse the lines that start in tid-th part of the file
+  inline void ParseChunk(int tid, int nthread) {
+    const char *head = file_.data();
+    const size_t size = file_.Size();
+    const char *begin = head + this->LineBegin(size * tid / nthread);
+    const char *end = head + this->LineBegin(size * (tid + 1) / nthread);
+    Chunk &c = chunks_[tid];
+    c.row_ptr.push_back(0);
+    c.max_findex = 0;
+    const char *p = begin;
+    while (p < end) {
+      const char *lend = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (lend == NULL) lend = end;
+      this->ParseLine(p, lend, &c);
+      p = lend + 1;
+    }
+  }
+  // first position of a line starting at or after pos
+  inline size_t LineBegin(size_t pos) const {
+    const char *head = file_.data();
+    const size_t size = file_.Size();
+    if (pos == 0 || pos >= size) return std::min(pos, size);
+    if (head[pos - 1] == '\n') return pos;
+    const char *lend = static_cast<const char*>(memchr(head + pos, '\n', size - pos));
+    return lend == NULL ? size : lend - head + 1;
+  }
+  // parse one line, empty lines and comments are skipped
+  inline void ParseLine(const char *p, const char *end, Chunk *c) {
+    char buf[64];
+    p = NextToken(p, end, buf, sizeof(buf));
+    if (buf[0] == '\0' || buf[0] == '#') return;
+    c->labels.push_back(static_cast<float>(atof(buf)));
+    while (true) {
+      p = NextToken(p, end, buf, sizeof(buf));
+      if (buf[0] == '\0' || buf[0] == '#') break;
+      char *sep = strchr(buf, ':');
+      utils::Check(sep != NULL, "LibSVMIterator: invalid entry \"%s\", must be findex:fvalue", buf);
+      *sep = '\0';
+      unsigned findex = static_cast<unsigned>(strtoul(buf, NULL, 10));
+      c->entry.push_back(SparseInst::Entry(findex, static_cast<float>(atof(sep + 1))));
+      c->max_findex = std::max(c->max_findex, findex);
+    }
+    c->row_ptr.push_back(c->entry.size());
+  }
+  // copy next whitespace separated token in [p, end) into buf, buf is empty if there is none
+  inline static const char *NextToken(const char *p, const char *end, char *buf, size_t len) {
+    while (p < end && isspace(*p)) ++p;
+    size_t n = 0;
+    while (p < end && !isspace(*p)) {
+      utils::Check(n + 1 < len, "LibSVMIterator: token too long");
+      buf[n++] = *p++;
+    }
+    buf[n] = '\0';
+    return p;
+  }
+
+ private:
+  /*! \brief silent */
+  int silent_;
+  /*! \brief whether do shuffle */
+  int shuffle_;
+  /*! \brief whether to fill the last batch with instances from beginning */
+  int round_batch_;
+  /*! \brief number of threads to parse the file */
+  int nthread_;
+  /*! \brief batch size */
+  index_t batch_size_;
+  /*! \brief number of features, dense size of each instance */
+  unsigned num_feature_;
+  /*! \brief path to the libsvm file */
+  std::string path_data_;
+  /*! \brief output */
+  DataBatch out_;
+  /*! \brief current location */
+  size_t loc_;
+  /*! \brief the dataset in CSR format */
+  std::vector<size_t> row_ptr_;
+  std::vector<SparseInst::Entry> entry_;
+  std::vector<float> labels_;
+  /*! \brief order of instances in current round, also used as instance index */
+  std::vector<unsigned> order_;
+  /*! \brief buffer of gathered batch */
+  std::vector<size_t> batch_row_ptr_;
+  std::vector<SparseInst::Entry> batch_entry_;
+  std::vector<float> batch_label_;
+  std::vector<unsigned> batch_index_;
+  /*! \brief mapped file during loading */
+  utils::MMapFile file_;
+  /*! \brief parse results of each thread */
+  std::vector<Chunk> chunks_;
+  /*! \brief number of instances of next round used by last batch in round_batch mode */
+  size_t num_overflow_;
+  /*! \brief seed_data */
+  unsigned seed_;
+  /*! \brief number of rounds started */
+  size_t epoch_;
+  /*! \brief random sampler for shuffle, restarted in each round */
+  utils::PhiloxSampler rnd;
+  /*! \brief magic number to setup randomness */
+  static const int kRandMagic = 0;
+};
+}  // namespace cxxnet
+#endif  // CXXNET_ITER_LIBSVM_INL_HPP_
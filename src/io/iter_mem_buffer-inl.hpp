@@ -34,7 +34,7 @@ class DenseBufferIterator : public IIterator<DataBatch> {
       const DataBatch &batch = base_->Value();
       utils::Assert(batch.label.dptr_ != NULL, "need dense");
       DataBatch v;
-      v.AllocSpaceDense(batch.data.shape_, batch.batch_size, batch.label.size(1));
+      v.AllocSpaceLike(batch);
       v.CopyFromDense(batch);
       buffer_.push_back(v);
       if (buffer_.size() >= max_nbatch_) break;
@@ -0,0 +1,460 @@
+#ifndef CXXNET_ITER_MEM_CACHE_INL_HPP_
+#define CXXNET_ITER_MEM_CACHE_INL_HPP_
+/*!
+ * \file iter_mem_cache-inl.hpp
+ * \brief iterator that caches the whole image dataset in memory as compressed records,
+ *   and runs augmentation and batching from the cache on worker threads
+ */
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <zlib.h>
+#include <mshadow/tensor.h>
+#include "./data.h"
+#include "./iter_augment_proc-inl.hpp"
+#include "./iter_batch_proc-inl.hpp"
+#include "../utils/utils.h"
+#include "../utils/random.h"
+#include "../utils/thread_pool.h"
+#include "../utils/thread_ring_buffer.h"
+
+namespace cxxnet {
+/*!
+ * \brief loads all decoded images of the base iterator at Init, each image is compressed by zlib
+ *   and appended to a single arena. In every round, the records are shuffled, and batch b of the
+ *   round is made by the worker that takes ticket b of a ring: it decompresses the records,
+ *   runs its own AugmentIterator and BatchAdaptIterator over them, and writes the batch into the
+ *   ring slot, the ring hands the batches to the consumer in order. The order of records and the
+ *   augmentation of each instance are decided by seed_data, round and instance index only, so the
+ *   output does not depend on nthread
+ */
+class MemCacheIterator: public IIterator<DataBatch> {
+ public:
+  /*!
+   * \brief constructor
+   * \param base the image iterator to be cached
+   * \param cfg parameters already given to base, they are also used by the augmenters of workers
+   */
+  MemCacheIterator(IIterator<DataInst> *base,
+                   const std::vector< std::pair<std::string, std::string> > &cfg)
+      : base_(base) {
+    silent_ = 0;
+    shuffle_ = 0;
+    round_batch_ = 0;
+    batch_size_ = 0;
+    nthread_ = 4;
+    compress_level_ = 1;
+    seed_ = 0;
+    arena_ = NULL;
+    arena_size_ = arena_capacity_ = 0;
+    raw_bytes_ = 0;
+    label_width_ = 0;
+    running_ = false;
+    stop_signal_ = false;
+    end_of_data_ = false;
+    cur_slot_ = -1;
+    out_ = NULL;
+    num_pop_ = round_begin_ = 0;
+    num_end_ = 0;
+    epoch_ = 0;
+    for (size_t i = 0; i < cfg.size(); ++i) {
+      this->ParseParam(cfg[i].first.c_str(), cfg[i].second.c_str());
+    }
+  }
+  virtual ~MemCacheIterator(void) {
+    if (running_) this->StopRound();
+    pool_.Destroy();
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i]->FreeSpaceDense();
+      delete ring_[i];
+    }
+    ring_.Destroy();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      delete workers_[i].chain;
+    }
+    delete base_;
+    free(arena_);
+  }
+  virtual void SetParam(const char *name, const char *val) {
+    if (base_ != NULL) base_->SetParam(name, val);
+    this->ParseParam(name, val);
+  }
+  virtual void Init(void) {
+    utils::Check(batch_size_ != 0, "MemCacheIterator: must set batch_size");
+    utils::Check(nthread_ > 0, "MemCacheIterator: memcache_nthread must be positive");
+    base_->Init();
+    this->LoadCache();
+    // the images are all in cache, free the base and its buffers
+    delete base_; base_ = NULL;
+    utils::Check(records_.size() != 0, "MemCacheIterator: no image in input iterator");
+    order_.resize(records_.size());
+    // the mean image may be created by the first worker in InitWorkers, over the original order
+    this->ResetOrder();
+    if (silent_ == 0) {
+      size_t index_bytes = records_.size() * sizeof(Record) +
+          labels_.size() * sizeof(float) + order_.size() * sizeof(unsigned);
+      printf("MemCacheIterator: %lu images, %lu MB in cache, %lu MB decoded, "\
+             "ratio=%.2f, index %lu MB\n",
+             static_cast<unsigned long>(records_.size()),
+             static_cast<unsigned long>(arena_size_ >> 20UL),
+             static_cast<unsigned long>(raw_bytes_ >> 20UL),
+             static_cast<double>(raw_bytes_) / std::max(arena_size_, static_cast<size_t>(1)),
+             static_cast<unsigned long>(index_bytes >> 20UL));
+    }
+    this->InitWorkers();
+    ring_.Init(nthread_ * kQueuePerThread);
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i] = new DataBatch();
+    }
+    job_.self = this;
+    pool_.Init(nthread_, &job_);
+    this->BeforeFirst();
+  }
+  virtual void BeforeFirst(void) {
+    if (running_) this->StopRound();
+    epoch_ += 1;
+    // the order of each round is shuffled from the original order
+    this->ResetOrder();
+    if (shuffle_ != 0) {
+      rnd.Seed(kRandMagic + seed_, static_cast<uint32_t>(epoch_), 0);
+      rnd.Shuffle(order_);
+    }
+    const size_t n = records_.size();
+    num_batch_ = (n + batch_size_ - 1) / batch_size_;
+    round_begin_ = num_pop_;
+    num_end_ = 0;
+    end_of_data_ = false;
+    running_ = true;
+    pool_.Start();
+  }
+  virtual bool Next(void) {
+    if (end_of_data_) return false;
+    return this->PopSlot();
+  }
+  virtual const DataBatch &Value(void) const {
+    utils::Assert(out_ != NULL, "MemCacheIterator: must call Next to get value");
+    return *out_;
+  }
+
+ private:
+  /*! \brief location of an image in arena */
+  struct Record {
+    // offset in arena and size of compressed image
+    size_t offset;
+    size_t size;
+    // shape of decoded image, in (height, width, channel)
+    mshadow::Shape<3> shape;
+    // instance index
+    unsigned index;
+  };
+  /*! \brief iterator over the records of one batch, used as base of the augmenter of a worker */
+  class CacheReader: public IIterator<DataInst> {
+   public:
+    explicit CacheReader(const MemCacheIterator *cache)
+        : cache_(cache), begin_(0), end_(0), pos_(0), img_(false) {}
+    virtual void SetParam(const char *name, const char *val) {}
+    virtual void Init(void) {}
+    virtual void BeforeFirst(void) {
+      pos_ = begin_;
+    }
+    virtual bool Next(void) {
+      if (pos_ >= end_) return false;
+      // positions beyond the dataset wrap to beginning, used by round_batch
+      const size_t n = cache_->order_.size();
+      const unsigned rid = cache_->order_[pos_ % n];
+      const Record &r = cache_->records_[rid];
+      img_.Resize(r.shape);
+      cache_->Decompress(r, img_.dptr_);
+      out_.index = r.index;
+      out_.label = mshadow::Tensor<cpu, 1>(const_cast<float*>(&cache_->labels_[0]) +
+                                           rid * cache_->label_width_,
+                                           mshadow::Shape1(cache_->label_width_));
+      out_.raw = img_;
+      pos_ += 1;
+      return true;
+    }
+    virtual const DataInst &Value(void) const {
+      return out_;
+    }
+    virtual size_t NumInst(void) const {
+      return end_ - begin_;
+    }
+    /*! \brief set positions in shuffled order to be read */
+    inline void SetRange(size_t begin, size_t end) {
+      begin_ = begin; end_ = end; pos_ = begin;
+    }
+
+   private:
+    const MemCacheIterator *cache_;
+    size_t begin_, end_, pos_;
+    mshadow::TensorContainer<cpu, 3, unsigned char> img_;
+    DataInst out_;
+  };
+  /*! \brief augmentation and batching chain of a worker */
+  struct Worker {
+    CacheReader *reader;
+    AugmentIterator *aug;
+    IIterator<DataBatch> *chain;
+  };
+  /*! \brief job of workers, each worker makes batches until end of round */
+  struct BatchJob {
+    MemCacheIterator *self;
+    inline void operator()(int tid, int nthread) {
+      self->RunWorker(tid);
+    }
+  };
+  /*! \brief job that compresses a chunk of images during loading */
+  struct CompressJob {
+    int level;
+    int count;
+    std::vector< std::vector<unsigned char> > in, out;
+    inline void operator()(int tid, int nthread) {
+      for (int i = tid; i < count; i += nthread) {
+        uLongf len = compressBound(in[i].size());
+        out[i].resize(len);
+        utils::Check(compress2(&out[i][0], &len, &in[i][0], in[i].size(), level) == Z_OK,
+                     "MemCacheIterator: fail to compress image");
+        out[i].resize(len);
+      }
+    }
+  };
+  inline void ParseParam(const char *name, const char *val) {
+    cfg_.push_back(std::make_pair(std::string(name), std::string(val)));
+    if (!strcmp(name, "silent")) silent_ = atoi(val);
+    if (!strcmp(name, "shuffle")) shuffle_ = atoi(val);
+    if (!strcmp(name, "round_batch")) round_batch_ = atoi(val);
+    if (!strcmp(name, "batch_size")) batch_size_ = static_cast<index_t>(atoi(val));
+    if (!strcmp(name, "memcache_nthread")) nthread_ = atoi(val);
+    if (!strcmp(name, "memcache_compress")) compress_level_ = atoi(val);
+    if (!strcmp(name, "seed_data")) seed_ = static_cast<unsigned>(atoi(val));
+  }
+  // read all images of base into arena, images are compressed in chunks by a thread pool
+  inline void LoadCache(void) {
+    CompressJob job;
+    job.level = compress_level_;
+    job.count = 0;
+    job.in.resize(nthread_ * kChunkPerThread);
+    job.out.resize(job.in.size());
+    utils::ThreadPool<CompressJob> pool;
+    if (compress_level_ != 0) pool.Init(nthread_, &job);
+    std::vector<Record> chunk(job.in.size());
+    bool end = false;
+    while (!end) {
+      job.count = 0;
+      while (job.count < static_cast<int>(job.in.size())) {
+        if (!base_->Next()) {
+          end = true; break;
+        }
+        const DataInst &d = base_->Value();
+        utils::Check(d.raw.dptr_ != NULL,
+                     "MemCacheIterator: input must be an image iterator, e.g. imgbin");
+        utils::Check(d.raw.CheckContiguous(), "MemCacheIterator: image must be contiguous");
+        if (label_width_ == 0) label_width_ = d.label.size(0);
+        utils::Check(d.label.size(0) == label_width_, "MemCacheIterator: label width mismatch");
+        for (index_t j = 0; j < d.label.size(0); ++j) {
+          labels_.push_back(d.label[j]);
+        }
+        Record &r = chunk[job.count];
+        r.shape = d.raw.shape_;
+        r.index = d.index;
+        const unsigned char *img = d.raw.dptr_;
+        job.in[job.count].assign(img, img + d.raw.shape_.Size());
+        raw_bytes_ += d.raw.shape_.Size();
+        job.count += 1;
+      }
+      if (compress_level_ != 0) pool.Run();
+      for (int i = 0; i < job.count; ++i) {
+        const std::vector<unsigned char> &bytes = compress_level_ != 0 ? job.out[i] : job.in[i];
+        chunk[i].offset = arena_size_;
+        chunk[i].size = bytes.size();
+        this->Append(bytes.size() != 0 ? &bytes[0] : NULL, bytes.size());
+        records_.push_back(chunk[i]);
+      }
+    }
+    // give back the space reserved for growth
+    if (arena_size_ != 0) {
+      arena_ = static_cast<unsigned char*>(realloc(arena_, arena_size_));
+      arena_capacity_ = arena_size_;
+    }
+  }
+  // set order of records to the original order
+  inline void ResetOrder(void) {
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = static_cast<unsigned>(i);
+    }
+  }
+  // append bytes to arena
+  inline void Append(const unsigned char *bytes, size_t size) {
+    if (arena_size_ + size > arena_capacity_) {
+      size_t capacity = std::max(arena_capacity_ + arena_capacity_ / 2, arena_size_ + size);
+      capacity = std::max(capacity, static_cast<size_t>(64UL << 20UL));
+      unsigned char *ptr = static_cast<unsigned char*>(realloc(arena_, capacity));
+      utils::Check(ptr != NULL, "MemCacheIterator: out of memory when caching images");
+      arena_ = ptr; arena_capacity_ = capacity;
+    }
+    if (size != 0) memcpy(arena_ + arena_size_, bytes, size);
+    arena_size_ += size;
+  }
+  // decompress record into dst, which has the size of decoded image
+  inline void Decompress(const Record &r, unsigned char *dst) const {
+    const size_t nbytes = r.shape.Size();
+    if (compress_level_ == 0) {
+      memcpy(dst, arena_ + r.offset, nbytes); return;
+    }
+    uLongf len = nbytes;
+    utils::Check(uncompress(dst, &len, arena_ + r.offset, r.size) == Z_OK && len == nbytes,
+                 "MemCacheIterator: fail to decompress image");
+  }
+  // create augmentation and batching chain of each worker, with the same parameters
+  inline void InitWorkers(void) {
+    for (int i = 0; i < nthread_; ++i) {
+      Worker w;
+      w.reader = new CacheReader(this);
+      w.aug = new AugmentIterator(w.reader);
+      w.chain = new BatchAdaptIterator(w.aug);
+      for (size_t j = 0; j < cfg_.size(); ++j) {
+        const char *name = cfg_[j].first.c_str();
+        // overflow of last batch is handled by the cache
+        if (!strcmp(name, "round_batch")) continue;
+        w.chain->SetParam(name, cfg_[j].second.c_str());
+      }
+      if (i != 0) w.chain->SetParam("silent", "1");
+      // the first worker may create the mean image by going over the cache in order,
+      // the others load it
+      w.reader->SetRange(0, records_.size());
+      w.chain->Init();
+      workers_.push_back(w);
+    }
+  }
+  // take tickets and make batches of current round, push one end mark when done
+  inline void RunWorker(int tid) {
+    while (true) {
+      unsigned long ticket;
+      int slot = ring_.BeginPush(&ticket);
+      const size_t b = ticket - round_begin_;
+      if (stop_signal_ || b >= num_batch_) {
+        ring_.EndPush(slot, true); return;
+      }
+      this->MakeBatch(workers_[tid], b, ring_[slot]);
+      ring_.EndPush(slot);
+    }
+  }
+  // make b-th batch of current round into dst
+  inline void MakeBatch(const Worker &w, size_t b, DataBatch *dst) {
+    const size_t n = records_.size();
+    const size_t begin = b * batch_size_;
+    size_t end = begin + batch_size_;
+    if (round_batch_ == 0) end = std::min(end, n);
+    w.reader->SetRange(begin, end);
+    w.chain->BeforeFirst();
+    w.aug->set_epoch(static_cast<unsigned>(epoch_));
+    if (dst->label.dptr_ != NULL) w.chain->ReserveSlot(*dst);
+    utils::Check(w.chain->Next(), "MemCacheIterator: empty batch");
+    const DataBatch &batch = w.chain->Value();
+    if (dst->label.dptr_ == NULL) dst->AllocSpaceLike(batch);
+    bool inplace = batch.data_type == DataBatch::kUInt8 ?
+        batch.data_uint8.dptr_ == dst->data_uint8.dptr_ : batch.data.dptr_ == dst->data.dptr_;
+    if (inplace) {
+      dst->num_batch_padd = batch.num_batch_padd;
+      dst->norm = batch.norm;
+    } else {
+      dst->CopyFromDense(batch);
+    }
+    // instances wrapped from the beginning are padding
+    if (end > n) dst->num_batch_padd = static_cast<index_t>(end - std::max(begin, n));
+  }
+  // move to next slot of ring, return false if reaches end of round
+  inline bool PopSlot(void) {
+    if (cur_slot_ != -1) ring_.EndPop(cur_slot_);
+    cur_slot_ = ring_.BeginPop();
+    out_ = ring_[cur_slot_];
+    num_pop_ += 1;
+    if (ring_.IsEnd(cur_slot_)) {
+      ring_.EndPop(cur_slot_);
+      cur_slot_ = -1;
+      out_ = NULL;
+      num_end_ += 1;
+      end_of_data_ = true;
+      return false;
+    }
+    return true;
+  }
+  // stop the workers, drop the batches made, until every worker pushed its end mark
+  inline void StopRound(void) {
+    stop_signal_ = true;
+    end_of_data_ = false;
+    while (num_end_ < pool_.nthread()) {
+      this->PopSlot();
+    }
+    pool_.Wait();
+    stop_signal_ = false;
+    running_ = false;
+  }
+  /*! \brief base iterator, freed after loading */
+  IIterator<DataInst> *base_;
+  /*! \brief all parameters, given to the chain of each worker */
+  std::vector< std::pair<std::string, std::string> > cfg_;
+  /*! \brief silent */
+  int silent_;
+  /*! \brief whether shuffle the records in every round */
+  int shuffle_;
+  /*! \brief whether fill the last batch with records from beginning */
+  int round_batch_;
+  /*! \brief batch size */
+  index_t batch_size_;
+  /*! \brief number of worker threads */
+  int nthread_;
+  /*! \brief zlib level of records, 0 means stored without compression */
+  int compress_level_;
+  /*! \brief seed_data */
+  unsigned seed_;
+  /*! \brief arena that holds all the records */
+  unsigned char *arena_;
+  size_t arena_size_, arena_capacity_;
+  /*! \brief total size of decoded images */
+  size_t raw_bytes_;
+  /*! \brief location of records in arena */
+  std::vector<Record> records_;
+  /*! \brief labels of records */
+  std::vector<float> labels_;
+  /*! \brief number of labels of each record */
+  index_t label_width_;
+  /*! \brief order of records in current round */
+  std::vector<unsigned> order_;
+  /*! \brief number of batches in current round */
+  size_t num_batch_;
+  /*! \brief number of rounds started */
+  size_t epoch_;
+  /*! \brief chain of each worker */
+  std::vector<Worker> workers_;
+  /*! \brief ring that puts batches made by workers back in order */
+  utils::ThreadRing<DataBatch*> ring_;
+  /*! \brief slot held by consumer, -1 if none */
+  int cur_slot_;
+  /*! \brief batch in the slot held by consumer */
+  DataBatch *out_;
+  /*! \brief number of slots popped so far, and first ticket of current round */
+  unsigned long num_pop_, round_begin_;
+  /*! \brief number of end marks popped in current round */
+  int num_end_;
+  /*! \brief whether workers are running a round */
+  bool running_;
+  /*! \brief whether consumer reaches end of round */
+  bool end_of_data_;
+  /*! \brief signal workers to stop current round */
+  volatile bool stop_signal_;
+  /*! \brief job and workers */
+  BatchJob job_;
+  utils::ThreadPool<BatchJob> pool_;
+  /*! \brief random sampler for shuffle, restarted in each round */
+  utils::PhiloxSampler rnd;
+  /*! \brief magic number to setup randomness */
+  static const int kRandMagic = 157;
+  /*! \brief number of batches in ring for each worker */
+  static const int kQueuePerThread = 2;
+  /*! \brief number of images each thread compresses in one chunk during loading */
+  static const int kChunkPerThread = 16;
+};
+}  // namespace cxxnet
+#endif  // CXXNET_ITER_MEM_CACHE_INL_HPP_
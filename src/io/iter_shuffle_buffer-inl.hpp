@@ -0,0 +1,194 @@
+#ifndef CXXNET_ITER_SHUFFLE_BUFFER_INL_HPP_
+#define CXXNET_ITER_SHUFFLE_BUFFER_INL_HPP_
+/*!
+ * \file iter_shuffle_buffer-inl.hpp
+ * \brief iterator that shuffles a stream of instances with a bounded buffer
+ */
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <mshadow/tensor.h>
+#include "./data.h"
+#include "../utils/utils.h"
+#include "../utils/random.h"
+
+namespace cxxnet {
+/*!
+ * \brief keeps a buffer of shuffle_buffer_size instances from the base iterator,
+ *   each call of Next emits a random instance in the buffer, and its slot is refilled
+ *   by the next instance of base iterator. The content of instances (decoded image, data
+ *   or uint8 data) is copied into the space of slots, which is reused in place, so after
+ *   the buffer is filled once, no allocation happens unless an instance is larger than
+ *   all instances seen by its slot
+ */
+class ShuffleBufferIterator: public IIterator<DataInst> {
+ public:
+  ShuffleBufferIterator(IIterator<DataInst> *base)
+      : base_(base) {
+    buffer_size_ = 10000;
+    silent_ = 0;
+    seed_ = 0;
+    epoch_ = 0;
+  }
+  virtual ~ShuffleBufferIterator(void) {
+    delete base_;
+  }
+  virtual void SetParam(const char *name, const char *val) {
+    base_->SetParam(name, val);
+    if (!strcmp(name, "shuffle_buffer_size")) buffer_size_ = atoi(val);
+    if (!strcmp(name, "seed_data")) seed_ = static_cast<unsigned>(atoi(val));
+    if (!strcmp(name, "silent")) silent_ = atoi(val);
+  }
+  virtual void Init(void) {
+    base_->Init();
+    utils::Check(buffer_size_ > 0, "shuffle_buffer_size must be positive");
+    slots_.resize(buffer_size_);
+    order_.resize(buffer_size_);
+    if (silent_ == 0) {
+      printf("ShuffleBufferIterator: shuffle_buffer_size=%d\n", buffer_size_);
+    }
+    this->BeforeFirst();
+  }
+  virtual void BeforeFirst(void) {
+    base_->BeforeFirst();
+    for (int i = 0; i < buffer_size_; ++i) {
+      order_[i] = i;
+    }
+    nfilled_ = 0;
+    pending_ = -1;
+    base_end_ = false;
+    num_emit_ = 0;
+    epoch_ += 1;
+  }
+  virtual bool Next(void) {
+    // refill the slot emitted by last call, or remove it if base reaches end
+    if (pending_ != -1) {
+      if (!this->LoadBase(order_[pending_])) {
+        std::swap(order_[pending_], order_[nfilled_ - 1]);
+        nfilled_ -= 1;
+      }
+      pending_ = -1;
+    }
+    while (nfilled_ < buffer_size_ && this->LoadBase(order_[nfilled_])) {
+      nfilled_ += 1;
+    }
+    if (nfilled_ == 0) return false;
+    // the choice is decided by seed, round and the number of instances emitted in the round
+    rnd.Seed(kRandMagic + seed_, static_cast<uint32_t>(epoch_), num_emit_);
+    pending_ = static_cast<int>(rnd.NextUInt32(nfilled_));
+    num_emit_ += 1;
+    this->Emit(slots_[order_[pending_]]);
+    return true;
+  }
+  virtual const DataInst &Value(void) const {
+    return out_;
+  }
+  virtual size_t NumInst(void) const {
+    return base_->NumInst();
+  }
+
+ private:
+  /*! \brief type of content in slot */
+  enum ContentType {
+    kRaw,
+    kData,
+    kDataUInt8
+  };
+  /*! \brief space of an instance in buffer */
+  struct Slot {
+    unsigned index;
+    std::vector<float> label;
+    std::vector<unsigned char> content;
+    mshadow::Shape<3> shape;
+    ContentType type;
+    DataNorm norm;
+  };
+  // load next instance of base into slot, return false if base reaches end
+  inline bool LoadBase(int sid) {
+    if (base_end_) return false;
+    if (!base_->Next()) {
+      base_end_ = true; return false;
+    }
+    const DataInst &d = base_->Value();
+    Slot &s = slots_[sid];
+    s.index = d.index;
+    s.label.resize(d.label.size(0));
+    for (index_t i = 0; i < d.label.size(0); ++i) {
+      s.label[i] = d.label[i];
+    }
+    s.norm = d.norm;
+    if (d.data.dptr_ != NULL) {
+      s.type = kData;
+      this->CopyContent(d.data, &s);
+    } else if (d.raw.dptr_ != NULL) {
+      s.type = kRaw;
+      this->CopyContent(d.raw, &s);
+    } else {
+      utils::Check(d.data_uint8.dptr_ != NULL, "ShuffleBufferIterator: instance has no content");
+      s.type = kDataUInt8;
+      this->CopyContent(d.data_uint8, &s);
+    }
+    return true;
+  }
+  template<typename DType>
+  inline void CopyContent(const mshadow::Tensor<cpu, 3, DType> &src, Slot *s) {
+    utils::Check(src.CheckContiguous(), "ShuffleBufferIterator: instance must be contiguous");
+    size_t nbytes = src.shape_.Size() * sizeof(DType);
+    // leave some room, so that slightly larger instances can reuse the space
+    if (s->content.capacity() < nbytes) s->content.reserve(nbytes + nbytes / 4);
+    s->content.resize(nbytes);
+    if (nbytes != 0) memcpy(&s->content[0], src.dptr_, nbytes);
+    s->shape = src.shape_;
+  }
+  // set output to the content of slot
+  inline void Emit(Slot &s) {
+    out_.index = s.index;
+    out_.label = mshadow::Tensor<cpu, 1>(s.label.size() != 0 ? &s.label[0] : NULL,
+                                         mshadow::Shape1(s.label.size()));
+    out_.norm = s.norm;
+    out_.data.dptr_ = NULL;
+    out_.raw.dptr_ = NULL;
+    out_.data_uint8.dptr_ = NULL;
+    void *dptr = s.content.size() != 0 ? &s.content[0] : NULL;
+    switch (s.type) {
+      case kData:
+        out_.data = mshadow::Tensor<cpu, 3>(static_cast<real_t*>(dptr), s.shape); break;
+      case kRaw:
+        out_.raw = mshadow::Tensor<cpu, 3, unsigned char>(
+            static_cast<unsigned char*>(dptr), s.shape); break;
+      case kDataUInt8:
+        out_.data_uint8 = mshadow::Tensor<cpu, 3, unsigned char>(
+            static_cast<unsigned char*>(dptr), s.shape); break;
+    }
+  }
+  /*! \brief base iterator */
+  IIterator<DataInst> *base_;
+  /*! \brief number of instances in buffer */
+  int buffer_size_;
+  /*! \brief silent */
+  int silent_;
+  /*! \brief output */
+  DataInst out_;
+  /*! \brief space of instances */
+  std::vector<Slot> slots_;
+  /*! \brief slots in use are order_[0, nfilled_) */
+  std::vector<int> order_;
+  /*! \brief number of slots in use */
+  int nfilled_;
+  /*! \brief position in order_ of the slot emitted by last call of Next, -1 if none */
+  int pending_;
+  /*! \brief whether base iterator reaches end */
+  bool base_end_;
+  /*! \brief number of instances emitted in current round */
+  uint32_t num_emit_;
+  /*! \brief seed_data */
+  unsigned seed_;
+  /*! \brief number of rounds started */
+  size_t epoch_;
+  /*! \brief random sampler, restarted for each instance emitted */
+  utils::PhiloxSampler rnd;
+  /*! \brief magic number to setup randomness */
+  static const int kRandMagic = 233;
+};
+}  // namespace cxxnet
+#endif  // CXXNET_ITER_SHUFFLE_BUFFER_INL_HPP_
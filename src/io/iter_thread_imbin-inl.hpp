@@ -28,6 +28,7 @@ public:
     label_width_ = 1;
     dist_num_worker_ = 0;
     dist_worker_rank_ = 0;
+    nchannel_ = 3;
   }
   virtual ~ThreadImagePageIterator(void) {
     if (fplst_ != NULL) fclose(fplst_);
@@ -56,6 +57,11 @@ public:
       dist_worker_rank_ = atoi(val);
     }
     if (!strcmp(name, "silent")) silent_ = atoi(val);
+    if (!strcmp(name, "input_shape")) {
+      // single channel network input is decoded in grayscale
+      unsigned nchannel;
+      if (sscanf(val, "%u", &nchannel) == 1) nchannel_ = nchannel == 1 ? 1 : 3;
+    }
     if (!strcmp(name, "label_width")) {
       label_width_ = atoi(val);
     }
@@ -105,7 +111,7 @@ public:
       }
       utils::Assert(fscanf(fplst_, "%*[^\n]\n") == 0, "ignore");
       this->NextBuffer(buf_);
-      this->LoadImage(img_, out_, buf_);
+      this->LoadImage(img_, out_, buf_, nchannel_);
       return true;
     }
     idx_ += 1;
@@ -125,11 +131,21 @@ public:
 protected:
   inline static void LoadImage(mshadow::TensorContainer<cpu, 3> &img,
                                DataInst &out,
-                               std::vector<unsigned char> &buf) {
-    cv::Mat res = cv::imdecode(buf, 1);
+                               std::vector<unsigned char> &buf,
+                               int nchannel) {
+    cv::Mat res = cv::imdecode(buf, nchannel == 1 ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
     utils::Assert(res.data != NULL, "decoding fail");
 
-    img.Resize(mshadow::Shape3(3, res.rows, res.cols));
+    img.Resize(mshadow::Shape3(nchannel, res.rows, res.cols));
+    if (nchannel == 1) {
+      for (index_t y = 0; y < img.size(1); ++y) {
+        for (index_t x = 0; x < img.size(2); ++x) {
+          img[0][y][x] = res.at<unsigned char>(y, x);
+        }
+      }
+      out.data = img;
+      res.release(); return;
+    }
     for (index_t y = 0; y < img.size(1); ++y) {
       for (index_t x = 0; x < img.size(2); ++x) {
         cv::Vec3b bgr = res.at<cv::Vec3b>(y, x);
@@ -168,6 +184,8 @@ protected:
   DataInst out_;
   /*! \brief label-width */
   int label_width_;
+  /*! \brief number of channels of decoded image */
+  int nchannel_;
   /*! \brief silent */
   int silent_;
   /*! \brief file pointer to list file, information file */
@@ -7,10 +7,17 @@
  */
 #include "data.h"
 #include <cstdlib>
-#include "../utils/thread_buffer.h"
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+#include "../utils/thread_ring_buffer.h"
+#include "../utils/thread_pool.h"
 #include "../utils/utils.h"
 #include "../utils/decoder.h"
 #include "../utils/random.h"
+#include "../utils/io.h"
+#include "../utils/decoded_cache.h"
+#include "../utils/page_reader.h"
 
 namespace cxxnet {
 /*! \brief thread buffer iterator */
@@ -20,11 +27,19 @@ public:
     silent_ = 0;
     itrpage.SetParam("buffer_size", "2");
     itrimg.SetParam("buffer_size", "256");
+    itrpage.set_stage_name("PageFactory");
+    itrimg.set_stage_name("ImageFactory");
     img_conf_prefix_ = "";
     dist_num_worker_ = 0;
     dist_worker_rank_ = 0;
+    outimg_ = NULL;
+    has_pos_ = false;
   }
   virtual ~ThreadImagePageIteratorX(void) {
+    if (silent_ == 0) {
+      printf("ThreadImagePageIterator: waited %g sec for images, image decoder waited %g sec for pages\n",
+             itrimg.wait_time(), itrpage.wait_time());
+    }
   }
   virtual void SetParam(const char *name, const char *val) {
     if (!strcmp(name, "image_list")) {
@@ -37,6 +52,9 @@ public:
       raw_imgbin_ += ",";
       path_imgbin_.push_back(std::string(val));
     }
+    if (!strcmp(name, "image_label")) {
+      path_imglbl_.push_back(std::string(val));
+    }
     if (!strcmp(name, "image_conf_prefix")) {
       img_conf_prefix_ = val;
     }
@@ -66,8 +84,14 @@ public:
     }
     utils::Check(path_imgbin_.size() == path_imglst_.size(),
                  "List/Bin number not consist");
+    if (path_imglbl_.size() == 0) {
+      path_imglbl_.resize(path_imgbin_.size());
+    }
+    utils::Check(path_imgbin_.size() == path_imglbl_.size(),
+                 "Label/Bin number not consist");
     itrpage.get_factory().path_imgbin = path_imgbin_;
     itrpage.get_factory().path_imglst = path_imglst_;
+    itrpage.get_factory().path_imglbl = path_imglbl_;
     itrpage.Init();
     itrimg.get_factory().itrpage = &itrpage;
     itrimg.Init();
@@ -75,12 +99,17 @@ public:
   }
   virtual void BeforeFirst(void) {
     itrimg.BeforeFirst();
+    has_pos_ = false;
   }
   virtual bool Next(void) {
     if (itrimg.Next(outimg_)) {
       out_.index = outimg_->inst_index;
       out_.label = outimg_->label;
-      out_.data = outimg_->img;
+      out_.raw = outimg_->raw;
+      for (int i = 0; i < 4; ++i) {
+        pos_[i] = outimg_->pos[i];
+      }
+      has_pos_ = true;
       return true;
     } else {
       return false;
@@ -89,6 +118,25 @@ public:
   virtual const DataInst &Value(void) const {
     return out_;
   }
+  virtual size_t NumInst(void) const {
+    return itrpage.get_factory().NumRecord();
+  }
+  virtual bool Tell(std::vector<uint64_t> *pos) const {
+    if (!has_pos_ || !this->CanSeek()) return false;
+    pos->assign(pos_, pos_ + 4);
+    return true;
+  }
+  virtual bool Seek(const std::vector<uint64_t> &pos) {
+    if (pos.size() != 4 || !this->CanSeek()) return false;
+    // applied when the loaders are stopped by BeforeFirst, the decoder skips
+    // the instances of the page that are already returned
+    itrpage.get_factory().SetSeek(&pos[0]);
+    itrimg.get_factory().SetSkip(static_cast<int>(pos[3]));
+    itrimg.BeforeFirst();
+    pos_[0] = pos[0]; pos_[1] = pos[1]; pos_[2] = pos[2]; pos_[3] = pos[3];
+    has_pos_ = true;
+    return true;
+  }
 
  protected:
   /*! \brief number of distributed worker */
@@ -100,10 +148,20 @@ public:
   /*! \brief prefix path of image binary, path to input lst */
   // format: imageid label path
   std::vector<std::string> path_imgbin_, path_imglst_;
+  /*! \brief path to binary label file of each image binary, empty if text list is used */
+  std::vector<std::string> path_imglbl_;
   /*! \brief configuration bing */
   std::string img_conf_prefix_, img_conf_ids_;
   /*! \brief raw image list */
   std::string raw_imglst_, raw_imgbin_;
+  /*! \brief position after the last instance returned, see PageEntry::pos and ImageEntry::pos */
+  uint64_t pos_[4];
+  /*! \brief whether pos_ is valid */
+  bool has_pos_;
+  /*! \brief whether the position of instances can be restored, only in the order of files */
+  inline bool CanSeek(void) const {
+    return itrpage.get_factory().CanSeek() && itrimg.get_factory().CanSeek();
+  }
   /*! \brief parse configure file */
   inline void ParseImageConf(void) {
     // handling for hadoop
@@ -113,7 +171,8 @@ public:
     }
     if (img_conf_prefix_.length() == 0) return;
     utils::Check(path_imglst_.size() == 0 &&
-                 path_imgbin_.size() == 0,
+                 path_imgbin_.size() == 0 &&
+                 path_imglbl_.size() == 0,
                  "you can either set image_conf_prefix or image_bin/image_list");
     int lb, ub;
     utils::Check(sscanf(img_conf_ids_.c_str(), "%d-%d", &lb, &ub) == 2,
@@ -135,6 +194,12 @@ public:
       tmp.resize(strlen(tmp.c_str()));
       path_imglst_.push_back(tmp + ".lst");
       path_imgbin_.push_back(tmp + ".bin");
+      // use binary label file when it is available
+      if (utils::BinaryLabelFile::IsLabelFile((tmp + ".lbl").c_str())) {
+        path_imglbl_.push_back(tmp + ".lbl");
+      } else {
+        path_imglbl_.push_back(std::string());
+      }
     }
   }
 
@@ -144,6 +209,30 @@ private:
     utils::BinaryPage page;
     std::vector<float> labels;
     std::vector<unsigned> inst_index;
+    // records gathered from all files, used instead of page in global shuffle mode
+    std::vector<utils::BinaryPage::Obj> records;
+    // whether the entry is a list of records instead of a page
+    bool use_records;
+    // position of the page: index in order of files, offset of page in the binary file,
+    // and offset of its labels in the list, or number of records before it in the label file
+    uint64_t pos[3];
+    // aligned space of page owned by entry, used by parallel page reader
+    void *buffer;
+    PageEntry(void) : use_records(false), buffer(NULL) {}
+    // entry whose page views a memory mapped file instead of owning space
+    PageEntry(void *dptr, bool use_records)
+        : page(dptr), use_records(use_records), buffer(NULL) {}
+    ~PageEntry(void) {
+      if (buffer != NULL) utils::ParallelPageReader::FreeBuffer(buffer);
+    }
+    // number of instances in the entry
+    inline int Size(void) {
+      return use_records ? static_cast<int>(records.size()) : page.Size();
+    }
+    // get i-th instance in the entry
+    inline utils::BinaryPage::Obj operator[](int i) {
+      return use_records ? records[i] : page[i];
+    }
   };
   // factory to load page
   struct PageFactory {
@@ -152,13 +241,29 @@ private:
     std::vector<std::string> path_imgbin;
     // list of img list path
     std::vector<std::string> path_imglst;
+    // list of binary label path, empty string means text list is used
+    std::vector<std::string> path_imglbl;
     // constructor
     PageFactory(void) {
       label_width = 1;
       list_ptr = 0;
       fplist = NULL;
       shuffle = 0;
-      rnd.Seed(kRandMagic);
+      mmap_pages = 0;
+      global_shuffle = 0;
+      fmap = NULL;
+      rec_ptr = 0;
+      page_ptr = 0;
+      cur_fid = 0;
+      prefetch_depth = 0;
+      prefetch_chunk = 4096;
+      prefetch_direct = 0;
+      decompress_nthread = 4;
+      seek_pending = false;
+      inflate_job.factory = this;
+      inflate_page = NULL;
+      seed = 0;
+      epoch = 0;
     }
     inline void SetParam(const char *name, const char *val) {
       if (!strcmp(name, "label_width")) {
@@ -168,79 +273,421 @@ private:
         shuffle = atoi(val);
       }
       if (!strcmp(name, "seed_data")) {
-        rnd.Seed(atoi(val) + kRandMagic);
+        seed = static_cast<unsigned>(atoi(val));
+      }
+      if (!strcmp(name, "mmap_pages")) {
+        mmap_pages = atoi(val);
+      }
+      if (!strcmp(name, "global_shuffle")) {
+        global_shuffle = atoi(val);
+      }
+      if (!strcmp(name, "prefetch_depth")) {
+        prefetch_depth = atoi(val);
+      }
+      if (!strcmp(name, "prefetch_chunk")) {
+        prefetch_chunk = atoi(val);
+      }
+      if (!strcmp(name, "prefetch_direct")) {
+        prefetch_direct = atoi(val);
+      }
+      if (!strcmp(name, "decompress_nthread")) {
+        decompress_nthread = atoi(val);
       }
     }
     inline bool Init(void) {
-      list_order.resize(path_imgbin.size());
-      for (size_t i = 0; i < path_imgbin.size(); ++i) {
-        list_order[i] = i;
+      if (global_shuffle != 0) {
+        this->InitGlobal();
+        return true;
       }
-      if (shuffle != 0) {
-        rnd.Shuffle(list_order);
+      if (mmap_pages != 0) {
+        fmaps.resize(path_imgbin.size(), NULL);
+      } else if (prefetch_depth != 0) {
+        utils::Check(prefetch_chunk > 0, "prefetch_chunk must be positive");
+        for (size_t i = 0; i < path_imgbin.size(); ++i) {
+          CheckRawPages(path_imgbin[i].c_str());
+        }
+        reader.Open(path_imgbin, kPageBytes, prefetch_depth,
+                    static_cast<size_t>(prefetch_chunk) << 10, prefetch_direct != 0);
       }
+      list_order.resize(path_imgbin.size());
+      this->ShuffleOrder(&list_order, shuffle != 0);
       // load in data
       list_ptr = 0;
-      fi.Open(path_imgbin[list_order[0]].c_str(), "rb");
-      fplist = utils::FopenCheck(path_imglst[list_order[0]].c_str(), "r");
+      this->OpenBin(list_order[0]);
+      this->OpenList(list_order[0]);
+      if (mmap_pages == 0 && prefetch_depth != 0) {
+        reader.BeforeFirst(list_order);
+      }
       return true;
     }
     inline void BeforeFirst(void) {
+      epoch += 1;
+      if (global_shuffle != 0) {
+        rec_ptr = 0;
+        this->ShuffleOrder(&rec_order, true);
+        return;
+      }
+      if (seek_pending) {
+        this->ApplySeek(); return;
+      }
       list_ptr = 0;
       if (path_imgbin.size() == 1) {
-        fi.Seek(0);
-        fseek(fplist, 0, SEEK_SET);
-      } else {
-        if (shuffle != 0) {
-          rnd.Shuffle(list_order);
+        if (mmap_pages != 0 || prefetch_depth != 0) {
+          this->OpenBin(list_order[0]);
+        } else {
+          fi.Seek(0);
         }
-        fi.Close();
-        fi.Open(path_imgbin[list_order[0]].c_str(), "rb");
-        if (fplist != NULL) fclose(fplist);
-        fplist = utils::FopenCheck(path_imglst[list_order[0]].c_str(), "r");
+        if (fplist != NULL) {
+          fseek(fplist, 0, SEEK_SET);
+        } else {
+          flabel.BeforeFirst();
+        }
+      } else {
+        this->ShuffleOrder(&list_order, shuffle != 0);
+        this->OpenBin(list_order[0]);
+        this->OpenList(list_order[0]);
+      }
+      if (mmap_pages == 0 && prefetch_depth != 0) {
+        reader.BeforeFirst(list_order);
       }
     }
     inline PageEntry *Create(void) {
-      return new PageEntry();
+      if (mmap_pages != 0 || global_shuffle != 0) {
+        return new PageEntry(NULL, global_shuffle != 0);
+      } else if (prefetch_depth != 0) {
+        PageEntry *e = new PageEntry(NULL, false);
+        e->buffer = utils::ParallelPageReader::AllocBuffer(kPageBytes);
+        e->page.View(e->buffer);
+        return e;
+      } else {
+        return new PageEntry();
+      }
     }
     inline bool LoadNext(PageEntry *&a) {
+      if (global_shuffle != 0) return this->LoadRecords(a);
       while (true) {
-        if (a->page.Load(fi)) {
+        a->pos[0] = list_ptr;
+        a->pos[1] = mmap_pages != 0 || prefetch_depth != 0 ? page_ptr * kPageBytes : fi.Tell();
+        a->pos[2] = fplist != NULL ? static_cast<uint64_t>(ftell(fplist)) : flabel.Tell();
+        if (this->LoadPage(a)) {
           a->labels.resize(a->page.Size() * label_width);
           a->inst_index.resize(a->page.Size());
-          for (int i = 0; i < a->page.Size(); ++i) {
-            utils::Check(fscanf(fplist, "%u", &(a->inst_index[i])) == 1,
-                         "invalid list format");
-            for (int j = 0; j < label_width; ++j) {
-              utils::Check(fscanf(fplist, "%f", &(a->labels[i * label_width + j])) == 1,
-                           "ImageList format:label_width=%u but only have %d labels per line",
-                           label_width, j);
-
-            }
-            utils::Assert(fscanf(fplist, "%*[^\n]\n") == 0, "ignore");
-          }
+          this->ReadLabels(a->page.Size(),
+                           BeginPtr(a->inst_index), BeginPtr(a->labels));
           return true;
         } else {
           list_ptr += 1;
           if (list_ptr >= list_order.size()) return false;
-          fi.Close();
-          fi.Open(path_imgbin[list_order[list_ptr]].c_str(), "rb");
-          if (fplist != NULL) fclose(fplist);
-          fplist = utils::FopenCheck(path_imglst[list_order[list_ptr]].c_str(), "r");
+          this->OpenBin(list_order[list_ptr]);
+          this->OpenList(list_order[list_ptr]);
         }
       }
     }
     inline void FreeSpace(PageEntry *&a) {
       delete a;
     }
+    // whether the page position can be restored by SetSeek, pages must be read by stream or mmap
+    inline bool CanSeek(void) const {
+      return shuffle == 0 && global_shuffle == 0 && (mmap_pages != 0 || prefetch_depth == 0);
+    }
+    // move to position of a page given by PageEntry::pos, applied by next BeforeFirst
+    inline void SetSeek(const uint64_t pos[3]) {
+      for (int i = 0; i < 3; ++i) {
+        seek_pos[i] = pos[i];
+      }
+      seek_pending = true;
+    }
+    // number of records in all binary files, counted from the label files or lists
+    inline size_t NumRecord(void) const {
+      if (global_shuffle != 0) return rec_order.size();
+      size_t n = 0;
+      for (size_t i = 0; i < path_imgbin.size(); ++i) {
+        if (path_imglbl[i].length() != 0) {
+          utils::BinaryLabelFile flbl;
+          flbl.Open(path_imglbl[i].c_str(), label_width);
+          n += static_cast<size_t>(flbl.NumRecord());
+          continue;
+        }
+        // one record for each line that is not blank, same as ParseList
+        FILE *fp = utils::FopenCheck(path_imglst[i].c_str(), "r");
+        bool blank = true;
+        int c;
+        while ((c = getc(fp)) != EOF) {
+          if (c == '\n') {
+            if (!blank) n += 1;
+            blank = true;
+          } else if (!isspace(c)) {
+            blank = false;
+          }
+        }
+        if (!blank) n += 1;
+        fclose(fp);
+      }
+      return n;
+    }
     inline void Destroy() {
       fi.Close();
+      flabel.Close();
       if (fplist != NULL) fclose(fplist);
+      fplist = NULL;
+      for (size_t i = 0; i < fmaps.size(); ++i) {
+        delete fmaps[i];
+      }
+      fmaps.clear();
+      reader.Close();
+      inflate_pool.Destroy();
     }
 
    private:
+    // job to decompress blocks of a compressed page in parallel
+    struct InflateJob {
+      PageFactory *factory;
+      inline void operator()(int tid, int nthread) {
+        for (int i = tid; i < factory->cpage.NumBlock(); i += nthread) {
+          factory->inflate_page->Decompress(factory->cpage, i);
+        }
+      }
+    };
+    // reset order to the original one, and shuffle it by seed and round only
+    inline void ShuffleOrder(std::vector<size_t> *order, bool do_shuffle) {
+      for (size_t i = 0; i < order->size(); ++i) {
+        (*order)[i] = i;
+      }
+      if (!do_shuffle) return;
+      rnd.Seed(kRandMagic + seed, static_cast<uint32_t>(epoch), 0);
+      rnd.Shuffle(*order);
+    }
+    // check the mapped binary file contains raw pages, compressed pages can only be read by stream
+    inline static void CheckRawPages(const utils::MMapFile &fmap, const char *fname) {
+      utils::Check(fmap.Size() < sizeof(int) ||
+                   reinterpret_cast<const int*>(fmap.data())[0] != utils::CompressedPage::kMagic,
+                   "%s has compressed pages, which can not be used with "\
+                   "mmap_pages, global_shuffle or prefetch_depth", fname);
+    }
+    // same check by the first int of file, done before the file is opened by page reader
+    inline static void CheckRawPages(const char *fname) {
+      utils::StdFile fi(fname, "rb");
+      int magic;
+      utils::Check(fi.Read(&magic, sizeof(magic)) == 0 ||
+                   magic != utils::CompressedPage::kMagic,
+                   "%s has compressed pages, which can not be used with prefetch_depth", fname);
+    }
+    // parse n lines of list file into instance index and labels
+    inline void ParseList(FILE *fp, size_t n, unsigned *index, float *labels) {
+      for (size_t i = 0; i < n; ++i) {
+        utils::Check(fscanf(fp, "%u", &index[i]) == 1,
+                     "invalid list format");
+        for (int j = 0; j < label_width; ++j) {
+          utils::Check(fscanf(fp, "%f", &labels[i * label_width + j]) == 1,
+                       "ImageList format:label_width=%u but only have %d labels per line",
+                       label_width, j);
+        }
+        utils::Assert(fscanf(fp, "%*[^\n]\n") == 0, "ignore");
+      }
+    }
+    // open the list file or binary label file of fid-th binary file
+    inline void OpenList(size_t fid) {
+      if (fplist != NULL) {
+        fclose(fplist); fplist = NULL;
+      }
+      if (path_imglbl[fid].length() != 0) {
+        flabel.Open(path_imglbl[fid].c_str(), label_width);
+      } else {
+        fplist = utils::FopenCheck(path_imglst[fid].c_str(), "r");
+      }
+    }
+    // read instance index and labels of next n records
+    inline void ReadLabels(size_t n, unsigned *index, float *labels) {
+      if (fplist != NULL) {
+        this->ParseList(fplist, n, index, labels);
+      } else {
+        flabel.Read(n, index, labels);
+      }
+    }
+    // map all binary files, and load record index and labels of all of them
+    inline void InitGlobal(void) {
+      fmaps.resize(path_imgbin.size(), NULL);
+      indices.resize(path_imgbin.size());
+      rec_begin.resize(path_imgbin.size() + 1, 0);
+      for (size_t i = 0; i < path_imgbin.size(); ++i) {
+        fmaps[i] = new utils::MMapFile();
+        fmaps[i]->Open(path_imgbin[i].c_str());
+        CheckRawPages(*fmaps[i], path_imgbin[i].c_str());
+        utils::Check(fmaps[i]->Size() % kPageBytes == 0,
+                     "global_shuffle: size of %s is not multiple of page size",
+                     path_imgbin[i].c_str());
+        fmaps[i]->Advise(0, fmaps[i]->Size(), utils::MMapFile::kRandom);
+        std::string path_idx = path_imgbin[i] + ".idx";
+        indices[i].LoadOrBuild(path_idx.c_str(), path_imgbin[i].c_str(), *fmaps[i]);
+        size_t n = indices[i].entry.size();
+        rec_begin[i + 1] = rec_begin[i] + n;
+        rec_index.resize(rec_begin[i + 1]);
+        rec_labels.resize(rec_begin[i + 1] * label_width);
+        this->OpenList(i);
+        utils::Check(fplist != NULL || flabel.NumRecord() == n,
+                     "global_shuffle: %s has %lu records, but %s has %lu",
+                     path_imgbin[i].c_str(), static_cast<unsigned long>(n),
+                     path_imglbl[i].c_str(), static_cast<unsigned long>(flabel.NumRecord()));
+        this->ReadLabels(n, BeginPtr(rec_index) + rec_begin[i],
+                         BeginPtr(rec_labels) + rec_begin[i] * label_width);
+      }
+      rec_order.resize(rec_begin.back());
+      this->ShuffleOrder(&rec_order, true);
+      rec_ptr = 0;
+    }
+    // gather next group of records in global order
+    inline bool LoadRecords(PageEntry *a) {
+      if (rec_ptr >= rec_order.size()) return false;
+      size_t n = std::min(static_cast<size_t>(kRecordsPerEntry),
+                          rec_order.size() - rec_ptr);
+      a->records.clear();
+      a->labels.resize(n * label_width);
+      a->inst_index.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        size_t r = rec_order[rec_ptr + i];
+        size_t fid = std::upper_bound(rec_begin.begin(), rec_begin.end(), r)
+            - rec_begin.begin() - 1;
+        utils::BinaryPage::Obj obj = indices[fid].Get(*fmaps[fid], r - rec_begin[fid]);
+        // start reading the record before the decoder touches it
+        fmaps[fid]->Advise(static_cast<char*>(obj.dptr) - fmaps[fid]->data(),
+                           obj.sz, utils::MMapFile::kWillNeed);
+        a->records.push_back(obj);
+        a->inst_index[i] = rec_index[r];
+        for (int j = 0; j < label_width; ++j) {
+          a->labels[i * label_width + j] = rec_labels[r * label_width + j];
+        }
+      }
+      rec_ptr += n;
+      return true;
+    }
+    // open the files at position given by SetSeek
+    inline void ApplySeek(void) {
+      seek_pending = false;
+      utils::Check(seek_pos[0] < list_order.size(), "ThreadImagePageIterator: invalid position");
+      list_ptr = static_cast<size_t>(seek_pos[0]);
+      this->OpenBin(list_order[list_ptr]);
+      this->OpenList(list_order[list_ptr]);
+      if (mmap_pages != 0) {
+        page_ptr = static_cast<size_t>(seek_pos[1] / kPageBytes);
+        fmap->Advise(seek_pos[1], kPageBytes, utils::MMapFile::kWillNeed);
+      } else {
+        fi.Seek(static_cast<size_t>(seek_pos[1]));
+      }
+      if (fplist != NULL) {
+        fseek(fplist, static_cast<long>(seek_pos[2]), SEEK_SET);
+      } else {
+        flabel.Seek(seek_pos[2]);
+      }
+    }
+    // open the fid-th binary file to read from its first page
+    inline void OpenBin(size_t fid) {
+      page_ptr = 0;
+      cur_fid = fid;
+      if (mmap_pages == 0 && prefetch_depth != 0) return;
+      if (mmap_pages == 0) {
+        fi.Close();
+        fi.Open(path_imgbin[fid].c_str(), "rb");
+        return;
+      }
+      // a mapping is kept until Destroy, since pages handed out
+      // may still be in use after we move to next file
+      if (fmaps[fid] == NULL) {
+        fmaps[fid] = new utils::MMapFile();
+        fmaps[fid]->Open(path_imgbin[fid].c_str());
+        CheckRawPages(*fmaps[fid], path_imgbin[fid].c_str());
+        utils::Check(fmaps[fid]->Size() % kPageBytes == 0,
+                     "mmap_pages: size of %s is not multiple of page size",
+                     path_imgbin[fid].c_str());
+      }
+      fmap = fmaps[fid];
+      fmap->Advise(0, fmap->Size(), utils::MMapFile::kSequential);
+      fmap->Advise(0, kPageBytes, utils::MMapFile::kWillNeed);
+    }
+    // load next page of current binary file
+    inline bool LoadPage(PageEntry *a) {
+      if (mmap_pages == 0 && prefetch_depth != 0) {
+        if (page_ptr >= reader.NumPage(cur_fid)) return false;
+        // reader reads the pages ahead in the same order
+        size_t fid, page;
+        bool succ = reader.Next(&a->buffer, &fid, &page);
+        utils::Assert(succ && fid == cur_fid && page == page_ptr,
+                      "ParallelPageReader: page out of order");
+        a->page.View(a->buffer);
+        utils::Check(a->page.Size() != utils::CompressedPage::kMagic,
+                     "%s has compressed pages, which can not be used with prefetch_depth",
+                     path_imgbin[cur_fid].c_str());
+        page_ptr += 1;
+        return true;
+      }
+      if (mmap_pages == 0) {
+        if (!a->page.Load(fi, &cpage)) return false;
+        if (cpage.NumBlock() != 0) {
+          // decompress the blocks of compressed page in parallel
+          if (inflate_pool.nthread() == 0) {
+            utils::Check(decompress_nthread > 0, "decompress_nthread must be positive");
+            inflate_pool.Init(decompress_nthread, &inflate_job);
+          }
+          inflate_page = &a->page;
+          inflate_pool.Run();
+        }
+        return true;
+      }
+      size_t offset = page_ptr * kPageBytes;
+      if (offset >= fmap->Size()) return false;
+      a->page.View(fmap->data() + offset);
+      // read ahead one page
+      fmap->Advise(offset + kPageBytes, kPageBytes, utils::MMapFile::kWillNeed);
+      page_ptr += 1;
+      return true;
+    }
     // file stream for binary page
     utils::StdFile fi;
+    // whether view pages directly from memory mapped binary file
+    int mmap_pages;
+    // memory mapping of each binary file, created when first opened
+    std::vector<utils::MMapFile*> fmaps;
+    // mapping of current binary file
+    utils::MMapFile *fmap;
+    // index of next page in current mapped file, or file of parallel page reader
+    size_t page_ptr;
+    // index of current binary file
+    size_t cur_fid;
+    // number of pages read ahead by parallel page reader, 0 means read by file stream
+    int prefetch_depth;
+    // size of each read of parallel page reader, in KB
+    int prefetch_chunk;
+    // whether parallel page reader bypasses page cache
+    int prefetch_direct;
+    // parallel page reader over all binary files
+    utils::ParallelPageReader reader;
+    // number of threads to decompress compressed pages
+    int decompress_nthread;
+    // compressed page being loaded, and the page it is decompressed into
+    utils::CompressedPage cpage;
+    utils::BinaryPage *inflate_page;
+    // threads to decompress pages, started when first compressed page is met
+    InflateJob inflate_job;
+    utils::ThreadPool<InflateJob> inflate_pool;
+    // number of bytes in a page
+    static const size_t kPageBytes = utils::BinaryPage::kPageSize * sizeof(int);
+    // whether read records of all files in a globally shuffled order
+    int global_shuffle;
+    // record index of each file, used in global shuffle mode
+    std::vector<utils::BinaryPageIndex> indices;
+    // global id of first record in each file
+    std::vector<size_t> rec_begin;
+    // instance index and labels of all records
+    std::vector<unsigned> rec_index;
+    std::vector<float> rec_labels;
+    // global order of records in this round
+    std::vector<size_t> rec_order;
+    // position of next record in rec_order
+    size_t rec_ptr;
+    // number of records gathered in one entry in global shuffle mode
+    static const size_t kRecordsPerEntry = 1024;
+    // position given by SetSeek, and whether it is to be applied by next BeforeFirst
+    uint64_t seek_pos[3];
+    bool seek_pending;
     // seq of list index
     std::vector<size_t> list_order;
     /*! \brief label-width */
@@ -249,10 +696,15 @@ private:
     size_t list_ptr;
     // file ptr for list
     FILE *fplist;
+    // binary label file, used instead of fplist when available
+    utils::BinaryLabelFile flabel;
     // shuffle
     int shuffle;
-    // random sampler
-    utils::RandomSampler rnd;
+    // seed_data, and number of rounds started
+    unsigned seed;
+    size_t epoch;
+    // random sampler, restarted in each round
+    utils::PhiloxSampler rnd;
     // magic seed number for random sampler
     static const int kRandMagic = 121;
   };
@@ -262,23 +714,43 @@ private:
     unsigned inst_index;
     // label of each instance
     mshadow::TensorContainer<cpu, 1> label;
-    // image data
-    mshadow::TensorContainer<cpu, 3> img;
-    ImageEntry() : label(false), img(false) {}
+    // decoded image data, in (height, width, channel)
+    mshadow::TensorContainer<cpu, 3, unsigned char> img;
+    // image to be used, either img or an image in decoded cache
+    mshadow::Tensor<cpu, 3, unsigned char> raw;
+    // whether raw is from decoded cache
+    bool cached;
+    // position after this instance, the position of its page and the number of
+    // instances of the page up to it, valid when pages are not shuffled
+    uint64_t pos[4];
+    ImageEntry() : label(false), img(false), cached(false) {}
   };
   struct ImageFactory {
   public:
     // page iterator
-    utils::ThreadBuffer<PageEntry*, PageFactory> *itrpage;
+    utils::ThreadRingBuffer<PageEntry*, PageFactory> *itrpage;
     // constructor
     ImageFactory(void) {
       label_width = 1;
       data_ptr = 0;
       shuffle = 0;
+      decode_nthread = 1;
+      decoded_cache_limit = 0;
+      decode_scale_down = 0;
+      min_img_size = 0.0f;
+      max_random_scale = 1.0f;
+      shape = mshadow::Shape3(0, 0, 0);
+      silent = 0;
       end_of_data = false;
+      claim_end = false;
+      running = false;
+      stop_signal = false;
+      num_end = 0;
       page = NULL;
-      rnd.Seed(kRandMagic);
-      img.set_pad(false);
+      page_skip = first_skip = seek_skip = 0;
+      seed = 0;
+      epoch = 0;
+      num_page = 0;
     }
     inline void SetParam(const char *name, const char *val) {
       if (!strcmp(name, "label_width")) {
@@ -288,10 +760,69 @@ private:
         shuffle = atoi(val);
       }
       if (!strcmp(name, "seed_data")) {
-        rnd.Seed(atoi(val) + kRandMagic);
+        seed = static_cast<unsigned>(atoi(val));
+      }
+      if (!strcmp(name, "decode_nthread")) {
+        decode_nthread = atoi(val);
       }
+      if (!strcmp(name, "decoded_cache")) {
+        decoded_cache = val;
+      }
+      if (!strcmp(name, "decoded_cache_limit")) {
+        decoded_cache_limit = static_cast<size_t>(atof(val) * (1 << 20));
+      }
+      if (!strcmp(name, "decode_scale_down")) decode_scale_down = atoi(val);
+      if (!strcmp(name, "input_shape")) {
+        utils::Check(sscanf(val, "%u,%u,%u", &shape[0], &shape[1], &shape[2]) == 3,
+                     "input_shape must be three consecutive integers without space example: 1,1,200 ");
+      }
+      if (!strcmp(name, "min_img_size")) min_img_size = static_cast<float>(atof(val));
+      if (!strcmp(name, "max_random_scale")) max_random_scale = static_cast<float>(atof(val));
+      if (!strcmp(name, "silent")) silent = atoi(val);
     }
     inline bool Init(void) {
+      utils::Check(decode_nthread > 0, "decode_nthread must be positive");
+      unsigned min_size = 0;
+      if (decode_scale_down != 0) {
+        // keep enough pixels for cropping, and for the scaling in augmentation
+        float need = std::max(static_cast<float>(std::max(shape[1], shape[2])), min_img_size);
+        min_size = static_cast<unsigned>(ceil(need * std::max(1.0f, max_random_scale)));
+      }
+      // single channel network input is decoded in grayscale
+      const int nchannel = shape[0] == 1 ? 1 : 3;
+      for (int i = 0; i < decode_nthread; ++i) {
+        decoders.push_back(new Decoder());
+        decoders[i]->set_min_size(min_size);
+        decoders[i]->set_nchannel(nchannel);
+      }
+      if (decoded_cache.length() != 0) {
+        // images in cache depend on the dataset and how they are decoded
+        std::string signature;
+        const std::vector<std::string> &path_imgbin = itrpage->get_factory().path_imgbin;
+        for (size_t i = 0; i < path_imgbin.size(); ++i) {
+          signature += utils::DecodedImageCache::FileSignature(path_imgbin[i].c_str());
+        }
+        char buf[128];
+        snprintf(buf, sizeof(buf), "nchannel=%d,decode_scale_down=%d,min_size=%u",
+                 nchannel, decode_scale_down, min_size);
+        signature += buf;
+        cache.Open(decoded_cache.c_str(), decoded_cache_limit, signature);
+        if (silent == 0) {
+          printf("ImageFactory: decoded_cache=%s, %lu images, %lu MB cached\n",
+                 decoded_cache.c_str(), cache.NumImage(), cache.NumBytes() >> 20UL);
+        }
+      }
+      cache_lock.Init(1);
+      if (decode_nthread > 1) {
+        claim_lock.Init(1);
+        page_done.Init(0);
+        dring.Init(decode_nthread * kQueuePerThread);
+        for (int i = 0; i < dring.capacity(); ++i) {
+          dring[i] = new ImageEntry();
+        }
+        job.self = this;
+        pool.Init(decode_nthread, &job);
+      }
       return true;
     }
     inline ImageEntry *Create(void) {
@@ -302,95 +833,266 @@ private:
     }
     inline bool LoadNext(ImageEntry *&val) {
       if (end_of_data) return false;
-      while (true) {
-        if (page == NULL || data_ptr >= page->page.Size()) {
-          if (!itrpage->Next(page)) {
-            end_of_data = true; return false;
-          }
-          data_ptr = 0;
-          inst_order.resize(page->page.Size());
-          for (int i = 0; i < page->page.Size(); ++i) {
-            inst_order[i] = i;
-          }
-          if (shuffle != 0) {
-            rnd.Shuffle(inst_order);
-          }
-        } else {
-          const int idx = inst_order[data_ptr];
-          utils::BinaryPage::Obj obj = page->page[idx];
-          decoder.Decode(static_cast<unsigned char*>(obj.dptr),
-                         obj.sz, &img);
-          val->img.Resize(mshadow::Shape3(3, img.size(0), img.size(1)));
-          // assign image
-          if (img.size(2) == 3) {
-            mshadow::Tensor<cpu, 3> dst = val->img;
-            for (index_t i = 0; i < img.size(0); ++i) {
-              for (index_t j = 0; j < img.size(1); ++j) {
-                for (index_t k = 0; k < 3; ++k) {
-                  dst[k][i][j] = static_cast<real_t>(img[i][j][k]);
-                }
-              }
-            }
-          } else {
-            mshadow::Tensor<cpu, 3> dst = val->img;
-            for (index_t i = 0; i < img.size(0); ++i) {
-              for (index_t j = 0; j < img.size(1); ++j) {
-                real_t s = static_cast<real_t>(img[i][j][0]);
-                dst[0][i][j] = s;
-                dst[1][i][j] = s;
-                dst[2][i][j] = s;
-              }
-            }
-          }
-          val->label.Resize(mshadow::Shape1(label_width));
-          for (int j = 0; j < label_width; ++j) {
-            val->label[j] = page->labels[idx * label_width + j];
-          }
-          val->inst_index = page->inst_index[idx];
-          data_ptr += 1;
-          return true;
+      if (decode_nthread == 1) {
+        if (!this->CheckPage()) {
+          end_of_data = true; return false;
         }
+        this->DecodeInst(0, page, inst_order[data_ptr], val);
+        this->CacheInst(val);
+        data_ptr += 1;
+        return true;
+      }
+      if (!running) {
+        running = true;
+        pool.Start();
+      }
+      // workers decode the next instances ahead, the ring gives them back in order
+      int slot = dring.BeginPop();
+      if (dring.IsEnd(slot)) {
+        dring.EndPop(slot);
+        num_end += 1;
+        end_of_data = true;
+        return false;
+      }
+      this->CacheInst(dring[slot]);
+      // hand over the decoded entry, take the free entry back into ring
+      std::swap(val, dring[slot]);
+      dring.EndPop(slot);
+      return true;
+    }
+    inline void Destroy() {
+      if (decoders.size() == 0) return;
+      this->StopRound();
+      pool.Destroy();
+      for (size_t i = 0; i < decoders.size(); ++i) {
+        delete decoders[i];
+      }
+      for (int i = 0; i < dring.capacity(); ++i) {
+        delete dring[i];
+      }
+      if (decode_nthread > 1) {
+        dring.Destroy();
+        claim_lock.Destroy();
+        page_done.Destroy();
       }
+      cache_lock.Destroy();
+      decoders.clear();
+      cache.Close();
     }
-    inline void Destroy() {}
     inline void BeforeFirst() {
+      this->StopRound();
       itrpage->BeforeFirst();
+      // images cached in last round become readable, no image of cache is in use now
+      if (decoded_cache.length() != 0) cache.Sync();
       end_of_data = false;
+      claim_end = false;
       page = NULL;
       data_ptr = 0;
+      page_skip = 0;
+      first_skip = seek_skip;
+      seek_skip = 0;
+      epoch += 1;
+      num_page = 0;
+    }
+    // whether the order of instances in a page is kept
+    inline bool CanSeek(void) const {
+      return shuffle == 0;
+    }
+    // skip the first n instances of the first page after next BeforeFirst
+    inline void SetSkip(int n) {
+      seek_skip = n;
     }
    private:
-    // mark end of data
+    // jpeg decoder
+    #if CXXNET_USE_OPENCV_DECODER == 1
+    typedef utils::OpenCVDecoder Decoder;
+    #else
+    typedef utils::JpegDecoder Decoder;
+    #endif
+    // job of decode workers, each worker decodes instances until end of round
+    struct DecodeJob {
+      ImageFactory *self;
+      inline void operator()(int tid, int nthread) {
+        self->RunWorker(tid);
+      }
+    };
+    // take the next instance and decode it into the ring, push one end mark when done;
+    // instances are claimed in the order of tickets of the ring, so the output order is
+    // the same as decoding with one thread
+    inline void RunWorker(int tid) {
+      while (true) {
+        claim_lock.Wait();
+        int slot = dring.BeginPush();
+        PageEntry *pg = NULL;
+        int idx = 0;
+        if (!stop_signal) this->ClaimInst(&pg, &idx);
+        claim_lock.Post();
+        if (pg == NULL) {
+          dring.EndPush(slot, true); return;
+        }
+        this->DecodeInst(tid, pg, idx, dring[slot]);
+        page_done.Post();
+        dring.EndPush(slot);
+      }
+    }
+    // claim next instance, called with claim_lock held, return false if end of data
+    inline bool ClaimInst(PageEntry **pg, int *idx) {
+      if (claim_end) return false;
+      if (page != NULL && data_ptr >= page->Size()) {
+        // the page is given back by next call of itrpage->Next,
+        // wait until all its instances are decoded
+        for (int i = page_skip; i < page->Size(); ++i) {
+          page_done.Wait();
+        }
+        page = NULL;
+      }
+      if (!this->CheckPage()) {
+        claim_end = true; return false;
+      }
+      *pg = page;
+      *idx = inst_order[data_ptr];
+      data_ptr += 1;
+      return true;
+    }
+    // stop the workers of current round, drop the decoded instances
+    inline void StopRound(void) {
+      if (!running) return;
+      stop_signal = true;
+      while (num_end < pool.nthread()) {
+        int slot = dring.BeginPop();
+        if (dring.IsEnd(slot)) num_end += 1;
+        dring.EndPop(slot);
+      }
+      pool.Wait();
+      // counts of decoded instances of the last page are not waited by any claim
+      while (page_done.TryWait()) {}
+      stop_signal = false;
+      running = false;
+      num_end = 0;
+    }
+    // move to a page that still have instances, return false if end of data
+    inline bool CheckPage(void) {
+      while (page == NULL || data_ptr >= page->Size()) {
+        if (!itrpage->Next(page)) return false;
+        // instances returned before the position given by seek are in the first page
+        page_skip = std::min(first_skip, page->Size());
+        first_skip = 0;
+        data_ptr = page_skip;
+        inst_order.resize(page->Size());
+        for (int i = 0; i < page->Size(); ++i) {
+          inst_order[i] = i;
+        }
+        // the order in a page is decided by seed, round and the number of pages before it
+        if (shuffle != 0) {
+          rnd.Seed(kRandMagic + seed, static_cast<uint32_t>(epoch), num_page);
+          rnd.Shuffle(inst_order);
+        }
+        num_page += 1;
+      }
+      return true;
+    }
+    // decode idx-th instance of page pg into val, using resource of worker tid
+    inline void DecodeInst(int tid, PageEntry *pg, int idx, ImageEntry *val) {
+      val->inst_index = pg->inst_index[idx];
+      val->pos[0] = pg->pos[0]; val->pos[1] = pg->pos[1]; val->pos[2] = pg->pos[2];
+      val->pos[3] = static_cast<uint64_t>(idx) + 1;
+      val->cached = false;
+      if (decoded_cache.length() != 0) {
+        cache_lock.Wait();
+        val->cached = cache.Get(val->inst_index, &val->raw);
+        cache_lock.Post();
+      }
+      if (!val->cached) {
+        utils::BinaryPage::Obj obj = (*pg)[idx];
+        // keep the decoded bytes, conversion into float is fused with augmentation
+        decoders[tid]->Decode(static_cast<unsigned char*>(obj.dptr),
+                              obj.sz, &val->img);
+        val->raw = val->img;
+      }
+      val->label.Resize(mshadow::Shape1(label_width));
+      for (int j = 0; j < label_width; ++j) {
+        val->label[j] = pg->labels[idx * label_width + j];
+      }
+    }
+    // add newly decoded image into decoded cache
+    inline void CacheInst(ImageEntry *val) {
+      if (decoded_cache.length() != 0 && !val->cached) {
+        cache_lock.Wait();
+        cache.Put(val->inst_index, val->img);
+        cache_lock.Post();
+      }
+    }
+    // mark end of data, seen by the consumer
     bool end_of_data;
+    // whether workers reach end of data
+    bool claim_end;
     // current page
     PageEntry *page;
     // seq of inst index
     std::vector<int> inst_order;
-    // jpeg decoder
-    #if CXXNET_USE_OPENCV_DECODER == 1
-    utils::OpenCVDecoder decoder;
-    #else
-    utils::JpegDecoder decoder;
-    #endif
+    // number of instances of current page skipped, which are not decoded
+    int page_skip;
+    // number of instances to be skipped in the first page of this round, and of next round
+    int first_skip, seek_skip;
+    // decoder of each worker
+    std::vector<Decoder*> decoders;
     // id for data
     int data_ptr;
     // shuffle
     int shuffle;
     // label_width
     int label_width;
-    // image
-    mshadow::TensorContainer<cpu, 3, unsigned char> img;
-    // random number generator
-    utils::RandomSampler rnd;
+    // number of threads used to decode
+    int decode_nthread;
+    // whether decode images at reduced resolution when they are bigger than needed
+    int decode_scale_down;
+    // input shape of network
+    mshadow::Shape<3> shape;
+    // parameters of augmentation that affect the decoded size needed
+    float min_img_size, max_random_scale;
+    // directory of decoded image cache, empty if not used
+    std::string decoded_cache;
+    // size limit of decoded cache in bytes
+    size_t decoded_cache_limit;
+    // decoded image cache
+    utils::DecodedImageCache cache;
+    // silent
+    int silent;
+    // ring that puts the instances decoded by workers back in order, used when decode_nthread > 1
+    utils::ThreadRing<ImageEntry*> dring;
+    // lock of page, data_ptr and inst_order, taken by workers to claim instances
+    utils::Semaphore claim_lock;
+    // posted once for each decoded instance of current page
+    utils::Semaphore page_done;
+    // lock of decoded cache
+    utils::Semaphore cache_lock;
+    // whether workers are running a round
+    bool running;
+    // signal workers to stop current round
+    volatile bool stop_signal;
+    // number of end marks popped in current round
+    int num_end;
+    // decode job
+    DecodeJob job;
+    // worker threads
+    utils::ThreadPool<DecodeJob> pool;
+    // seed_data, number of rounds started, and number of pages loaded in current round
+    unsigned seed;
+    size_t epoch;
+    uint32_t num_page;
+    // random number generator, restarted for each page
+    utils::PhiloxSampler rnd;
     // magic number
     static const int kRandMagic = 111;
+    // number of decoded images in ring for each decode thread
+    static const int kQueuePerThread = 8;
   };
 
 protected:
   /*! \brief output data */
   ImageEntry *outimg_;
-  utils::ThreadBuffer<PageEntry*, PageFactory> itrpage;
-  utils::ThreadBuffer<ImageEntry*, ImageFactory> itrimg;
+  utils::ThreadRingBuffer<PageEntry*, PageFactory> itrpage;
+  utils::ThreadRingBuffer<ImageEntry*, ImageFactory> itrimg;
 }; // class ThreadImagePageIterator
 }; // namespace cxxnet
 #endif
@@ -12,6 +12,7 @@
 #include "../global.h"
 #include "../utils/utils.h"
 #include "../utils/io.h"
+#include "../io/data.h"
 #if CXXNET_USE_CUDNN == 1
  #ifdef __CUDACC__
   #include <cudnn.h>
@@ -39,8 +40,18 @@ struct Node {
   /*! \brief whether the underlying data must be contiguous */
   bool must_contiguous;
   bool inited;
+  /*!
+   * \brief whether the node takes sparse input, if so, data is not allocated and only
+   *   the shape of data is used, the content is given by sparse_row_ptr and sparse_data
+   */
+  bool is_sparse;
+  /*! \brief row pointer of sparse content in CSR format on host, row i is [row_ptr[i], row_ptr[i + 1]) */
+  const size_t *sparse_row_ptr;
+  /*! \brief entries of sparse content on host */
+  const SparseInst::Entry *sparse_data;
   // constructor
-  Node(void) : must_contiguous(false) {
+  Node(void) : must_contiguous(false), is_sparse(false),
+               sparse_row_ptr(NULL), sparse_data(NULL) {
     data.shape_ = mshadow::Shape4(0,0,0,0);
     inited = false;
   }
@@ -60,6 +71,7 @@ struct Node {
   }
   /*! \brief helper rountine to allocate space */
   inline void AllocSpace(void) {
+    if (is_sparse) return;
     if (must_contiguous) {
       mshadow::AllocSpace(&data, false);
       utils::Assert(data.CheckContiguous(), "contiguous");
@@ -311,6 +323,7 @@ const int kChConcat = 28;
 const int kPRelu = 29;
 const int kBatchNorm = 30;
 const int kFixConnect = 31;
+const int kSparseFullConnect = 32;
 /*! \brief gap used to encode pairtest layer */
 const int kPairTestGap = 1024;
 /*! \brief use integer to encode layer types */
@@ -323,6 +336,7 @@ inline LayerType GetLayerType(const char *type) {
   if (!strncmp(type, "share", 5)) return kSharedLayer;
   if (!strcmp(type, "fullc")) return kFullConnect;
   if (!strcmp(type, "fixconn")) return kFixConnect;
+  if (!strcmp(type, "sparse_fullc")) return kSparseFullConnect;
   if (!strcmp(type, "bias")) return kBias;
   if (!strcmp(type, "softmax")) return kSoftmax;
   if (!strcmp(type, "relu")) return kRectifiedLinear;
@@ -12,6 +12,7 @@
 #include "./dropout_layer-inl.hpp"
 #include "./fullc_layer-inl.hpp"
 #include "./fixconn_layer-inl.hpp"
+#include "./sparse_fullc_layer-inl.hpp"
 #include "./lrn_layer-inl.hpp"
 #include "./flatten_layer-inl.hpp"
 #include "./pooling_layer-inl.hpp"
@@ -50,6 +51,7 @@ ILayer<xpu>* CreateLayer_(LayerType type,
     case kDropout: return new DropoutLayer<xpu>(p_rnd);
     case kFullConnect: return new FullConnectLayer<xpu>(p_rnd);
     case kFixConnect: return new FixConnectLayer<xpu>();
+    case kSparseFullConnect: return new SparseFullConnectLayer<xpu>(p_rnd);
     case kLRN: return new LRNLayer<xpu>();
     case kFlatten: return new FlattenLayer<xpu>();
     case kReluMaxPooling: return
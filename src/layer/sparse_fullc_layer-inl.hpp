@@ -0,0 +1,155 @@
+#ifndef CXXNET_LAYER_SPARSE_FULLC_LAYER_INL_HPP_
+#define CXXNET_LAYER_SPARSE_FULLC_LAYER_INL_HPP_
+/*!
+ * \file sparse_fullc_layer-inl.hpp
+ * \brief fully connected layer that takes sparse input in CSR format,
+ *   must be directly connected to the input node
+ */
+#include <mshadow/tensor.h>
+#include "./layer.h"
+#include "./param.h"
+#include "../utils/utils.h"
+
+namespace cxxnet {
+namespace layer {
+/*!
+ * \brief fully connected layer over sparse input, out = X * W + bias,
+ *   the weight is stored in (num_input_node, num_hidden), transposed compared with fullc,
+ *   so that the weight of each feature is contiguous, forward only reads the rows of
+ *   features present in the batch, and backprop only accumulates gradient into these rows;
+ *   the updater collects the same rows from the batch and only updates them (lazy_update);
+ *   only cpu is supported
+ */
+template<typename xpu>
+class SparseFullConnectLayer : public ILayer<xpu> {
+ public:
+  SparseFullConnectLayer(mshadow::Random<xpu> *p_rnd) : prnd_(p_rnd) {}
+  virtual ~SparseFullConnectLayer(void) {}
+  virtual void SetParam(const char *name, const char* val) {
+    param_.SetParam(name, val);
+  }
+  virtual void ApplyVisitor(typename ILayer<xpu>::IVisitor *pvisitor) {
+    pvisitor->Visit("wmat", wmat_, gwmat_);
+    if (param_.no_bias == 0) {
+      pvisitor->Visit("bias", bias_, gbias_);
+    }
+  }
+  virtual void InitModel(void) {
+    wmat_.Resize(mshadow::Shape2(param_.num_input_node, param_.num_hidden));
+    bias_.Resize(mshadow::Shape1(param_.num_hidden));
+    param_.RandInitWeight(this->prnd_, wmat_, wmat_.size(0), wmat_.size(1));
+    bias_ = param_.init_bias;
+    gwmat_.Resize(wmat_.shape_);
+    gbias_.Resize(bias_.shape_);
+    gwmat_ = 0.0f; gbias_ = 0.0f;
+  }
+  virtual void SaveModel(utils::IStream &fo) const {
+    fo.Write(&param_, sizeof(LayerParam));
+    wmat_.SaveBinary(fo);
+    bias_.SaveBinary(fo);
+  }
+  virtual void LoadModel(utils::IStream &fi) {
+    utils::Check(fi.Read(&param_, sizeof(LayerParam)) != 0,
+                  "SparseFullConnectLayer:LoadModel invalid model file");
+    wmat_.LoadBinary(fi);
+    bias_.LoadBinary(fi);
+    gwmat_.Resize(wmat_.shape_);
+    gbias_.Resize(bias_.shape_);
+    gwmat_ = 0.0f; gbias_ = 0.0f;
+  }
+  virtual void SetStream(mshadow::Stream<xpu> *stream) {
+    wmat_.set_stream(stream);
+    bias_.set_stream(stream);
+    gwmat_.set_stream(stream);
+    gbias_.set_stream(stream);
+  }
+  virtual void InitConnection(const std::vector<Node<xpu>*> &nodes_in,
+                              const std::vector<Node<xpu>*> &nodes_out,
+                              ConnectState<xpu> *p_cstate) {
+    utils::Check(xpu::kDevCPU, "SparseFullcLayer: only cpu is supported");
+    utils::Check(nodes_in.size() == 1 && nodes_out.size() == 1,
+                 "SparseFullcLayer: Layer only support 1-1 connection");
+    utils::Check(nodes_in[0]->is_mat(), "SparseFullcLayer: input need to be a matrix");
+    utils::Check(param_.num_hidden > 0, "SparseFullcLayer: must set nhidden correctly");
+    // input is given by the sparse batch, no space is needed
+    nodes_in[0]->is_sparse = true;
+    nodes_out[0]->data.shape_ =
+        mshadow::Shape4(nodes_in[0]->data.size(0), 1, 1, param_.num_hidden);
+    if (param_.num_input_node == 0) {
+      param_.num_input_node = static_cast<int>(nodes_in[0]->data.size(3));
+    } else {
+      utils::Check(param_.num_input_node == static_cast<int>(nodes_in[0]->data.size(3)),
+                   "SparseFullcLayer: input hidden nodes is not consistent");
+    }
+  }
+  virtual void Forward(bool is_train,
+                       const std::vector<Node<xpu>*> &nodes_in,
+                       const std::vector<Node<xpu>*> &nodes_out,
+                       ConnectState<xpu> *p_cstate) {
+    using namespace mshadow::expr;
+    const Node<xpu> &in = *nodes_in[0];
+    utils::Check(in.sparse_row_ptr != NULL, "SparseFullcLayer: input must be sparse batch");
+    mshadow::Tensor<xpu, 2> m_out = nodes_out[0]->mat();
+    const index_t nhidden = m_out.size(1);
+    if (param_.no_bias == 0) {
+      m_out = repmat(bias_, m_out.size(0));
+    } else {
+      m_out = 0.0f;
+    }
+    for (index_t i = 0; i < m_out.size(0); ++i) {
+      real_t *out = m_out[i].dptr_;
+      for (size_t k = in.sparse_row_ptr[i]; k < in.sparse_row_ptr[i + 1]; ++k) {
+        const SparseInst::Entry &e = in.sparse_data[k];
+        utils::Check(e.findex < wmat_.size(0),
+                     "SparseFullcLayer: feature index exceed num_input_node");
+        const real_t *w = wmat_[e.findex].dptr_;
+        const real_t v = e.fvalue;
+        for (index_t j = 0; j < nhidden; ++j) {
+          out[j] += v * w[j];
+        }
+      }
+    }
+  }
+  virtual void Backprop(bool prop_grad,
+                        const std::vector<Node<xpu>*> &nodes_in,
+                        const std::vector<Node<xpu>*> &nodes_out,
+                        ConnectState<xpu> *p_cstate) {
+    using namespace mshadow::expr;
+    utils::Check(!prop_grad, "SparseFullcLayer: can not propagate gradient to sparse input");
+    const Node<xpu> &in = *nodes_in[0];
+    mshadow::Tensor<xpu, 2> m_out = nodes_out[0]->mat();
+    const index_t nhidden = m_out.size(1);
+    if (param_.no_bias == 0) {
+      gbias_ += sum_rows(m_out);
+    }
+    // only the rows of features in the batch are touched
+    for (index_t i = 0; i < m_out.size(0); ++i) {
+      const real_t *grad = m_out[i].dptr_;
+      for (size_t k = in.sparse_row_ptr[i]; k < in.sparse_row_ptr[i + 1]; ++k) {
+        const SparseInst::Entry &e = in.sparse_data[k];
+        real_t *gw = gwmat_[e.findex].dptr_;
+        const real_t v = e.fvalue;
+        for (index_t j = 0; j < nhidden; ++j) {
+          gw[j] += v * grad[j];
+        }
+      }
+    }
+  }
+
+ protected:
+  /*! \brief random number generator */
+  mshadow::Random<xpu> *prnd_;
+  /*! \brief parameters that potentially be useful */
+  LayerParam param_;
+  /*! \brief weight matrix, in (num_input_node, num_hidden) */
+  mshadow::TensorContainer<xpu,2> wmat_;
+  /*! \brief bias */
+  mshadow::TensorContainer<xpu,1> bias_;
+  /*! \brief accumulates the gradient of weight matrix */
+  mshadow::TensorContainer<xpu,2> gwmat_;
+  /*! \brief accumulates the gradient of bias */
+  mshadow::TensorContainer<xpu,1> gbias_;
+};
+}  // namespace layer
+}  // namespace cxxnet
+#endif  // CXXNET_LAYER_SPARSE_FULLC_LAYER_INL_HPP_
@@ -11,6 +11,7 @@
 #include "../layer/layer.h"
 #include "../layer/visitor.h"
 #include "../updater/updater.h"
+#include "../io/data.h"
 #include "../utils/utils.h"
 #include "../utils/io.h"
 #include "../utils/thread.h"
@@ -37,15 +38,23 @@ struct NeuralNet {
   mshadow::Random<xpu> rnd;
   /*! \brief stream for this  */
   mshadow::Stream<xpu> *stream;
+  /*! \brief device copy of uint8 input */
+  mshadow::TensorContainer<xpu, 4, unsigned char> input_uint8;
+  /*! \brief device copy of the mean of uint8 input */
+  mshadow::TensorContainer<xpu, 3> input_mean;
+  /*! \brief host mean that input_mean is copied from */
+  const real_t *input_mean_src;
   // constructor do nothing
   NeuralNet(const NetConfig &cfg,
             mshadow::index_t batch_size,
             int seed,
             mshadow::Stream<xpu> *stream)
-      : cfg(cfg), rnd(seed), stream(stream) {
+      : cfg(cfg), rnd(seed), stream(stream), input_mean_src(NULL) {
     // set maximum batch
     this->max_batch = batch_size;
     rnd.set_stream(stream);
+    input_uint8.set_stream(stream);
+    input_mean.set_stream(stream);
     label_info.name2findex = &cfg.label_name_map;
   }
   ~NeuralNet(void) {
@@ -102,18 +111,32 @@ struct NeuralNet {
   /*!
    * \brief forward prop
    * \param is_train whether is training phase
-   * \param batch the input batch
+   * \param batch the input batch, can be dense, uint8 or sparse
    */
   inline void Forward(bool is_train,
-                      mshadow::Tensor<cpu,4> batch,
-                      std::vector<mshadow::Tensor<cpu,4> > extra_data,
+                      const DataBatch &batch,
                       bool need_sync) {
     // check if we need to adjust batch size according to the input
-    this->AdjustBatchSize(batch.size(0));
-    // copy data into node
-    mshadow::Copy(nodes[0].data, batch, stream);
-    for (size_t i = 0; i < extra_data.size(); ++i) {
-      mshadow::Copy(nodes[i + 1].data, extra_data[i], stream);
+    this->AdjustBatchSize(batch.batch_size);
+    utils::Check(batch.is_sparse() == nodes[0].is_sparse,
+                 "NeuralNet: sparse input batch must be taken by sparse_fullc layer");
+    if (batch.is_sparse()) {
+      // sparse batch is bound to input node without copy
+      nodes[0].sparse_row_ptr = batch.sparse_row_ptr;
+      nodes[0].sparse_data = batch.sparse_data;
+    } else {
+      utils::Check(batch.data.size(1) == nodes[0].data.size(1),
+                   "NeuralNet: input data has %u channels, but input node has %u channels",
+                   batch.data.size(1), nodes[0].data.size(1));
+      if (batch.data_type == DataBatch::kUInt8) {
+        this->CopyInputUInt8(batch.data_uint8, batch.norm);
+      } else {
+        // copy data into node
+        mshadow::Copy(nodes[0].data, batch.data, stream);
+      }
+    }
+    for (size_t i = 0; i < batch.extra_data.size(); ++i) {
+      mshadow::Copy(nodes[i + 1].data, batch.extra_data[i], stream);
     }
     // setup updater notification
     for (size_t i = connections.size(); i != 0; --i) {
@@ -275,6 +298,28 @@ struct NeuralNet {
       }
     }
   }
+  // copy uint8 input to device, convert and normalize it into the input node
+  inline void CopyInputUInt8(mshadow::Tensor<cpu,4,unsigned char> batch,
+                             const DataNorm &norm) {
+    using namespace mshadow::expr;
+    mshadow::Tensor<xpu, 4> in = nodes[0].data;
+    utils::Check(batch.size(1) == in.size(1) && batch.size(2) == in.size(2) &&
+                 batch.size(3) == in.size(3),
+                 "NeuralNet: shape of uint8 input mismatch with input node");
+    utils::Check(norm.mean.dptr_ != NULL && norm.mean.shape_ == batch[0].shape_,
+                 "NeuralNet: uint8 input requires mean of input shape");
+    input_uint8.Resize(batch.shape_);
+    mshadow::Copy(input_uint8, batch, stream);
+    // mean stays the same during training, only copy it when changed
+    if (input_mean_src != norm.mean.dptr_) {
+      input_mean.Resize(norm.mean.shape_);
+      mshadow::Copy(input_mean, norm.mean, stream);
+      input_mean_src = norm.mean.dptr_;
+    }
+    for (index_t i = 0; i < batch.size(0); ++i) {
+      in[i] = (tcast<real_t>(input_uint8[i]) - input_mean) * norm.scale;
+    }
+  }
   /*! \brief free all space allocated in this struct*/
   inline void FreeSpace(void) {
     // wait all actions to complete before free
@@ -376,8 +421,7 @@ class NeuralNetThread {
     this->ExecTask();
   }
   /*! \brief run a training forward backprop pass */
-  inline void TrainForwardBackprop(mshadow::Tensor<cpu,4> batch,
-                                   const std::vector<mshadow::Tensor<mshadow::cpu, 4> >& extra_data,
+  inline void TrainForwardBackprop(const DataBatch &batch,
                                    const layer::LabelInfo &label_info,
                                    const std::vector<std::pair<int, mshadow::Tensor<cpu, 4> > >& req,
                                    bool prop_to_input,
@@ -392,15 +436,12 @@ class NeuralNetThread {
     iparam_need_sync = need_sync;
     iparam_need_update = need_update;
     iparam_epoch = update_epoch;
-    iparam_extra_data = extra_data;
     this->task = kTrainProp;
     this->ExecTask();
   }
   /*! \brief run a predicting forward pass, copy final layer  */
-  inline void PredictForward(mshadow::Tensor<cpu, 4> batch,
-                             const std::vector<mshadow::Tensor<mshadow::cpu, 4> > &extra_data) {
+  inline void PredictForward(const DataBatch &batch) {
     iparam_batch = batch;
-    iparam_extra_data = extra_data;
     this->task = kPredForward;
     this->ExecTask();
   }
@@ -512,8 +553,8 @@ class NeuralNetThread {
       case kUpdate: net_->Update(iparam_epoch); return;
       case kStartRound: net_->StartRound(static_cast<int>(iparam_epoch)); return;
       case kTrainProp: {
-        if (iparam_batch.size(0) == 0) return;
-        net_->Forward(true, iparam_batch, iparam_extra_data, iparam_need_sync);
+        if (iparam_batch.batch_size == 0) return;
+        net_->Forward(true, iparam_batch, iparam_need_sync);
         for (index_t i = 0; i < oparam_req.size(); ++i) {
           index_t id = oparam_req[i].first + (oparam_req[i].first < 0 ? net_->nodes.size() : 0);
           utils::Assert(id < net_->nodes.size(), "nid out of range");
@@ -524,7 +565,7 @@ class NeuralNetThread {
         return;
       }
       case kPredForward: {
-        net_->Forward(false, iparam_batch, iparam_extra_data, true);
+        net_->Forward(false, iparam_batch, true);
         return;
       }
       case kCopyNode: {
@@ -598,9 +639,7 @@ class NeuralNetThread {
   // input tag
   std::string iparam_tag;
   // input batch
-  mshadow::Tensor<cpu, 4> iparam_batch;
-  // input extra data
-  std::vector<mshadow::Tensor<cpu,4> > iparam_extra_data;
+  DataBatch iparam_batch;
   // current task
   TaskType task;
   // intenal net implementation
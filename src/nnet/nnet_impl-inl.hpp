@@ -153,17 +153,12 @@ class CXXNetThreadTrainer : public INetTrainer {
     for (mshadow::index_t i = nets_.size(); i != 0; --i) {
       mshadow::index_t begin = std::min((i - 1) * step, data.batch_size);
       mshadow::index_t end = std::min(i * step, data.batch_size);
-      std::vector<mshadow::Tensor<mshadow::cpu, 4> > extra_data;
-      for (mshadow::index_t j = 0; j < data.extra_data.size(); ++j){
-        extra_data.push_back(data.extra_data[j].Slice(begin, end));
-      }
       std::vector<std::pair<int, mshadow::Tensor<cpu, 4> > > batch_eval_req;
       for (index_t j = 0; j < eval_req.size(); ++j) {
         batch_eval_req.push_back(
           std::make_pair(eval_req[j].first, eval_req[j].second.Slice(begin, end)));
       }
-      nets_[i - 1]->TrainForwardBackprop(data.data.Slice(begin, end),
-                                         extra_data,
+      nets_[i - 1]->TrainForwardBackprop(data.Slice(begin, end),
                                          info.Slice(begin, end),
                                          batch_eval_req,
                                          false, need_sync,
@@ -305,12 +300,7 @@ class CXXNetThreadTrainer : public INetTrainer {
     for (mshadow::index_t i = nets_.size(); i != 0; --i) {
       mshadow::index_t begin = std::min((i - 1) * step, data.batch_size);
       mshadow::index_t end = std::min(i * step, data.batch_size);
-      mshadow::Tensor<cpu, 4> mbatch = data.data.Slice(begin, end);
-      std::vector<mshadow::Tensor<mshadow::cpu, 4> > extra_data;
-      for (mshadow::index_t j = 0; j < data.extra_data.size(); ++j){
-        extra_data.push_back(data.extra_data[j].Slice(begin, end));
-      }
-      nets_[i - 1]->PredictForward(mbatch, extra_data);
+      nets_[i - 1]->PredictForward(data.Slice(begin, end));
     }
     this->WaitAllJobs();
     // copy results out
@@ -48,6 +48,16 @@ class AdamUpdater : public IUpdater<xpu> {
     this->ApplyUpdate(epoch, mshadow::Tensor<xpu, dim>
                       (grad.dptr_, w.shape_, grad.stride_, w.stream_));
   }
+  virtual void UpdateRows(long epoch, const std::vector<index_t> &rows) {
+    mshadow::Tensor<xpu, 2> w2 = w.FlatTo2D(), dw2 = dw.FlatTo2D();
+    mshadow::Tensor<xpu, 2> m2_1 = m_w1.FlatTo2D(), m2_2 = m_w2.FlatTo2D();
+    const float lr_t = this->StepSize(epoch);
+    for (size_t i = 0; i < rows.size(); ++i) {
+      mshadow::Tensor<xpu, 1> grad = dw2[rows[i]];
+      this->ApplyStep(w2[rows[i]], m2_1[rows[i]], m2_2[rows[i]], grad, lr_t);
+      grad = 0.0f;
+    }
+  }
   virtual void StartRound(int round) {
     param.round = round;
   }
@@ -72,13 +82,25 @@ class AdamUpdater : public IUpdater<xpu> {
   // update function
   virtual void ApplyUpdate(long epoch,
                            mshadow::Tensor<xpu, dim> grad) {
-    if (param.wd > 0.0f) grad -= param.wd * w;
+    this->ApplyStep(w, m_w1, m_w2, grad, this->StepSize(epoch));
+  }
+  // step size of epoch with bias correction
+  inline float StepSize(long epoch) const {
     float fix1 = 1.0f - powf(1.0f - decay1, epoch + 1);
     float fix2 = 1.0f - powf(1.0f - decay2, epoch + 1);
-    float lr_t = param.base_lr_ * sqrt(fix2) / fix1;
-    m_w1 += decay1 * (grad - m_w1);
-    m_w2 += decay2 * (mshadow::expr::F<op::square>(grad) - m_w2);
-    w -= lr_t * (m_w1 / (mshadow::expr::F<op::square_root>(m_w2) + 1e-8f));
+    return param.base_lr_ * sqrt(fix2) / fix1;
+  }
+  // one step on weight with moments m1, m2, shared by whole and row update
+  template<int d>
+  inline void ApplyStep(mshadow::Tensor<xpu, d> weight,
+                        mshadow::Tensor<xpu, d> m1,
+                        mshadow::Tensor<xpu, d> m2,
+                        mshadow::Tensor<xpu, d> grad,
+                        float lr_t) {
+    if (param.wd > 0.0f) grad -= param.wd * weight;
+    m1 += decay1 * (grad - m1);
+    m2 += decay2 * (mshadow::expr::F<op::square>(grad) - m2);
+    weight -= lr_t * (m1 / (mshadow::expr::F<op::square_root>(m2) + 1e-8f));
   }
 };  // class AdamUpdater
 }  // namespace updater
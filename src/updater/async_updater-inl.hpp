@@ -32,6 +32,8 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
     test_on_server = 0;
     bigarray_bound = 1000 * 1000;
     pull_not_issued = false;
+    // only the rows of features in the batch get gradient in sparse_fullc
+    lazy_update = (this->tag == "wmat" && layer_type == layer::kSparseFullConnect) ? 1 : 0;
   }
   virtual ~AsyncUpdater(void) {
     delete updater;
@@ -40,6 +42,9 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
     if (update_on_server == 0) {
       updater->Init();
     }
+    // gradient summed by parameter server is dense, rows are only tracked on single device
+    if (pserver != NULL) lazy_update = 0;
+    if (lazy_update != 0) row_mark.resize(w.size(0), false);
     if (pserver != NULL) {
       if (fullc_gather != 0) {
         char name[32];
@@ -66,6 +71,19 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
   }
   virtual void BeforeBackprop(const std::vector<layer::Node<xpu>*> &nodes_in,
                               const std::vector<layer::Node<xpu>*> &nodes_out) {
+    if (lazy_update != 0) {
+      utils::Check(nodes_in.size() == 1 && nodes_in[0]->sparse_row_ptr != NULL,
+                   "lazy_update can only work with sparse_fullc");
+      const layer::Node<xpu> &in = *nodes_in[0];
+      for (index_t i = 0; i < in.data.size(0); ++i) {
+        for (size_t k = in.sparse_row_ptr[i]; k < in.sparse_row_ptr[i + 1]; ++k) {
+          const index_t r = in.sparse_data[k].findex;
+          if (!row_mark[r]) {
+            row_mark[r] = true; touched_rows.push_back(r);
+          }
+        }
+      }
+    }
     if (fullc_gather != 0) {
       utils::Check(update_on_server == 0, "GatherUpdate can not use update_on_server");
       utils::Check(nodes_in.size() == 1, "fullc_gather can only work with fullc");
@@ -94,6 +112,14 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
   virtual void AfterBackprop(bool do_update, long epoch) {
     if (fullc_gather == 0) {
       if (do_update && pserver == NULL) {
+        if (lazy_update != 0) {
+          updater->UpdateRows(epoch, touched_rows);
+          for (size_t i = 0; i < touched_rows.size(); ++i) {
+            row_mark[touched_rows[i]] = false;
+          }
+          touched_rows.clear();
+          return;
+        }
         updater->Update(epoch); return;
       }
       if (do_update) {
@@ -159,6 +185,11 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
         fullc_gather = atoi(val);
       }
     }
+    if (!strcmp(name, "lazy_update")) {
+      if (tag == "wmat" && layer_type == layer::kSparseFullConnect) {
+        lazy_update = atoi(val);
+      }
+    }
     if (!strcmp(name, "batch_size")) {
       total_batch_size = static_cast<index_t>(atoi(val));
     }
@@ -249,6 +280,13 @@ class AsyncUpdater: public IAsyncUpdater<xpu> {
   index_t local_batch_size, total_batch_size;
   // temporal result 
   mshadow::TensorContainer<xpu, 2> tnode; 
+  // the following data structure are used to support lazy_update
+  // only update the rows touched since last update, used by sparse_fullc
+  int lazy_update;
+  // rows of weight touched since last update
+  std::vector<index_t> touched_rows;
+  // whether each row is in touched_rows
+  std::vector<bool> row_mark;
 };
 }  // updater
 }  // cxxnet
@@ -45,6 +45,16 @@ class NAGUpdater : public IUpdater<xpu> {
     this->ApplyUpdate(epoch, mshadow::Tensor<xpu, dim>
                       (grad.dptr_, w.shape_, grad.stride_, w.stream_));
   }
+  virtual void UpdateRows(long epoch, const std::vector<index_t> &rows) {
+    param.ScheduleEpoch(epoch);
+    mshadow::Tensor<xpu, 2> w2 = w.FlatTo2D(), dw2 = dw.FlatTo2D();
+    mshadow::Tensor<xpu, 2> m2 = m_w.FlatTo2D(), old_m2 = old_m_w.FlatTo2D();
+    for (size_t i = 0; i < rows.size(); ++i) {
+      mshadow::Tensor<xpu, 1> grad = dw2[rows[i]];
+      this->ApplyStep(w2[rows[i]], m2[rows[i]], old_m2[rows[i]], grad);
+      grad = 0.0f;
+    }
+  }
   virtual void StartRound(int round) {
     param.round = round;
   }
@@ -65,10 +75,18 @@ class NAGUpdater : public IUpdater<xpu> {
   inline void ApplyUpdate(long epoch,
                           mshadow::Tensor<xpu, dim> grad) {
     param.ScheduleEpoch(epoch);
-    mshadow::Copy(old_m_w, m_w, old_m_w.stream_);
-    m_w *= param.momentum;
-    m_w += (-param.learning_rate) * (grad + param.wd * w);
-    w += (1 + param.momentum) * m_w - param.momentum * old_m_w;
+    this->ApplyStep(w, m_w, old_m_w, grad);
+  }
+  // one step on weight with momentum mom, shared by whole and row update
+  template<int d>
+  inline void ApplyStep(mshadow::Tensor<xpu, d> weight,
+                        mshadow::Tensor<xpu, d> mom,
+                        mshadow::Tensor<xpu, d> old_mom,
+                        mshadow::Tensor<xpu, d> grad) {
+    mshadow::Copy(old_mom, mom, old_mom.stream_);
+    mom *= param.momentum;
+    mom += (-param.learning_rate) * (grad + param.wd * weight);
+    weight += (1 + param.momentum) * mom - param.momentum * old_mom;
   }
 };  // class SGDUpdater
 }  // namespace updater
@@ -53,6 +53,15 @@ class SGDUpdater : public IUpdater<xpu> {
     this->ApplyUpdate(epoch, mshadow::Tensor<xpu, dim>
                       (grad.dptr_, w.shape_, grad.stride_, w.stream_));
   }
+  virtual void UpdateRows(long epoch, const std::vector<index_t> &rows) {
+    param.ScheduleEpoch(epoch);
+    mshadow::Tensor<xpu, 2> w2 = w.FlatTo2D(), dw2 = dw.FlatTo2D(), m2 = m_w.FlatTo2D();
+    for (size_t i = 0; i < rows.size(); ++i) {
+      mshadow::Tensor<xpu, 1> grad = dw2[rows[i]];
+      this->ApplyStep(w2[rows[i]], m2[rows[i]], grad);
+      grad = 0.0f;
+    }
+  }
   virtual void StartRound(int round) {
     param.round = round;
   }
@@ -72,15 +81,22 @@ class SGDUpdater : public IUpdater<xpu> {
   // update function
   virtual void ApplyUpdate(long epoch,
                            mshadow::Tensor<xpu, dim> grad) {
-    using namespace mshadow::expr;
     param.ScheduleEpoch(epoch);
-    m_w *= param.momentum;
+    this->ApplyStep(w, m_w, grad);
+  }
+  // one step on weight with momentum mom, shared by whole and row update
+  template<int d>
+  inline void ApplyStep(mshadow::Tensor<xpu, d> weight,
+                        mshadow::Tensor<xpu, d> mom,
+                        mshadow::Tensor<xpu, d> grad) {
+    using namespace mshadow::expr;
+    mom *= param.momentum;
     if (param.clip_gradient != 0.0f) {
-      m_w += (-param.learning_rate) * (F<clip>(grad, param.clip_gradient) + param.wd * w);
+      mom += (-param.learning_rate) * (F<clip>(grad, param.clip_gradient) + param.wd * weight);
     } else {
-      m_w += (-param.learning_rate) * (grad + param.wd * w);
+      mom += (-param.learning_rate) * (grad + param.wd * weight);
     }
-    w += m_w;
+    weight += mom;
   }
 };  // class SGDUpdater
 }  // namespace updater
@@ -61,6 +61,18 @@ class IUpdater {
    *        be called before passing in the gradient value
    */
   virtual void Update(long epoch, mshadow::Tensor<xpu, 2> grad) = 0;
+  /*!
+   * \brief update only the given rows of the parameter flattened to 2D, used when
+   *        the gradient is known to be zero in all other rows, e.g. weight of sparse_fullc,
+   *        the other rows, including their momentum, are left untouched,
+   *        the given rows of the gradient are reset to 0 after the update
+   * \param epoch what current epoch is
+   * \param rows indices of rows to be updated, each row must appear once
+   */
+  virtual void UpdateRows(long epoch, const std::vector<index_t> &rows) {
+    // updaters that do not support it update the whole weight
+    this->Update(epoch);
+  }
   /*!\ brief set parameters that could be spefic to this updater */
   virtual void SetParam(const char *name, const char *val) = 0;
 };
@@ -0,0 +1,206 @@
+#ifndef CXXNET_UTILS_DECODED_CACHE_H_
+#define CXXNET_UTILS_DECODED_CACHE_H_
+/*!
+ * \file decoded_cache.h
+ * \brief persistent cache of decoded images on local disk, so that
+ *   images only need to be decoded once across rounds and runs
+ */
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <mshadow/tensor.h>
+#include "./utils.h"
+#include "./io.h"
+
+namespace cxxnet {
+namespace utils {
+/*!
+ * \brief cache of decoded images in (height, width, channel) uint8 format, keyed by image index.
+ *   Images are appended to dir/decoded.bin, and become readable from the memory mapped file
+ *   after next call of Sync. The location of images is saved in dir/decoded.idx together with
+ *   a signature of the dataset and decoding settings, so the cache can be reused by later runs
+ *   on the same data. When the size limit is reached,
+ *   new images are no longer added, and only part of the dataset is cached.
+ */
+class DecodedImageCache {
+ public:
+  DecodedImageCache(void) : max_bytes_(0), nbytes_(0), dirty_(false) {}
+  ~DecodedImageCache(void) {
+    this->Close();
+  }
+  /*!
+   * \brief open cache in dir, existing content is loaded if it is built with the same signature,
+   *   otherwise the cache is dropped and built again
+   * \param dir directory of the cache files, must exist
+   * \param max_bytes maximum size of cache in bytes, 0 means no limit
+   * \param signature identity of the dataset and the settings of decoding, see FileSignature
+   */
+  inline void Open(const char *dir, size_t max_bytes, const std::string &signature) {
+    path_bin_ = std::string(dir) + "/decoded.bin";
+    path_idx_ = std::string(dir) + "/decoded.idx";
+    max_bytes_ = max_bytes;
+    signature_ = signature;
+    index_.clear();
+    FILE *fp = fopen64(path_idx_.c_str(), "rb");
+    if (fp != NULL) {
+      FileStream fs(fp);
+      IStream &fi = fs;
+      uint32_t magic;
+      std::string sig;
+      std::vector<Entry> entry;
+      if (fi.Read(&magic, sizeof(magic)) != 0 && magic == kMagic &&
+          fi.Read(&sig) && sig == signature_ && fi.Read(&entry)) {
+        for (size_t i = 0; i < entry.size(); ++i) {
+          index_[entry[i].key] = entry[i];
+        }
+      }
+      fs.Close();
+    }
+    fo_.Open(path_bin_.c_str(), "ab");
+    // drop entries that are not in the file, e.g. the file was truncated
+    for (std::map<unsigned, Entry>::iterator it = index_.begin(); it != index_.end();) {
+      if (it->second.offset + it->second.Bytes() > fo_.Size()) {
+        index_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    // images written after the last index save are not indexed, cut them off,
+    // so that new images go right after the indexed ones
+    size_t end = 0;
+    for (std::map<unsigned, Entry>::const_iterator it = index_.begin();
+         it != index_.end(); ++it) {
+      end = std::max(end, static_cast<size_t>(it->second.offset + it->second.Bytes()));
+    }
+    if (fo_.Size() != end) {
+      fo_.Close();
+      utils::Check(truncate(path_bin_.c_str(), static_cast<off_t>(end)) == 0,
+                   "DecodedImageCache: fail to truncate %s", path_bin_.c_str());
+      fo_.Open(path_bin_.c_str(), "ab");
+    }
+    nbytes_ = end;
+    // save the index now if the cache is dropped, so the stale index is never used
+    dirty_ = index_.size() == 0;
+    fmap_.Open(path_bin_.c_str());
+  }
+  /*!
+   * \brief signature of a file from its name, size and modification time,
+   *   used to find out whether the dataset of cache is changed
+   * \param fname name of file
+   */
+  inline static std::string FileSignature(const char *fname) {
+    struct stat st;
+    utils::Check(stat(fname, &st) == 0, "DecodedImageCache: fail to stat %s", fname);
+    char buf[64];
+    snprintf(buf, sizeof(buf), ":%lu:%ld;", static_cast<unsigned long>(st.st_size),
+             static_cast<long>(st.st_mtime));
+    return std::string(fname) + buf;
+  }
+  /*! \brief save the index and close the cache */
+  inline void Close(void) {
+    this->Sync();
+    fo_.Close();
+    fmap_.Close();
+  }
+  /*!
+   * \brief get the cached image, the result views the mapped file and is valid until next Sync
+   * \param key index of the image
+   * \param out the image
+   * \return whether the image is in cache
+   */
+  inline bool Get(unsigned key, mshadow::Tensor<cpu, 3, unsigned char> *out) const {
+    std::map<unsigned, Entry>::const_iterator it = index_.find(key);
+    if (it == index_.end()) return false;
+    const Entry &e = it->second;
+    // not readable until next Sync
+    if (e.offset + e.Bytes() > fmap_.Size()) return false;
+    *out = mshadow::Tensor<cpu, 3, unsigned char>
+        (reinterpret_cast<unsigned char*>(fmap_.data() + e.offset),
+         mshadow::Shape3(e.shape[0], e.shape[1], e.shape[2]));
+    return true;
+  }
+  /*!
+   * \brief add image to the cache, nothing is done if the key is cached or the cache is full
+   * \param key index of the image
+   * \param img the image, in (height, width, channel), must be contiguous
+   */
+  inline void Put(unsigned key, mshadow::Tensor<cpu, 3, unsigned char> img) {
+    if (index_.count(key) != 0) return;
+    Entry e;
+    e.key = key;
+    e.shape[0] = img.size(0); e.shape[1] = img.size(1); e.shape[2] = img.size(2);
+    e.offset = nbytes_;
+    if (max_bytes_ != 0 && nbytes_ + e.Bytes() > max_bytes_) return;
+    utils::Assert(img.stride_ == img.size(2), "DecodedImageCache: image must be contiguous");
+    fo_.Write(img.dptr_, e.Bytes());
+    nbytes_ += e.Bytes();
+    index_[key] = e;
+    dirty_ = true;
+  }
+  /*!
+   * \brief save the index and remap the cache file, so that images added are readable,
+   *   this invalidates all images returned by Get
+   */
+  inline void Sync(void) {
+    if (!dirty_) return;
+    fo_.Flush();
+    std::vector<Entry> entry;
+    for (std::map<unsigned, Entry>::const_iterator it = index_.begin();
+         it != index_.end(); ++it) {
+      entry.push_back(it->second);
+    }
+    FILE *fp = fopen64(path_idx_.c_str(), "wb");
+    if (fp != NULL) {
+      FileStream fs(fp);
+      IStream &fo = fs;
+      uint32_t magic = kMagic;
+      fo.Write(&magic, sizeof(magic));
+      fo.Write(signature_);
+      fo.Write(entry);
+      fs.Close();
+    }
+    fmap_.Open(path_bin_.c_str());
+    dirty_ = false;
+  }
+  /*! \return number of images in cache */
+  inline size_t NumImage(void) const {
+    return index_.size();
+  }
+  /*! \return size of cache file in bytes */
+  inline size_t NumBytes(void) const {
+    return nbytes_;
+  }
+
+ private:
+  /*! \brief location of a cached image */
+  struct Entry {
+    uint32_t key;
+    uint32_t shape[3];
+    uint64_t offset;
+    inline size_t Bytes(void) const {
+      return static_cast<size_t>(shape[0]) * shape[1] * shape[2];
+    }
+  };
+  /*! \brief magic number of index file */
+  static const uint32_t kMagic = 0xced7230d;
+  // path to cache file and index file
+  std::string path_bin_, path_idx_;
+  // signature of dataset and decoding settings
+  std::string signature_;
+  // size limit
+  size_t max_bytes_;
+  // current size of cache file
+  size_t nbytes_;
+  // whether there are images not synced
+  bool dirty_;
+  // location of images
+  std::map<unsigned, Entry> index_;
+  // file to append images
+  StdFile fo_;
+  // mapped cache file
+  MMapFile fmap_;
+};
+}  // namespace utils
+}  // namespace cxxnet
+#endif  // CXXNET_UTILS_DECODED_CACHE_H_
@@ -2,6 +2,8 @@
 #define CXXNET_UTILS_DECODER_H_
 
 #include <vector>
+#include <cstring>
+#include <algorithm>
 #if CXXNET_USE_OPENCV_DECODER == 0
   #include <jpeglib.h>
   #include <setjmp.h>
@@ -17,10 +19,35 @@
 namespace cxxnet {
 namespace utils {
 
+/*!
+ * \brief get the size of jpeg image by scanning the frame header, without decoding
+ * \return false if the data is not a jpeg image
+ */
+inline bool GetJpegSize(const unsigned char *ptr, size_t sz,
+                        unsigned *width, unsigned *height) {
+  if (sz < 4 || ptr[0] != 0xFF || ptr[1] != 0xD8) return false;
+  size_t i = 2;
+  while (i + 4 <= sz) {
+    if (ptr[i] != 0xFF) return false;
+    unsigned char marker = ptr[i + 1];
+    size_t len = (static_cast<size_t>(ptr[i + 2]) << 8) | ptr[i + 3];
+    // start of frame, except DHT(C4), JPG(C8) and DAC(CC)
+    if (marker >= 0xC0 && marker <= 0xCF &&
+        marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (i + 9 > sz) return false;
+      *height = (static_cast<unsigned>(ptr[i + 5]) << 8) | ptr[i + 6];
+      *width = (static_cast<unsigned>(ptr[i + 7]) << 8) | ptr[i + 8];
+      return true;
+    }
+    i += 2 + len;
+  }
+  return false;
+}
+
 #if CXXNET_USE_OPENCV_DECODER == 0
 struct JpegDecoder {
 public:
-  JpegDecoder(void) {
+  JpegDecoder(void) : min_size_(0), nchannel_(3) {
     cinfo.err = jpeg_std_error(&jerr.base);
     jerr.base.error_exit = jerror_exit;
     jerr.base.output_message = joutput_message;
@@ -39,15 +66,49 @@ public:
     }
     this->jpeg_mem_src(&cinfo, ptr, sz);
     utils::Check(jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK, "libjpeg: failed to decode");
+    // libjpeg converts color images into grayscale during decoding
+    if (nchannel_ == 1) cinfo.out_color_space = JCS_GRAYSCALE;
+    // let libjpeg scale down in DCT domain, as long as the short side is no less than min_size_
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    if (min_size_ != 0) {
+      unsigned short_side = std::min(cinfo.image_width, cinfo.image_height);
+      for (unsigned denom = 8; denom > 1; denom /= 2) {
+        if ((short_side + denom - 1) / denom >= min_size_) {
+          cinfo.scale_denom = denom; break;
+        }
+      }
+    }
     utils::Check(jpeg_start_decompress(&cinfo) == true, "libjpeg: failed to decode");
     p_data->Resize(mshadow::Shape3(cinfo.output_height, cinfo.output_width, cinfo.output_components));
-    JSAMPROW jptr = &((*p_data)[0][0][0]);
+    const size_t row_bytes = cinfo.output_width * cinfo.output_components;
+    unsigned char *dptr = &((*p_data)[0][0][0]);
+    JSAMPROW rows[kMaxRows];
     while (cinfo.output_scanline < cinfo.output_height) {
-      utils::Check(jpeg_read_scanlines(&cinfo, &jptr, 1) == true, "libjpeg: failed to decode");
-      jptr += cinfo.output_width * cinfo.output_components;
+      JDIMENSION nrow = std::min(static_cast<JDIMENSION>(kMaxRows),
+                                 cinfo.output_height - cinfo.output_scanline);
+      for (JDIMENSION i = 0; i < nrow; ++i) {
+        rows[i] = dptr + (cinfo.output_scanline + i) * row_bytes;
+      }
+      utils::Check(jpeg_read_scanlines(&cinfo, rows, nrow) != 0, "libjpeg: failed to decode");
     }
     utils::Check(jpeg_finish_decompress(&cinfo) == true, "libjpeg: failed to decode");
   }
+  /*!
+   * \brief set the minimum size of the short side of decoded images,
+   *   images are decoded at 1/2, 1/4 or 1/8 resolution when they are still big enough
+   * \param min_size minimum size, 0 means always decode at full resolution
+   */
+  inline void set_min_size(unsigned min_size) {
+    min_size_ = min_size;
+  }
+  /*!
+   * \brief set number of channels of decoded images
+   * \param nchannel 1 to decode all images in grayscale, 3 to keep the channels of image
+   */
+  inline void set_nchannel(unsigned nchannel) {
+    nchannel_ = nchannel;
+  }
 private:
   struct jerror_mgr {
     jpeg_error_mgr base;
@@ -97,6 +158,12 @@ private:
   }
 
 private:
+  // maximum number of rows read by one call of jpeg_read_scanlines
+  static const int kMaxRows = 16;
+  // minimum size of short side of decoded image
+  unsigned min_size_;
+  // number of channels of decoded image
+  unsigned nchannel_;
   jpeg_decompress_struct cinfo;
   jpeg_source_mgr src;
   jerror_mgr jerr;
@@ -105,11 +172,18 @@ private:
 
 #if CXXNET_USE_OPENCV
 struct OpenCVDecoder {
+  OpenCVDecoder(void) : min_size_(0), nchannel_(3) {}
   void Decode(unsigned char *ptr, size_t sz, mshadow::TensorContainer<cpu, 3, unsigned char> *p_data) {
     cv::Mat buf(1, sz, CV_8U, ptr);
-    cv::Mat res = cv::imdecode(buf, 1);
+    cv::Mat res = cv::imdecode(buf, this->DecodeFlag(buf));
     utils::Assert(res.data != NULL, "decoding fail");
-    p_data->Resize(mshadow::Shape3(res.rows, res.cols, 3));
+    p_data->Resize(mshadow::Shape3(res.rows, res.cols, res.channels()));
+    if (res.channels() == 1) {
+      for (int y = 0; y < res.rows; ++y) {
+        memcpy((*p_data)[y].dptr_, res.ptr(y), res.cols);
+      }
+      res.release(); return;
+    }
     for (int y = 0; y < res.rows; ++y) {
       for (int x = 0; x < res.cols; ++x) {
         cv::Vec3b bgr = res.at<cv::Vec3b>(y, x);
@@ -121,6 +195,46 @@ struct OpenCVDecoder {
     }
     res.release();
   }
+  /*!
+   * \brief set the minimum size of the short side of decoded images,
+   *   images are decoded at reduced resolution when they are still big enough
+   * \param min_size minimum size, 0 means always decode at full resolution
+   */
+  inline void set_min_size(unsigned min_size) {
+    min_size_ = min_size;
+  }
+  /*!
+   * \brief set number of channels of decoded images
+   * \param nchannel 1 to decode all images in grayscale, 3 to decode all images in color
+   */
+  inline void set_nchannel(unsigned nchannel) {
+    nchannel_ = nchannel;
+  }
+
+ private:
+  // minimum size of short side of decoded image
+  unsigned min_size_;
+  // number of channels of decoded image
+  unsigned nchannel_;
+  // get flag of imdecode, reduced decoding is only available since OpenCV 3
+  inline int DecodeFlag(const cv::Mat &buf) {
+#if CV_VERSION_MAJOR >= 3
+    unsigned width, height;
+    if (min_size_ != 0 && GetJpegSize(buf.data, buf.cols, &width, &height)) {
+      unsigned short_side = std::min(width, height);
+      const int flags[3] = {cv::IMREAD_REDUCED_COLOR_8, cv::IMREAD_REDUCED_COLOR_4,
+                            cv::IMREAD_REDUCED_COLOR_2};
+      const int gray_flags[3] = {cv::IMREAD_REDUCED_GRAYSCALE_8, cv::IMREAD_REDUCED_GRAYSCALE_4,
+                                 cv::IMREAD_REDUCED_GRAYSCALE_2};
+      for (unsigned i = 0, denom = 8; i < 3; ++i, denom /= 2) {
+        if ((short_side + denom - 1) / denom >= min_size_) {
+          return nchannel_ == 1 ? gray_flags[i] : flags[i];
+        }
+      }
+    }
+#endif
+    return nchannel_ == 1 ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+  }
 };
 #endif
 } // namespace utils
@@ -8,8 +8,15 @@
 #include "./utils.h"
 #include <zlib.h>
 #include <string>
+#include <vector>
 #include <algorithm>
 #include <cstring>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace cxxnet {
 namespace utils {
@@ -215,7 +222,7 @@ class StdFile: public ISeekStream {
   StdFile(const char *fname, const char *mode) {
     Open(fname, mode);
   }
-  StdFile() {}
+  StdFile() : fp_(NULL), sz_(0) {}
   virtual ~StdFile(void) {
     this->Close();
   }
@@ -242,6 +249,9 @@ class StdFile: public ISeekStream {
       fclose(fp_); fp_ = NULL;
     }
   }
+  inline void Flush(void) {
+    fflush(fp_);
+  }
   inline size_t Size() {
     return sz_;
   }
@@ -250,6 +260,191 @@ class StdFile: public ISeekStream {
   size_t sz_;
 }; // class StdFile
 
+/*! \brief read only memory mapped file */
+class MMapFile {
+ public:
+  /*! \brief type of access advice to the kernel */
+  enum Advice {
+    kNormal,
+    kSequential,
+    kRandom,
+    kWillNeed,
+    kDontNeed
+  };
+  MMapFile(void) : dptr_(NULL), size_(0) {}
+  ~MMapFile(void) {
+    this->Close();
+  }
+  /*! \brief map the whole file into memory */
+  inline void Open(const char *fname) {
+    this->Close();
+#ifndef _MSC_VER
+    int fd = open(fname, O_RDONLY);
+    utils::Check(fd != -1, "can not open file \"%s\"\n", fname);
+    struct stat st;
+    utils::Check(fstat(fd, &st) == 0, "MMapFile: fail to stat \"%s\"", fname);
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ != 0) {
+      void *ptr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      utils::Check(ptr != MAP_FAILED, "MMapFile: fail to map \"%s\"", fname);
+      dptr_ = static_cast<char*>(ptr);
+    }
+    close(fd);
+#else
+    utils::Error("MMapFile: memory mapped file is not supported on this platform");
+#endif
+  }
+  /*! \brief unmap the file */
+  inline void Close(void) {
+#ifndef _MSC_VER
+    if (dptr_ != NULL) munmap(dptr_, size_);
+#endif
+    dptr_ = NULL; size_ = 0;
+  }
+  /*!
+   * \brief give access advice of region [offset, offset + len) to the kernel,
+   *   the region is extended to system page boundary, and clipped to file size
+   */
+  inline void Advise(size_t offset, size_t len, Advice advice) {
+#ifndef _MSC_VER
+    if (dptr_ == NULL || offset >= size_) return;
+    len = std::min(len, size_ - offset);
+    size_t align = offset % static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    offset -= align; len += align;
+    int flag = MADV_NORMAL;
+    switch (advice) {
+      case kNormal: flag = MADV_NORMAL; break;
+      case kSequential: flag = MADV_SEQUENTIAL; break;
+      case kRandom: flag = MADV_RANDOM; break;
+      case kWillNeed: flag = MADV_WILLNEED; break;
+      case kDontNeed: flag = MADV_DONTNEED; break;
+    }
+    madvise(dptr_ + offset, len, flag);
+#endif
+  }
+  /*! \return pointer to the beginning of file content */
+  inline char *data(void) const {
+    return dptr_;
+  }
+  /*! \return size of the file */
+  inline size_t Size(void) const {
+    return size_;
+  }
+
+ private:
+  // mapped content
+  char *dptr_;
+  // size of file
+  size_t size_;
+};  // class MMapFile
+
+/*!
+ * \brief compressed content of a binary page, the page is split into blocks of block_bytes,
+ *   each block is compressed independently by zlib, so that blocks can be decompressed in parallel.
+ *   On disk, it starts with kMagic, which is negative and can not be the number of records
+ *   of a raw page, then block_bytes, number of blocks, compressed size of each block,
+ *   followed by the compressed blocks
+ */
+struct CompressedPage {
+  /*! \brief magic number that marks a compressed page */
+  static const int kMagic = -0x3ced7231;
+  /*! \brief default size of block */
+  static const int kBlockBytes = 1 << 20;
+  /*! \brief size of block before compression */
+  int block_bytes;
+  /*! \brief compressed size of each block */
+  std::vector<int> csize;
+  /*! \brief offset of each compressed block in data */
+  std::vector<size_t> coffset;
+  /*! \brief compressed blocks */
+  std::vector<unsigned char> data;
+  CompressedPage(void) : block_bytes(0) {}
+  /*! \return number of blocks, 0 means the page is not compressed */
+  inline int NumBlock(void) const {
+    return static_cast<int>(csize.size());
+  }
+  /*! \brief mark the page as not compressed */
+  inline void Clear(void) {
+    csize.clear(); coffset.clear();
+  }
+  /*!
+   * \brief compress the content of a page
+   * \param src content of page
+   * \param nbytes size of page
+   * \param level zlib compression level
+   */
+  inline void Compress(const void *src, size_t nbytes, int level) {
+    const unsigned char *p = static_cast<const unsigned char*>(src);
+    block_bytes = kBlockBytes;
+    int nblock = static_cast<int>((nbytes + block_bytes - 1) / block_bytes);
+    csize.resize(nblock); coffset.resize(nblock);
+    data.resize(compressBound(block_bytes) * nblock);
+    size_t top = 0;
+    for (int i = 0; i < nblock; ++i) {
+      size_t begin = static_cast<size_t>(i) * block_bytes;
+      size_t len = std::min(nbytes - begin, static_cast<size_t>(block_bytes));
+      uLongf clen = static_cast<uLongf>(data.size() - top);
+      utils::Check(compress2(&data[top], &clen, p + begin, len, level) == Z_OK,
+                   "CompressedPage: fail to compress page");
+      csize[i] = static_cast<int>(clen);
+      coffset[i] = top;
+      top += clen;
+    }
+    data.resize(top);
+  }
+  /*!
+   * \brief decompress i-th block
+   * \param i index of block
+   * \param dst content of page, the block is written to dst + i * block_bytes
+   * \param nbytes size of page
+   */
+  inline void Decompress(int i, void *dst, size_t nbytes) const {
+    utils::Assert(i >= 0 && i < NumBlock() &&
+                  static_cast<size_t>(i) * block_bytes < nbytes,
+                  "CompressedPage: block index exceed page");
+    size_t begin = static_cast<size_t>(i) * block_bytes;
+    size_t len = std::min(nbytes - begin, static_cast<size_t>(block_bytes));
+    uLongf dlen = static_cast<uLongf>(len);
+    utils::Check(uncompress(static_cast<unsigned char*>(dst) + begin, &dlen,
+                            &data[coffset[i]], csize[i]) == Z_OK && dlen == len,
+                 "CompressedPage: fail to decompress page, file corrupted");
+  }
+  /*! \brief save the compressed page */
+  inline void Save(IStream &fo) const {
+    int head[3];
+    head[0] = kMagic; head[1] = block_bytes; head[2] = NumBlock();
+    fo.Write(head, sizeof(head));
+    fo.Write(&csize[0], sizeof(int) * csize.size());
+    if (data.size() != 0) fo.Write(&data[0], data.size());
+  }
+  /*!
+   * \brief load the compressed page, after the magic number is read,
+   *   the header is checked against the page size, so that a corrupted file is rejected
+   *   before any block is decompressed
+   * \param fi the input stream
+   * \param nbytes size of page
+   */
+  inline void LoadBody(IStream &fi, size_t nbytes) {
+    int head[2];
+    utils::Check(fi.Read(head, sizeof(head)) != 0 && head[0] == kBlockBytes &&
+                 static_cast<size_t>(head[1]) == (nbytes + kBlockBytes - 1) / kBlockBytes,
+                 "CompressedPage: invalid page header");
+    block_bytes = head[0];
+    csize.resize(head[1]); coffset.resize(head[1]);
+    utils::Check(fi.Read(&csize[0], sizeof(int) * csize.size()) != 0,
+                 "CompressedPage: invalid page header");
+    size_t total = 0;
+    for (size_t i = 0; i < csize.size(); ++i) {
+      utils::Check(csize[i] > 0, "CompressedPage: invalid page header");
+      coffset[i] = total;
+      total += csize[i];
+    }
+    data.resize(total);
+    utils::Check(fi.Read(&data[0], total) != 0,
+                 "CompressedPage: unexpected end of file");
+  }
+};  // struct CompressedPage
+
 /*! \brief Basic page class */
 class BinaryPage {
  public:
@@ -269,17 +464,65 @@ class BinaryPage {
   BinaryPage(void)  {
     data_ = new int[kPageSize];
     utils::Check(data_ != NULL, "fail to allocate page, out of space");
+    own_data_ = true;
     this->Clear();
   };
+  /*!
+   * \brief constructor of page that views external memory, no space is allocated
+   * \param dptr pointer to kPageSize ints of page content, can be NULL and set later by View
+   */
+  explicit BinaryPage(void *dptr) {
+    data_ = static_cast<int*>(dptr);
+    own_data_ = false;
+  }
   ~BinaryPage() {
-    if (data_) delete [] data_;
+    if (own_data_ && data_) delete [] data_;
   }
   /*!
-   * \brief load one page form instream
+   * \brief load one page form instream, both raw and compressed pages can be loaded
+   * \param fi the input stream
+   * \param cpage if not NULL, a compressed page is loaded into cpage instead of being
+   *   decompressed, so that the caller can decompress it, e.g. in parallel by Decompress,
+   *   cpage->NumBlock() is 0 if the page is not compressed
    * \return true if loading is successful
    */
-  inline bool Load(utils::IStream &fi) {
-    return fi.Read(&data_[0], sizeof(int)*kPageSize) !=0;
+  inline bool Load(utils::IStream &fi, CompressedPage *cpage = NULL) {
+    utils::Assert(own_data_, "BinaryPage: can not load into a page view");
+    if (fi.Read(&data_[0], sizeof(int)) == 0) return false;
+    if (data_[0] != CompressedPage::kMagic) {
+      if (cpage != NULL) cpage->Clear();
+      return fi.Read(&data_[1], sizeof(int) * (kPageSize - 1)) != 0;
+    }
+    if (cpage != NULL) {
+      cpage->LoadBody(fi, sizeof(int) * kPageSize);
+    } else {
+      CompressedPage cp;
+      cp.LoadBody(fi, sizeof(int) * kPageSize);
+      for (int i = 0; i < cp.NumBlock(); ++i) {
+        this->Decompress(cp, i);
+      }
+    }
+    return true;
+  }
+  /*! \brief decompress i-th block of compressed page into the page */
+  inline void Decompress(const CompressedPage &cpage, int i) {
+    cpage.Decompress(i, data_, sizeof(int) * kPageSize);
+  }
+  /*! \brief save one page into outstream with compression */
+  inline void SaveCompressed(utils::IStream &fo, int level) {
+    CompressedPage cp;
+    cp.Compress(data_, sizeof(int) * kPageSize, level);
+    cp.Save(fo);
+  }
+  /*!
+   * \brief make the page a view of external memory, e.g. a memory mapped file,
+   *   the page content is not copied, and the memory must stay valid while the page is used
+   * \param dptr pointer to kPageSize ints of page content
+   */
+  inline void View(void *dptr) {
+    if (own_data_ && data_) delete [] data_;
+    data_ = static_cast<int*>(dptr);
+    own_data_ = false;
   }
   /*! \brief save one page into outstream */
   inline void Save(utils::IStream &fo) {
@@ -312,6 +555,14 @@ class BinaryPage {
     utils::Assert(r < Size(), "index excceed bound");
     return Obj(this->offset(data_[ r + 2 ]),  data_[ r + 2 ] - data_[ r + 1 ]);
   }
+  /*!
+   * \brief get byte offset of one binary object from the beginning of page
+   *  \param r r th obj in the page
+   */
+  inline size_t ObjOffset(int r) {
+    utils::Assert(r < Size(), "index excceed bound");
+    return kPageSize * sizeof(int) - data_[ r + 2 ];
+  }
  private:
   /*! \return number of elements */
   inline size_t FreeBytes(void) {
@@ -323,7 +574,334 @@ class BinaryPage {
  private:
   //int data_[ kPageSize ];
   int *data_;
+  // whether data_ is allocated by the page
+  bool own_data_;
 };  // class BinaryPage
+
+/*!
+ * \brief location of every record in a binary page file,
+ *   this is stored as .idx sidecar of the binary file to allow random access
+ */
+struct BinaryPageIndex {
+  /*! \brief location of one record */
+  struct Entry {
+    /*! \brief page number in the file */
+    uint32_t page;
+    /*! \brief byte offset of the record from the beginning of page */
+    uint32_t offset;
+    /*! \brief size of record in bytes */
+    uint32_t size;
+  };
+  /*! \brief location of records, in the order they appear in the file */
+  std::vector<Entry> entry;
+  /*! \brief number of bytes in a page */
+  static const size_t kPageBytes = BinaryPage::kPageSize * sizeof(int);
+  /*! \brief add locations of all records in a page */
+  inline void AddPage(uint32_t pid, BinaryPage &pg) {
+    for (int i = 0; i < pg.Size(); ++i) {
+      Entry e;
+      e.page = pid;
+      e.offset = static_cast<uint32_t>(pg.ObjOffset(i));
+      e.size = static_cast<uint32_t>(pg[i].sz);
+      entry.push_back(e);
+    }
+  }
+  /*! \brief build the index by scanning the page headers of a mapped binary file */
+  inline void Build(const MMapFile &fbin) {
+    entry.clear();
+    BinaryPage pg(NULL);
+    for (size_t i = 0; i < fbin.Size() / kPageBytes; ++i) {
+      pg.View(fbin.data() + i * kPageBytes);
+      this->AddPage(static_cast<uint32_t>(i), pg);
+    }
+  }
+  /*! \return pointer to the content of i-th record in mapped binary file */
+  inline BinaryPage::Obj Get(const MMapFile &fbin, size_t i) const {
+    const Entry &e = entry[i];
+    return BinaryPage::Obj(fbin.data() + e.page * kPageBytes + e.offset, e.size);
+  }
+  /*!
+   * \brief save the index, together with the size and modification time of the binary file,
+   *   so that an index left from another version of the binary file is not used
+   * \param fo output stream
+   * \param path_bin the binary file, must be completely written and closed
+   */
+  inline void Save(IStream &fo, const char *path_bin) const {
+    Header head;
+    utils::Check(head.Stat(path_bin), "BinaryPageIndex: fail to stat %s", path_bin);
+    fo.Write(&head, sizeof(head));
+    fo.Write(entry);
+  }
+  /*!
+   * \brief load the index
+   * \param path_idx file of the index
+   * \param path_bin the binary file the index belongs to
+   * \param fbin the mapped binary file
+   * \return false if the index does not exist, or it does not match the binary file
+   */
+  inline bool Load(const char *path_idx, const char *path_bin, const MMapFile &fbin) {
+    Header cur, head;
+    if (!cur.Stat(path_bin)) return false;
+    FILE *fp = fopen64(path_idx, "rb");
+    if (fp == NULL) return false;
+    FileStream fs(fp);
+    bool ok = fs.Read(&head, sizeof(head)) != 0 && head.magic == cur.magic &&
+        head.bin_size == cur.bin_size && head.bin_mtime == cur.bin_mtime &&
+        static_cast<IStream&>(fs).Read(&entry);
+    fs.Close();
+    // every record must lie in its page of the mapped file
+    for (size_t i = 0; ok && i < entry.size(); ++i) {
+      const Entry &e = entry[i];
+      ok = static_cast<size_t>(e.offset) + e.size <= kPageBytes &&
+          (static_cast<size_t>(e.page) + 1) * kPageBytes <= fbin.Size();
+    }
+    if (!ok) entry.clear();
+    return ok;
+  }
+  /*!
+   * \brief load the index from path_idx, if it does not exist or does not match the binary file,
+   *   build it from the binary file and try to save it to path_idx
+   */
+  inline void LoadOrBuild(const char *path_idx, const char *path_bin, const MMapFile &fbin) {
+    if (this->Load(path_idx, path_bin, fbin)) return;
+    this->Build(fbin);
+    FILE *fp = fopen64(path_idx, "wb");
+    if (fp != NULL) {
+      FileStream fs(fp);
+      this->Save(fs, path_bin);
+      fs.Close();
+    }
+  }
+  /*! \brief magic number of index file */
+  static const uint32_t kMagic = 0xced72310;
+
+ private:
+  /*! \brief header of index file, identifies the binary file it belongs to */
+  struct Header {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t bin_size;
+    int64_t bin_mtime;
+    // fill the header from the binary file, return false if it can not be accessed
+    inline bool Stat(const char *path_bin) {
+      struct stat st;
+      if (stat(path_bin, &st) != 0) return false;
+      magic = kMagic; reserved = 0;
+      bin_size = static_cast<uint64_t>(st.st_size);
+      bin_mtime = static_cast<int64_t>(st.st_mtime);
+      return true;
+    }
+  };
+};  // struct BinaryPageIndex
+
+/*!
+ * \brief binary label file (.lbl), stores instance index and labels of records
+ *   in the same order as the records in the list and binary file,
+ *   the file starts with a header of magic, label_width and number of records,
+ *   then each record is a uint32 instance index followed by label_width float32 labels
+ */
+class BinaryLabelFile {
+ public:
+  BinaryLabelFile(void) : label_width_(0), num_record_(0), num_read_(0) {}
+  /*!
+   * \brief write the header of label file
+   * \param fo output stream
+   * \param label_width number of labels of each record
+   * \param num_record number of records in the file
+   */
+  inline static void WriteHeader(IStream &fo, uint32_t label_width, uint64_t num_record) {
+    uint32_t head[2];
+    head[0] = kMagic; head[1] = label_width;
+    fo.Write(head, sizeof(head));
+    fo.Write(&num_record, sizeof(num_record));
+  }
+  /*!
+   * \brief check whether the file is a binary label file
+   * \param fname name of the file
+   */
+  inline static bool IsLabelFile(const char *fname) {
+    FILE *fp = fopen64(fname, "rb");
+    if (fp == NULL) return false;
+    uint32_t magic;
+    bool ret = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == kMagic;
+    fclose(fp);
+    return ret;
+  }
+  /*!
+   * \brief open the label file for reading
+   * \param fname name of the file
+   * \param label_width expected number of labels of each record
+   */
+  inline void Open(const char *fname, int label_width) {
+    fi_.Close();
+    fi_.Open(fname, "rb");
+    uint32_t head[2];
+    utils::Check(fi_.Read(head, sizeof(head)) != 0 && head[0] == kMagic,
+                 "BinaryLabelFile: %s is not a binary label file", fname);
+    utils::Check(head[1] == static_cast<uint32_t>(label_width),
+                 "BinaryLabelFile: %s has label_width=%u, but label_width=%d is specified",
+                 fname, head[1], label_width);
+    utils::Check(fi_.Read(&num_record_, sizeof(num_record_)) != 0,
+                 "BinaryLabelFile: invalid header in %s", fname);
+    label_width_ = label_width;
+    num_read_ = 0;
+  }
+  /*! \brief close the file */
+  inline void Close(void) {
+    fi_.Close();
+  }
+  /*! \brief move to the first record */
+  inline void BeforeFirst(void) {
+    fi_.Seek(kHeaderBytes);
+    num_read_ = 0;
+  }
+  /*! \return number of records in the file */
+  inline uint64_t NumRecord(void) const {
+    return num_record_;
+  }
+  /*! \return number of records read, the position to be given to Seek */
+  inline uint64_t Tell(void) const {
+    return num_read_;
+  }
+  /*!
+   * \brief move to a record, so that next Read starts from it
+   * \param n number of records before it
+   */
+  inline void Seek(uint64_t n) {
+    utils::Check(n <= num_record_, "BinaryLabelFile: seek beyond the last record");
+    const size_t rsize = sizeof(uint32_t) + sizeof(float) * label_width_;
+    fi_.Seek(kHeaderBytes + static_cast<size_t>(n) * rsize);
+    num_read_ = n;
+  }
+  /*!
+   * \brief read next n records with a single bulk read
+   * \param n number of records to read, must not exceed the remaining records
+   * \param index output instance index, size n
+   * \param labels output labels, size n * label_width
+   */
+  inline void Read(size_t n, unsigned *index, float *labels) {
+    if (n == 0) return;
+    utils::Check(num_read_ + n <= num_record_,
+                 "BinaryLabelFile: label file has less records than the data");
+    const size_t rsize = sizeof(uint32_t) + sizeof(float) * label_width_;
+    buf_.resize(n * rsize);
+    utils::Check(fi_.Read(&buf_[0], n * rsize) != 0,
+                 "BinaryLabelFile: unexpected end of file");
+    for (size_t i = 0; i < n; ++i) {
+      const char *rec = &buf_[i * rsize];
+      uint32_t idx;
+      memcpy(&idx, rec, sizeof(idx));
+      index[i] = idx;
+      memcpy(labels + i * label_width_, rec + sizeof(idx), sizeof(float) * label_width_);
+    }
+    num_read_ += n;
+  }
+  /*! \brief magic number of label file */
+  static const uint32_t kMagic = 0xced7230b;
+
+ private:
+  // size of header
+  static const size_t kHeaderBytes = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+  // file to read from
+  StdFile fi_;
+  // number of labels of each record
+  int label_width_;
+  // number of records
+  uint64_t num_record_;
+  // number of records read
+  uint64_t num_read_;
+  // read buffer
+  std::vector<char> buf_;
+};  // class BinaryLabelFile
+
+/*!
+ * \brief binary attach file (.attbin), stores extra data of instances, sorted by instance index,
+ *   the file starts with a header of magic, dim and number of rows,
+ *   followed by the uint32 instance index of all rows in ascending order,
+ *   then dim float32 values of each row in the same order,
+ *   the file is memory mapped, and rows are located by binary search,
+ *   or directly when the indices are consecutive
+ */
+class BinaryAttachFile {
+ public:
+  BinaryAttachFile(void) : dim_(0), num_row_(0), index_(NULL), data_(NULL), dense_(false) {}
+  /*!
+   * \brief write the header of attach file
+   * \param fo output stream
+   * \param dim number of values of each row
+   * \param num_row number of rows in the file
+   */
+  inline static void WriteHeader(IStream &fo, uint32_t dim, uint64_t num_row) {
+    uint32_t head[2];
+    head[0] = kMagic; head[1] = dim;
+    fo.Write(head, sizeof(head));
+    fo.Write(&num_row, sizeof(num_row));
+  }
+  /*! \brief map the file for reading */
+  inline void Open(const char *fname) {
+    fmap_.Open(fname);
+    utils::Check(fmap_.Size() >= kHeaderBytes,
+                 "BinaryAttachFile: %s is not a binary attach file", fname);
+    uint32_t head[2];
+    memcpy(head, fmap_.data(), sizeof(head));
+    memcpy(&num_row_, fmap_.data() + sizeof(head), sizeof(num_row_));
+    utils::Check(head[0] == kMagic,
+                 "BinaryAttachFile: %s is not a binary attach file", fname);
+    dim_ = head[1];
+    utils::Check(fmap_.Size() == kHeaderBytes + num_row_ * (sizeof(uint32_t) + sizeof(float) * dim_),
+                 "BinaryAttachFile: size of %s does not match its header", fname);
+    index_ = reinterpret_cast<const uint32_t*>(fmap_.data() + kHeaderBytes);
+    data_ = reinterpret_cast<const float*>(index_ + num_row_);
+    dense_ = num_row_ != 0 && index_[num_row_ - 1] - index_[0] + 1 == num_row_;
+    // lookups are random accesses
+    fmap_.Advise(0, fmap_.Size(), MMapFile::kRandom);
+  }
+  /*! \brief close the file */
+  inline void Close(void) {
+    fmap_.Close();
+    index_ = NULL; data_ = NULL;
+    num_row_ = 0;
+  }
+  /*! \return number of values of each row */
+  inline uint32_t dim(void) const {
+    return dim_;
+  }
+  /*! \return number of rows */
+  inline uint64_t NumRow(void) const {
+    return num_row_;
+  }
+  /*!
+   * \brief find the row of instance
+   * \param index instance index
+   * \return pointer to dim values of the row, NULL if the instance is not in file
+   */
+  inline const float *Find(uint32_t index) const {
+    if (num_row_ == 0 || index < index_[0] || index > index_[num_row_ - 1]) return NULL;
+    if (dense_) return data_ + static_cast<size_t>(index - index_[0]) * dim_;
+    const uint32_t *end = index_ + num_row_;
+    const uint32_t *it = std::lower_bound(index_, end, index);
+    if (it == end || *it != index) return NULL;
+    return data_ + static_cast<size_t>(it - index_) * dim_;
+  }
+  /*! \brief magic number of attach file */
+  static const uint32_t kMagic = 0xced7230f;
+
+ private:
+  // size of header
+  static const size_t kHeaderBytes = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+  // number of values of each row
+  uint32_t dim_;
+  // number of rows
+  uint64_t num_row_;
+  // sorted instance index of rows, in mapped file
+  const uint32_t *index_;
+  // values of rows, in mapped file
+  const float *data_;
+  // whether the indices are consecutive
+  bool dense_;
+  // mapped file
+  MMapFile fmap_;
+};  // class BinaryAttachFile
 }  // namespace utils
 }  // namespace cxxnet
 #endif
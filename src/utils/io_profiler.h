@@ -0,0 +1,184 @@
+#ifndef CXXNET_UTILS_IO_PROFILER_H_
+#define CXXNET_UTILS_IO_PROFILER_H_
+/*!
+ * \file io_profiler.h
+ * \brief counters of the stages of data pipeline, used to find out which stage is the bottleneck
+ */
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "./utils.h"
+#include "./timer.h"
+
+namespace cxxnet {
+namespace utils {
+/*!
+ * \brief counters of one instance of a pipeline stage, each counter is only updated
+ *   by the thread that runs the stage, so no lock is needed. Counters are never cleared
+ *   while the stage runs, a period is measured by the difference of two snapshots
+ */
+struct IOStage {
+  /*! \brief name of stage, instances of same name are reported together */
+  std::string name;
+  /*! \brief time spent in doing the work of stage */
+  double busy_time;
+  /*! \brief time spent in waiting for input, or for space to put output */
+  double wait_time;
+  /*! \brief number of items produced */
+  unsigned long count;
+  /*! \brief capacity of the output queue of stage, 0 if stage has no queue */
+  int queue_capacity;
+  /*! \brief sum of the number of ready items in queue, sampled when consumer takes an item */
+  double queue_fill;
+  /*! \brief number of samples of queue_fill */
+  unsigned long queue_samples;
+  /*! \brief time the consumer spent in waiting for queue */
+  double starve_time;
+  IOStage(void) : queue_capacity(0) {
+    this->Reset();
+  }
+  inline void Reset(void) {
+    busy_time = wait_time = 0.0;
+    count = 0;
+    queue_fill = 0.0;
+    queue_samples = 0;
+    starve_time = 0.0;
+  }
+  /*! \brief substract the counters of an earlier snapshot of the same stage */
+  inline void Sub(const IOStage &begin) {
+    busy_time -= begin.busy_time; wait_time -= begin.wait_time;
+    count -= begin.count;
+    queue_fill -= begin.queue_fill; queue_samples -= begin.queue_samples;
+    starve_time -= begin.starve_time;
+  }
+};
+/*!
+ * \brief registry of all stages, stages are registered during initialization of iterators
+ *   and live until exit, so pointers to them never dangle; counting is off by default
+ */
+class IOProfiler {
+ public:
+  /*! \return the global profiler */
+  inline static IOProfiler *Get(void) {
+    static IOProfiler inst;
+    return &inst;
+  }
+  /*! \brief register a stage, not thread safe, must be called during initialization */
+  inline IOStage *Register(const char *name) {
+    IOStage *s = new IOStage();
+    s->name = name;
+    stages_.push_back(s);
+    return s;
+  }
+  /*! \return whether counting is on */
+  inline bool enabled(void) const {
+    return enabled_;
+  }
+  /*! \brief turn counting on or off */
+  inline void set_enabled(bool enabled) {
+    enabled_ = enabled;
+  }
+  /*!
+   * \brief copy the counters of all stages, can be called while the stages are running,
+   *   in which case the item in progress may be partly counted
+   * \return counters in the order of registration
+   */
+  inline std::vector<IOStage> Snapshot(void) const {
+    std::vector<IOStage> ret;
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      ret.push_back(*stages_[i]);
+    }
+    return ret;
+  }
+  /*!
+   * \brief print the counters of stages that produced any item since a snapshot
+   * \param fo output file
+   * \param elapsed wall time in seconds since the snapshot
+   * \param begin snapshot taken at the start of the period, stages registered after it start from 0
+   */
+  inline void Print(FILE *fo, double elapsed, const std::vector<IOStage> &begin) const {
+    fprintf(fo, "%-22s %4s %10s %10s %9s %9s %6s %12s %9s\n", "stage", "inst", "items",
+            "items/sec", "busy(s)", "wait(s)", "busy%", "queue", "starve(s)");
+    std::vector<bool> done(stages_.size(), false);
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      if (done[i]) continue;
+      // sum up instances of the same stage, e.g. chains of multiple workers
+      IOStage sum;
+      int ninst = 0, capacity = 0;
+      for (size_t j = i; j < stages_.size(); ++j) {
+        if (done[j] || stages_[j]->name != stages_[i]->name) continue;
+        done[j] = true;
+        IOStage s = *stages_[j];
+        if (j < begin.size()) s.Sub(begin[j]);
+        if (s.count == 0) continue;
+        ninst += 1;
+        sum.busy_time += s.busy_time; sum.wait_time += s.wait_time;
+        sum.count += s.count;
+        sum.queue_fill += s.queue_fill; sum.queue_samples += s.queue_samples;
+        sum.starve_time += s.starve_time;
+        capacity += s.queue_capacity;
+      }
+      if (ninst == 0) continue;
+      char queue[32] = "-";
+      if (capacity != 0 && sum.queue_samples != 0) {
+        snprintf(queue, sizeof(queue), "%.1f/%d",
+                 sum.queue_fill / sum.queue_samples * ninst, capacity);
+      }
+      fprintf(fo, "%-22s %4d %10lu %10.1f %9.2f %9.2f %6.1f %12s %9.2f\n",
+              stages_[i]->name.c_str(), ninst, sum.count,
+              elapsed > 0.0 ? sum.count / elapsed : 0.0,
+              sum.busy_time, sum.wait_time,
+              elapsed > 0.0 ? sum.busy_time / (elapsed * ninst) * 100.0 : 0.0,
+              queue, sum.starve_time);
+    }
+    fflush(fo);
+  }
+
+ private:
+  IOProfiler(void) : enabled_(false) {}
+  ~IOProfiler(void) {
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      delete stages_[i];
+    }
+  }
+  // whether counting is on
+  bool enabled_;
+  // all registered stages
+  std::vector<IOStage*> stages_;
+};
+/*!
+ * \brief splits the time of a stage into busy and waiting time between marks,
+ *   does nothing if stage is NULL or counting is off
+ */
+class IOStageTimer {
+ public:
+  explicit IOStageTimer(IOStage *stage)
+      : stage_(stage != NULL && IOProfiler::Get()->enabled() ? stage : NULL) {
+    if (stage_ != NULL) last_ = GetTime();
+  }
+  /*! \brief time since last mark was spent in waiting */
+  inline void Wait(void) {
+    if (stage_ == NULL) return;
+    double now = GetTime();
+    stage_->wait_time += now - last_;
+    last_ = now;
+  }
+  /*!
+   * \brief time since last mark was spent in working
+   * \param nitem number of items produced
+   */
+  inline void Busy(unsigned long nitem = 0) {
+    if (stage_ == NULL) return;
+    double now = GetTime();
+    stage_->busy_time += now - last_;
+    stage_->count += nitem;
+    last_ = now;
+  }
+
+ private:
+  IOStage *stage_;
+  double last_;
+};
+}  // namespace utils
+}  // namespace cxxnet
+#endif  // CXXNET_UTILS_IO_PROFILER_H_
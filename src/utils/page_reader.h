@@ -0,0 +1,298 @@
+#ifndef CXXNET_UTILS_PAGE_READER_H_
+#define CXXNET_UTILS_PAGE_READER_H_
+/*!
+ * \file page_reader.h
+ * \brief reader of fixed size pages from a group of binary files, which reads pages ahead
+ *   of the consumer with multiple reads in flight, optionally bypassing the page cache
+ */
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include "./utils.h"
+#include "./thread_pool.h"
+#include "./thread_ring_buffer.h"
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace cxxnet {
+namespace utils {
+/*!
+ * \brief reads the pages of a round in file order by nthread reader threads, each thread
+ *   takes the next page and reads it by positional reads, and a ring of nthread page buffers
+ *   hands the pages to the consumer in order, so up to nthread pages are read ahead of the
+ *   consumer, and nthread reads are in flight on the device instead of one buffered stream.
+ *   With direct IO, files are opened with O_DIRECT, and the page buffer must be allocated by
+ *   AllocBuffer; if O_DIRECT is not supported by the file system, buffered reads are used and
+ *   the pages are dropped from page cache after being read, so the dataset does not evict
+ *   everything else from memory
+ */
+class ParallelPageReader {
+ public:
+  /*! \brief alignment of buffer, offset and size required by direct IO */
+  static const size_t kAlign = 4096;
+  ParallelPageReader(void)
+      : page_bytes_(0), chunk_bytes_(0), direct_(false), drop_cache_(false),
+        num_pop_(0), round_begin_(0), num_end_(0),
+        running_(false), end_of_round_(false), stop_signal_(false) {
+    job_.reader = this;
+  }
+  ~ParallelPageReader(void) {
+    this->Close();
+  }
+  /*!
+   * \brief open the files and start the reader threads
+   * \param files path of the files, size of each file must be multiple of page_bytes
+   * \param page_bytes size of page in bytes, must be multiple of kAlign when direct is set
+   * \param nthread number of reader threads, which is also the number of pages read ahead
+   * \param chunk_bytes size of each read, rounded up to multiple of kAlign
+   * \param direct whether bypass page cache
+   */
+  inline void Open(const std::vector<std::string> &files, size_t page_bytes,
+                   int nthread, size_t chunk_bytes, bool direct) {
+#ifndef _MSC_VER
+    this->Close();
+    utils::Check(!direct || page_bytes % kAlign == 0,
+                 "ParallelPageReader: page size must be multiple of %lu for direct IO",
+                 static_cast<unsigned long>(kAlign));
+    page_bytes_ = page_bytes;
+    chunk_bytes_ = (chunk_bytes + kAlign - 1) / kAlign * kAlign;
+    if (chunk_bytes_ == 0) chunk_bytes_ = kAlign;
+    direct_ = direct; drop_cache_ = false;
+    for (size_t i = 0; i < files.size(); ++i) {
+      int fd = -1;
+#ifdef O_DIRECT
+      if (direct_) {
+        fd = open(files[i].c_str(), O_RDONLY | O_DIRECT);
+        if (fd == -1 && errno == EINVAL) {
+          fprintf(stderr, "ParallelPageReader: O_DIRECT is not supported for %s, "\
+                  "use buffered read and drop pages from cache\n", files[i].c_str());
+          direct_ = false; drop_cache_ = true;
+        }
+      }
+#else
+      if (direct_) {
+        direct_ = false; drop_cache_ = true;
+      }
+#endif
+      int bfd = open(files[i].c_str(), O_RDONLY);
+      utils::Check(bfd != -1, "ParallelPageReader: can not open file \"%s\"", files[i].c_str());
+      if (fd == -1) fd = bfd;
+      struct stat st;
+      utils::Check(fstat(fd, &st) == 0, "ParallelPageReader: fail to stat \"%s\"",
+                   files[i].c_str());
+      utils::Check(static_cast<size_t>(st.st_size) % page_bytes_ == 0,
+                   "ParallelPageReader: size of %s is not multiple of page size",
+                   files[i].c_str());
+      fds_.push_back(fd);
+      bfds_.push_back(bfd);
+      npages_.push_back(static_cast<size_t>(st.st_size) / page_bytes_);
+    }
+    ring_.Init(nthread);
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      ring_[i].buffer = AllocBuffer(page_bytes_);
+    }
+    pool_.Init(nthread, &job_);
+#else
+    utils::Error("ParallelPageReader: not supported on this platform");
+#endif
+  }
+  /*! \brief stop the reader threads and close all the files */
+  inline void Close(void) {
+    if (running_) this->StopRound();
+    pool_.Destroy();
+    for (int i = 0; i < ring_.capacity(); ++i) {
+      FreeBuffer(ring_[i].buffer);
+    }
+    ring_.Destroy();
+#ifndef _MSC_VER
+    for (size_t i = 0; i < fds_.size(); ++i) {
+      if (fds_[i] != bfds_[i]) close(fds_[i]);
+      close(bfds_[i]);
+    }
+#endif
+    fds_.clear();
+    bfds_.clear();
+    npages_.clear();
+  }
+  /*! \return number of pages in fid-th file */
+  inline size_t NumPage(size_t fid) const {
+    return npages_[fid];
+  }
+  /*!
+   * \brief start a round that reads all pages of the files in the given order,
+   *   the pages of last round that are not taken are dropped
+   * \param order index of the files in the order to be read
+   */
+  inline void BeforeFirst(const std::vector<size_t> &order) {
+    if (running_) this->StopRound();
+    sched_.clear();
+    for (size_t i = 0; i < order.size(); ++i) {
+      for (size_t page = 0; page < npages_[order[i]]; ++page) {
+        sched_.push_back(PagePos(order[i], page));
+      }
+    }
+    // all tickets of last round are popped, tickets of this round start from here
+    round_begin_ = num_pop_;
+    num_end_ = 0;
+    end_of_round_ = false;
+    running_ = true;
+    pool_.Start();
+  }
+  /*!
+   * \brief take next page of the round, block until it is read
+   * \param pbuf points to buffer of page_bytes allocated by AllocBuffer, the buffer is
+   *   swapped with the one that holds the page, so the page is handed over without copy
+   * \param fid stores index of file of the page
+   * \param page stores index of the page in the file
+   * \return false if all pages of the round are taken
+   */
+  inline bool Next(void **pbuf, size_t *fid, size_t *page) {
+    if (end_of_round_) return false;
+    int slot = this->PopSlot();
+    if (slot == -1) return false;
+    PageSlot &e = ring_[slot];
+    std::swap(*pbuf, e.buffer);
+    *fid = e.pos.first; *page = e.pos.second;
+    ring_.EndPop(slot);
+    return true;
+  }
+  /*! \brief allocate buffer that can be used as destination of direct read */
+  inline static void *AllocBuffer(size_t bytes) {
+    void *ptr = NULL;
+#ifndef _MSC_VER
+    utils::Check(posix_memalign(&ptr, kAlign, bytes) == 0,
+                 "ParallelPageReader: fail to allocate buffer, out of space");
+#else
+    ptr = malloc(bytes);
+    utils::Check(ptr != NULL, "ParallelPageReader: fail to allocate buffer, out of space");
+#endif
+    return ptr;
+  }
+  /*! \brief free buffer allocated by AllocBuffer */
+  inline static void FreeBuffer(void *ptr) {
+    free(ptr);
+  }
+
+ private:
+  /*! \brief file index and page index */
+  typedef std::pair<size_t, size_t> PagePos;
+  /*! \brief page in ring */
+  struct PageSlot {
+    // position of the page
+    PagePos pos;
+    // aligned buffer of page
+    void *buffer;
+    PageSlot(void) : buffer(NULL) {}
+  };
+  /*! \brief job of reader threads, each thread reads pages until end of round */
+  struct ReadJob {
+    ParallelPageReader *reader;
+    inline void operator()(int tid, int nthread) {
+      reader->RunWorker();
+    }
+  };
+  // take tickets and read pages of current round, push one end mark when done
+  inline void RunWorker(void) {
+    while (true) {
+      unsigned long ticket;
+      int slot = ring_.BeginPush(&ticket);
+      const size_t pos = ticket - round_begin_;
+      if (stop_signal_ || pos >= sched_.size()) {
+        ring_.EndPush(slot, true); return;
+      }
+      ring_[slot].pos = sched_[pos];
+      this->ReadPage(sched_[pos], static_cast<char*>(ring_[slot].buffer));
+      ring_.EndPush(slot);
+    }
+  }
+  // pop next slot of ring, return -1 if it is an end mark
+  inline int PopSlot(void) {
+    int slot = ring_.BeginPop();
+    num_pop_ += 1;
+    if (ring_.IsEnd(slot)) {
+      ring_.EndPop(slot);
+      num_end_ += 1;
+      end_of_round_ = true;
+      return -1;
+    }
+    return slot;
+  }
+  // stop the reader threads, drop the pages read, until every thread pushed its end mark
+  inline void StopRound(void) {
+    stop_signal_ = true;
+    while (num_end_ < pool_.nthread()) {
+      int slot = this->PopSlot();
+      if (slot != -1) ring_.EndPop(slot);
+    }
+    pool_.Wait();
+    stop_signal_ = false;
+    running_ = false;
+  }
+  // read a whole page into dst, by reads of chunk_bytes
+  inline void ReadPage(const PagePos &pos, char *dst) {
+#ifndef _MSC_VER
+    const size_t offset = pos.second * page_bytes_;
+    for (size_t begin = 0; begin < page_bytes_; begin += chunk_bytes_) {
+      const size_t end = std::min(begin + chunk_bytes_, page_bytes_);
+      int fd = fds_[pos.first];
+      size_t ptr = begin;
+      while (ptr < end) {
+        ssize_t n = pread(fd, dst + ptr, end - ptr, offset + ptr);
+        if (n == -1 && errno == EINTR) continue;
+        utils::Check(n > 0, "ParallelPageReader: fail to read page, errno=%d", errno);
+        ptr += n;
+        // a short direct read can stop at an unaligned position, from which
+        // O_DIRECT refuses to read, so the rest of chunk is read without it
+        if (ptr % kAlign != 0) fd = bfds_[pos.first];
+      }
+    }
+#if defined(POSIX_FADV_DONTNEED)
+    if (drop_cache_) {
+      posix_fadvise(fds_[pos.first], offset, page_bytes_, POSIX_FADV_DONTNEED);
+    }
+#endif
+#endif
+  }
+  // size of page
+  size_t page_bytes_;
+  // size of each read
+  size_t chunk_bytes_;
+  // whether the files are opened with O_DIRECT
+  bool direct_;
+  // whether drop pages from page cache after read, used when direct IO is not supported
+  bool drop_cache_;
+  // file descriptor of each file, opened with O_DIRECT in direct IO
+  std::vector<int> fds_;
+  // buffered file descriptor of each file, same as fds_ if direct IO is not used
+  std::vector<int> bfds_;
+  // number of pages of each file
+  std::vector<size_t> npages_;
+  // pages to be read in current round
+  std::vector<PagePos> sched_;
+  // ring that puts the pages read by threads back in order
+  ThreadRing<PageSlot> ring_;
+  // number of slots popped so far, equals to number of tickets taken when threads are idle
+  unsigned long num_pop_;
+  // first ticket of current round
+  unsigned long round_begin_;
+  // number of end marks popped in current round
+  int num_end_;
+  // whether threads are running a round
+  bool running_;
+  // whether consumer reaches end of round
+  bool end_of_round_;
+  // signal threads to stop current round
+  volatile bool stop_signal_;
+  // job and reader threads
+  ReadJob job_;
+  ThreadPool<ReadJob> pool_;
+};
+}  // namespace utils
+}  // namespace cxxnet
+#endif  // CXXNET_UTILS_PAGE_READER_H_
@@ -8,6 +8,7 @@
 #include <cstdlib>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include "./utils.h"
 
 namespace cxxnet {
@@ -50,6 +51,98 @@ class RandomSampler {
  private:
   unsigned rseed_;
 };
+/*!
+ * \brief counter based random number generator, Philox4x32-10. The numbers are a pure function
+ *   of key (seed, epoch) and counter (index, position), so streams of different instances can be
+ *   generated in any order by any thread, and the result does not depend on scheduling
+ */
+class PhiloxSampler {
+ public:
+  PhiloxSampler(void) {
+    this->Seed(0, 0, 0);
+  }
+  /*!
+   * \brief seed random number, same as Seed(seed, 0, 0)
+   * \param seed the random number seed
+   */
+  inline void Seed(unsigned seed) {
+    this->Seed(seed, 0, 0);
+  }
+  /*!
+   * \brief start the stream of an instance
+   * \param seed the random number seed
+   * \param epoch round of data
+   * \param index index of instance
+   */
+  inline void Seed(uint32_t seed, uint32_t epoch, uint32_t index) {
+    key_[0] = seed; key_[1] = epoch;
+    ctr_[0] = 0; ctr_[1] = 0;
+    ctr_[2] = index; ctr_[3] = 0;
+    nleft_ = 0;
+  }
+  /*! \brief return a random 32-bit number */
+  inline uint32_t NextUInt32(void) {
+    if (nleft_ == 0) {
+      this->Generate(ctr_, buf_);
+      this->Step();
+      nleft_ = 4;
+    }
+    return buf_[--nleft_];
+  }
+  /*! \brief return a real number uniform in [0,1) */
+  inline double NextDouble(void) {
+    return this->NextUInt32() * (1.0 / 4294967296.0);
+  }
+  /*! \brief return a random number in n */
+  inline uint32_t NextUInt32(uint32_t n) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(this->NextUInt32()) * n) >> 32);
+  }
+  /*! \brief random shuffle data */
+  template<typename T>
+  inline void Shuffle(T *data, size_t sz) {
+    if(sz == 0) return;
+    for(uint32_t i = (uint32_t)sz - 1; i > 0; i--) {
+      std::swap(data[i], data[NextUInt32(i+1)]);
+    }
+  }
+  /*!\brief random shuffle data in */
+  template<typename T>
+  inline void Shuffle(std::vector<T> &data) {
+    Shuffle(&data[0], data.size());
+  }
+
+ private:
+  // compute one block of 4 numbers from counter and key
+  inline void Generate(const uint32_t ctr[4], uint32_t out[4]) const {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key_[0], k1 = key_[1];
+    for (int r = 0; r < 10; ++r) {
+      uint64_t p0 = static_cast<uint64_t>(kMul0) * c0;
+      uint64_t p1 = static_cast<uint64_t>(kMul1) * c2;
+      uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+      uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+      c0 = hi1 ^ c1 ^ k0; c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1; c3 = lo0;
+      k0 += kWeyl0; k1 += kWeyl1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+  }
+  // move to next block of the stream
+  inline void Step(void) {
+    if (++ctr_[0] == 0) ++ctr_[1];
+  }
+  // multipliers and key increments of Philox4x32
+  static const uint32_t kMul0 = 0xD2511F53U;
+  static const uint32_t kMul1 = 0xCD9E8D57U;
+  static const uint32_t kWeyl0 = 0x9E3779B9U;
+  static const uint32_t kWeyl1 = 0xBB67AE85U;
+  // key and counter of next block
+  uint32_t key_[2];
+  uint32_t ctr_[4];
+  // numbers of current block not used yet
+  uint32_t buf_[4];
+  int nleft_;
+};
 }  // namespace utils
 }  // namespace cxxnet
 #endif
@@ -17,7 +17,7 @@ namespace utils {
 class Semaphore {
  public :
   inline void Init(int init_val) {
-    sem = CreateSemaphore(NULL, init_val, 10, NULL);
+    sem = CreateSemaphore(NULL, init_val, kMaxCount, NULL);
     utils::Assert(sem != NULL, "create Semaphore error");
   }
   inline void Destroy(void) {
@@ -26,11 +26,15 @@ class Semaphore {
   inline void Wait(void) {
     utils::Assert(WaitForSingleObject(sem, INFINITE) == WAIT_OBJECT_0, "WaitForSingleObject error");
   }
+  inline bool TryWait(void) {
+    return WaitForSingleObject(sem, 0) == WAIT_OBJECT_0;
+  }
   inline void Post(void) {
     utils::Assert(ReleaseSemaphore(sem, 1, NULL)  != 0, "ReleaseSemaphore error");
   }
  private:
   HANDLE sem;
+  static const LONG kMaxCount = 1 << 30;
 };
 /*! \brief simple thread that wraps windows thread */
 class Thread {
@@ -50,6 +54,10 @@ class Thread {
 inline void ThreadExit(void *status) {
   _endthreadex(0);
 }
+/*! \brief atomically add val to *ptr, return the value before addition */
+inline long AtomicFetchAdd(volatile long *ptr, long val) {
+  return InterlockedExchangeAdd(ptr, val);
+}
 #define CXXNET_THREAD_PREFIX unsigned int __stdcall
 }  // namespace utils
 }  // namespace cxxnet
@@ -99,6 +107,9 @@ class Semaphore {
   inline void Wait(void) {
     sem_wait(semPtr);
   }
+  inline bool TryWait(void) {
+    return sem_trywait(semPtr) == 0;
+  }
   inline void Post(void) {
     sem_post(semPtr);
   }               
@@ -115,6 +126,9 @@ class Semaphore {
   inline void Wait(void) {
     sem_wait(&sem);
   }
+  inline bool TryWait(void) {
+    return sem_trywait(&sem) == 0;
+  }
   inline void Post(void) {
     sem_post(&sem);
   }
@@ -139,6 +153,10 @@ class Thread {
 inline void ThreadExit(void *status) {
   pthread_exit(status);
 }
+/*! \brief atomically add val to *ptr, return the value before addition */
+inline long AtomicFetchAdd(volatile long *ptr, long val) {
+  return __sync_fetch_and_add(ptr, val);
+}
 }  // namespace utils
 }  // namespace cxxnet
 #define CXXNET_THREAD_PREFIX void *
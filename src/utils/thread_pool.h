@@ -0,0 +1,116 @@
+#ifndef CXXNET_UTILS_THREAD_POOL_H_
+#define CXXNET_UTILS_THREAD_POOL_H_
+/*!
+ * \file thread_pool.h
+ * \brief a fixed group of worker threads that run one job in fork-join style,
+ *   used to split a chunk of work (e.g. decoding) across threads
+ */
+#include <vector>
+#include "./utils.h"
+#include "./thread.h"
+
+namespace cxxnet {
+namespace utils {
+/*!
+ * \brief fork-join thread pool, every call of Run wakes up all workers,
+ *   each worker calls job(tid, nthread) once, and Run returns when all of them finish
+ * \tparam Job job type, must implement void operator()(int tid, int nthread)
+ */
+template<typename Job>
+class ThreadPool {
+ public:
+  ThreadPool(void) : job_(NULL), destroy_signal_(false) {}
+  ~ThreadPool(void) {
+    this->Destroy();
+  }
+  /*!
+   * \brief start nthread workers that runs job
+   * \param nthread number of worker threads
+   * \param job the job to be executed, must be alive during the lifetime of pool
+   */
+  inline void Init(int nthread, Job *job) {
+    utils::Assert(workers_.size() == 0, "ThreadPool: can only be initialized once");
+    utils::Check(nthread > 0, "ThreadPool: number of threads must be positive");
+    job_ = job;
+    destroy_signal_ = false;
+    for (int i = 0; i < nthread; ++i) {
+      workers_.push_back(new Worker());
+      workers_[i]->pool = this;
+      workers_[i]->tid = i;
+      workers_[i]->job_start.Init(0);
+      workers_[i]->job_end.Init(0);
+      workers_[i]->thread.Start(WorkerEntry, workers_[i]);
+    }
+  }
+  /*! \brief run job on all workers, block until all of them are done */
+  inline void Run(void) {
+    this->Start();
+    this->Wait();
+  }
+  /*!
+   * \brief start job on all workers without waiting, used when the caller consumes
+   *   the output of the job while it is running, must be followed by Wait
+   */
+  inline void Start(void) {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->job_start.Post();
+    }
+  }
+  /*! \brief wait until the job started by Start is done on all workers */
+  inline void Wait(void) {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->job_end.Wait();
+    }
+  }
+  /*! \brief shutdown all the worker threads */
+  inline void Destroy(void) {
+    if (workers_.size() == 0) return;
+    destroy_signal_ = true;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->job_start.Post();
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->thread.Join();
+      workers_[i]->job_start.Destroy();
+      workers_[i]->job_end.Destroy();
+      delete workers_[i];
+    }
+    workers_.clear();
+  }
+  /*! \return number of worker threads */
+  inline int nthread(void) const {
+    return static_cast<int>(workers_.size());
+  }
+
+ private:
+  /*! \brief context of each worker */
+  struct Worker {
+    ThreadPool<Job> *pool;
+    int tid;
+    Semaphore job_start, job_end;
+    Thread thread;
+  };
+  inline void RunWorker(Worker *w) {
+    while (true) {
+      w->job_start.Wait();
+      if (destroy_signal_) break;
+      (*job_)(w->tid, static_cast<int>(workers_.size()));
+      w->job_end.Post();
+    }
+  }
+  inline static CXXNET_THREAD_PREFIX WorkerEntry(void *pworker) {
+    Worker *w = static_cast<Worker*>(pworker);
+    w->pool->RunWorker(w);
+    ThreadExit(NULL);
+    return NULL;
+  }
+  // job to be executed
+  Job *job_;
+  // signal to kill the threads
+  bool destroy_signal_;
+  // worker threads
+  std::vector<Worker*> workers_;
+};
+}  // namespace utils
+}  // namespace cxxnet
+#endif  // CXXNET_UTILS_THREAD_POOL_H_
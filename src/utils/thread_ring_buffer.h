@@ -0,0 +1,336 @@
+#ifndef CXXNET_UTILS_THREAD_RING_BUFFER_H_
+#define CXXNET_UTILS_THREAD_RING_BUFFER_H_
+/*!
+ * \file thread_ring_buffer.h
+ * \brief ring buffer that hands elements from producer to consumer one by one,
+ *   and a buffered loading iterator built on it, can be used to create parallel pipeline
+ */
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include "./utils.h"
+#include "./thread.h"
+#include "./timer.h"
+#include "./io_profiler.h"
+
+namespace cxxnet {
+namespace utils {
+/*!
+ * \brief bounded ring of preallocated elements, each element is handed over
+ *   as soon as it is ready, instead of waiting for a whole buffer to be filled.
+ *   There is only one consumer, there can be multiple producers. Elements are popped
+ *   in the order of the tickets that producers get in BeginPush, so multiple producers
+ *   can fill elements out of order and the ring puts them back in order
+ * \tparam Elem element type
+ */
+template<typename Elem>
+class ThreadRing {
+ public:
+  ThreadRing(void) : push_ticket_(0), num_ready_(0), pop_ticket_(0), wait_time_(0.0) {}
+  ~ThreadRing(void) {
+    this->Destroy();
+  }
+  /*!
+   * \brief initialize the ring
+   * \param capacity number of elements in the ring
+   */
+  inline void Init(int capacity) {
+    utils::Assert(slots_.size() == 0, "ThreadRing: can only be initialized once");
+    utils::Check(capacity > 0, "ThreadRing: capacity must be positive");
+    for (int i = 0; i < capacity; ++i) {
+      slots_.push_back(new Slot());
+      slots_[i]->ready.Init(0);
+      slots_[i]->end = false;
+    }
+    free_.Init(capacity);
+    push_ticket_ = 0; num_ready_ = 0; pop_ticket_ = 0;
+    wait_time_ = 0.0;
+  }
+  /*! \brief free the ring, the elements need to be freed by caller beforehand */
+  inline void Destroy(void) {
+    if (slots_.size() != 0) free_.Destroy();
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i]->ready.Destroy();
+      delete slots_[i];
+    }
+    slots_.clear();
+  }
+  /*! \return number of elements in the ring */
+  inline int capacity(void) const {
+    return static_cast<int>(slots_.size());
+  }
+  /*! \brief get element in slot */
+  inline Elem &operator[](int slot) {
+    return slots_[slot]->elem;
+  }
+  /*!
+   * \brief producer: wait until a free slot is available, can be called by multiple producers
+   * \param ticket if not NULL, stores the ticket of the slot, i.e. the number of pushes before it,
+   *   the element of ticket t is popped right after the element of ticket t - 1
+   * \return the slot to be filled
+   */
+  inline int BeginPush(unsigned long *ticket = NULL) {
+    // the ticket is taken after a slot is freed, so slot of ticket t is
+    // never taken while the element of ticket t - capacity is still in use
+    free_.Wait();
+    unsigned long t = static_cast<unsigned long>(AtomicFetchAdd(&push_ticket_, 1));
+    if (ticket != NULL) *ticket = t;
+    return static_cast<int>(t % slots_.size());
+  }
+  /*!
+   * \brief producer: hand the filled slot to the consumer
+   * \param slot the slot returned by BeginPush
+   * \param end whether the slot marks end of data instead of holding an element
+   */
+  inline void EndPush(int slot, bool end = false) {
+    slots_[slot]->end = end;
+    AtomicFetchAdd(&num_ready_, 1);
+    slots_[slot]->ready.Post();
+  }
+  /*!
+   * \brief consumer: wait until next slot is filled, time spent in waiting is recorded
+   * \return the slot to be consumed
+   */
+  inline int BeginPop(void) {
+    int slot = static_cast<int>(pop_ticket_ % slots_.size());
+    ++pop_ticket_;
+    if (!slots_[slot]->ready.TryWait()) {
+      double start = GetTime();
+      slots_[slot]->ready.Wait();
+      wait_time_ += GetTime() - start;
+    }
+    return slot;
+  }
+  /*!
+   * \brief consumer: number of filled slots that are not popped yet, can be called
+   *   before BeginPop to sample how full the ring is
+   */
+  inline int size(void) const {
+    return static_cast<int>(num_ready_ - static_cast<long>(pop_ticket_));
+  }
+  /*! \brief consumer: whether the slot marks end of data */
+  inline bool IsEnd(int slot) const {
+    return slots_[slot]->end;
+  }
+  /*! \brief consumer: give the slot back to producers */
+  inline void EndPop(int slot) {
+    free_.Post();
+  }
+  /*! \return total time in seconds consumer spent in waiting for producers */
+  inline double wait_time(void) const {
+    return wait_time_;
+  }
+
+ private:
+  /*! \brief a slot of element */
+  struct Slot {
+    Elem elem;
+    // whether the slot marks end of data
+    bool end;
+    // signals whether the slot is filled
+    Semaphore ready;
+  };
+  // slots of the ring
+  std::vector<Slot*> slots_;
+  // number of free slots, slots are freed in the order they are popped
+  Semaphore free_;
+  // ticket of next push, shared by producers
+  volatile long push_ticket_;
+  // number of pushes ended, shared by producers
+  volatile long num_ready_;
+  // ticket of next pop
+  unsigned long pop_ticket_;
+  // accumulated waiting time of consumer
+  double wait_time_;
+};
+
+/*!
+ * \brief buffered loading iterator that uses multithread, the interface is same as ThreadBuffer,
+ *   the loader fills a ring of 2 * buffer_size elements, and each element can be
+ *   consumed as soon as it is loaded
+ * \tparam Elem elememt type to be buffered
+ * \tparam ElemFactory factory type to implement in order to use thread buffer
+ */
+template<typename Elem, typename ElemFactory>
+class ThreadRingBuffer {
+ public:
+  /*!\brief constructor */
+  ThreadRingBuffer(void) {
+    this->init_end = false;
+    this->buf_size = 30;
+    this->stage_name = "ThreadRingBuffer";
+    this->stage = NULL;
+  }
+  ~ThreadRingBuffer(void) {
+    if (init_end) this->Destroy();
+  }
+  /*!\brief set parameter, will also pass the parameter to factory */
+  inline void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "buffer_size")) buf_size = atoi(val);
+    factory.SetParam(name, val);
+  }
+  /*!
+   * \brief initalize the buffered iterator
+   * \return false if the initlization can't be done, e.g. buffer file hasn't been created
+   */
+  inline bool Init(void) {
+    if (!factory.Init()) return false;
+    ring.Init(buf_size * 2);
+    for (int i = 0; i < ring.capacity(); ++i) {
+      ring[i] = factory.Create();
+    }
+    stage = IOProfiler::Get()->Register(stage_name);
+    stage->queue_capacity = ring.capacity();
+    this->init_end = true;
+    this->StartLoader();
+    return true;
+  }
+  /*!\brief place the iterator before first value */
+  inline void BeforeFirst(void) {
+    // stop the loader, drop the elements that are already loaded
+    this->StopLoader();
+    ring.EndPop(cur_slot);
+    // loader is waiting, critical zone
+    factory.BeforeFirst();
+    end_of_data = false;
+    cur_slot = -1;
+    loading_need.Post();
+  }
+  /*! \brief destroy the buffer iterator, will deallocate the buffer */
+  inline void Destroy(void) {
+    if (init_end) {
+      this->StopLoader();
+      destroy_signal = true;
+      loading_need.Post();
+      loader_thread.Join();
+      loading_need.Destroy();
+      for (int i = 0; i < ring.capacity(); ++i) {
+        factory.FreeSpace(ring[i]);
+      }
+      ring.Destroy();
+    }
+    factory.Destroy();
+    this->init_end = false;
+  }
+  /*!
+   * \brief get the next element needed in buffer,
+   *   the element is valid until next call of Next or BeforeFirst
+   * \param elem element to store into
+   * \return whether reaches end of data
+   */
+  inline bool Next(Elem &elem) {
+    if (!this->PopSlot()) return false;
+    elem = ring[cur_slot];
+    return true;
+  }
+  /*! \return total time in seconds the consumer spent in waiting for the loader */
+  inline double wait_time(void) const {
+    return ring.wait_time();
+  }
+  /*!
+   * \brief set name of the loader in the report of IOProfiler, must be called before Init
+   * \param name name of stage, must be a string literal
+   */
+  inline void set_stage_name(const char *name) {
+    stage_name = name;
+  }
+  /*!
+   * \brief get the factory object
+   */
+  inline ElemFactory &get_factory(void) {
+    return factory;
+  }
+  inline const ElemFactory &get_factory(void) const{
+    return factory;
+  }
+  // size of buffer
+  int  buf_size;
+
+ private:
+  // factory object used to load configures
+  ElemFactory factory;
+  // ring of the loaded elements
+  ThreadRing<Elem> ring;
+  // slot held by consumer, -1 if none
+  int cur_slot;
+  // whether consumer reaches end of data
+  bool end_of_data;
+  // initialization end
+  bool init_end;
+  // signal to stop loading current round of data
+  volatile bool stop_signal;
+  // signal to kill the thread
+  volatile bool destroy_signal;
+  // thread object
+  Thread loader_thread;
+  // signal to start loading a round of data
+  Semaphore loading_need;
+  // name of loader in profiling report
+  const char *stage_name;
+  // profiling counters of loader and ring
+  IOStage *stage;
+  /*!
+   * \brief slave thread
+   * this implementation is like producer-consumer style
+   */
+  inline void RunLoader(void) {
+    while (true) {
+      // sleep until loading is needed
+      loading_need.Wait();
+      if (destroy_signal) break;
+      IOStageTimer timer(stage);
+      while (true) {
+        int slot = ring.BeginPush();
+        timer.Wait();
+        bool loaded = !stop_signal && factory.LoadNext(ring[slot]);
+        timer.Busy(loaded ? 1 : 0);
+        ring.EndPush(slot, !loaded);
+        if (!loaded) break;
+      }
+    }
+  }
+  /*!\brief entry point of loader thread */
+  inline static CXXNET_THREAD_PREFIX LoaderEntry(void *pthread) {
+    static_cast< ThreadRingBuffer<Elem,ElemFactory>* >(pthread)->RunLoader();
+    ThreadExit(NULL);
+    return NULL;
+  }
+  /*!\brief start loader thread */
+  inline void StartLoader(void) {
+    destroy_signal = false;
+    stop_signal = false;
+    end_of_data = false;
+    cur_slot = -1;
+    loading_need.Init(1);
+    loader_thread.Start(LoaderEntry, this);
+  }
+  /*!\brief move to next slot, return false if reaches end of data */
+  inline bool PopSlot(void) {
+    if (end_of_data) return false;
+    if (cur_slot != -1) ring.EndPop(cur_slot);
+    if (IOProfiler::Get()->enabled()) {
+      double start = GetTime();
+      stage->queue_fill += ring.size();
+      stage->queue_samples += 1;
+      cur_slot = ring.BeginPop();
+      stage->starve_time += GetTime() - start;
+    } else {
+      cur_slot = ring.BeginPop();
+    }
+    if (ring.IsEnd(cur_slot)) {
+      // keep the end mark, so that the loader waits for next round
+      end_of_data = true; return false;
+    }
+    return true;
+  }
+  /*!\brief stop the loader of current round, after this, consumer holds the end mark */
+  inline void StopLoader(void) {
+    if (end_of_data) return;
+    stop_signal = true;
+    while (this->PopSlot()) {}
+    stop_signal = false;
+  }
+};
+}  // namespace utils
+}  // namespace cxxnet
+#endif  // CXXNET_UTILS_THREAD_RING_BUFFER_H_
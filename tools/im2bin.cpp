@@ -1,19 +1,32 @@
 #include "src/utils/io.h"
 #include <cstdio>
+#include <ctime>
 #include <string>
 #include <vector>
 
+// save page, compressed when level is not 0
+inline void SavePage(cxxnet::utils::BinaryPage &pg, cxxnet::utils::IStream &fo, int level) {
+    if (level != 0) {
+        pg.SaveCompressed(fo, level);
+    } else {
+        pg.Save(fo);
+    }
+}
+
 int main(int argc, char **argv) {
     using namespace cxxnet::utils;
-    if (argc != 4) {
-        fprintf(stderr, "Usage: imbin image.lst image_root_dir output_file\n");
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "Usage: imbin image.lst image_root_dir output_file [compress_level]\n"\
+                "compress_level: 1-9, compress each page with zlib, default 0 means no compression\n");
         exit(-1);
     }
+    int compress_level = argc > 4 ? atoi(argv[4]) : 0;
     char fname[ 256 ];
     unsigned int index = 0;
     float label = 0.0f;
     std::string root_path = argv[2];
     BinaryPage pg;
+    BinaryPageIndex pgindex;
 
     StdFile writer(argv[3], "wb");
     std::vector<unsigned char> buf( BinaryPage::kPageSize * sizeof(int), 0 );
@@ -41,7 +54,8 @@ int main(int argc, char **argv) {
 
         ++ imcnt;
         if (!pg.Push(fobj)) {
-            pg.Save(writer);
+            pgindex.AddPage(pgcnt, pg);
+            SavePage(pg, writer, compress_level);
             pg.Clear();
             if( !pg.Push(fobj) ){
                 fprintf( stderr, "image %s is too large to fit into a single page, considering increase kPageSize\n", path.c_str() );
@@ -57,11 +71,24 @@ int main(int argc, char **argv) {
         }
     }
     if( pg.Size() != 0 ){
-        pg.Save(writer);
+        pgindex.AddPage(pgcnt, pg);
+        SavePage(pg, writer, compress_level);
         pgcnt += 1;
     }
     elapsed = (long)(time(NULL) - start);
     printf("\nfinished [%8lu] images processed to %lu pages, %ld sec elapsed\n", imcnt, pgcnt, elapsed );
     writer.Close();
+    std::string path_idx = std::string(argv[3]) + ".idx";
+    if (compress_level != 0) {
+        // records of compressed pages can not be located by offset,
+        // remove the index of an earlier output so that it is not used
+        std::remove(path_idx.c_str());
+        printf("pages are compressed, offset index is not created\n");
+        return 0;
+    }
+    // record offset index, used for random access of records
+    StdFile fidx(path_idx.c_str(), "wb");
+    pgindex.Save(fidx, argv[3]);
+    fidx.Close();
     return 0;
 }
@@ -0,0 +1,275 @@
+// multithreaded packer of image binary, images are read and optionally resized
+// by a pool of threads, and written into shards balanced by bytes written,
+// with the list, binary label and offset index of each shard written in the same pass
+#include "src/utils/io.h"
+#include "src/utils/thread_pool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#if CXXNET_USE_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+using namespace cxxnet::utils;
+
+// one line of image list
+struct Record {
+    unsigned index;
+    std::vector<float> label;
+    std::string path;
+    std::string line;
+};
+
+// options of packer
+struct Option {
+    int nthread;
+    int resize;
+    int quality;
+    int label_width;
+    int compress;
+    size_t shard_bytes;
+    Option(void) : nthread(8), resize(0), quality(95), label_width(1),
+                   compress(0), shard_bytes(256UL << 20UL) {}
+};
+
+// job to read a chunk of records, record i is read by thread i % nthread
+struct ReadJob {
+    const Option *opt;
+    std::string root;
+    const Record *rec;
+    size_t count;
+    std::vector< std::vector<unsigned char> > data;
+    inline void operator()(int tid, int nthread) {
+        for (size_t i = tid; i < count; i += nthread) {
+            std::string path = root + rec[i].path;
+            StdFile reader(path.c_str(), "rb");
+            data[i].resize(reader.Size());
+            if (data[i].size() != 0) reader.Read(&data[i][0], data[i].size());
+            reader.Close();
+            if (opt->resize != 0) this->Resize(path, &data[i]);
+        }
+    }
+    // downscale the image so that its short side is opt->resize, and encode it as jpeg
+    inline void Resize(const std::string &path, std::vector<unsigned char> *buf) {
+#if CXXNET_USE_OPENCV
+        cv::Mat img = cv::imdecode(*buf, CV_LOAD_IMAGE_UNCHANGED);
+        Check(img.data != NULL, "fail to decode image %s", path.c_str());
+        if (img.channels() == 4) cv::cvtColor(img, img, CV_BGRA2BGR);
+        int short_side = std::min(img.rows, img.cols);
+        // images that are small enough are kept as they are
+        if (short_side <= opt->resize) return;
+        double scale = static_cast<double>(opt->resize) / short_side;
+        cv::Mat res;
+        cv::resize(img, res, cv::Size(static_cast<int>(img.cols * scale + 0.5),
+                                      static_cast<int>(img.rows * scale + 0.5)),
+                   0, 0, cv::INTER_AREA);
+        std::vector<int> param;
+        param.push_back(CV_IMWRITE_JPEG_QUALITY);
+        param.push_back(opt->quality);
+        Check(cv::imencode(".jpg", res, *buf, param), "fail to encode image %s", path.c_str());
+#else
+        Error("im2binx: resize requires OpenCV, build with USE_OPENCV=1");
+#endif
+    }
+};
+
+// writer of the shards, a new shard is started once the binary file reaches shard_bytes,
+// so shards of compressed pages, which differ in size, are balanced by bytes
+class ShardWriter {
+ public:
+    ShardWriter(const char *pattern, const Option &opt)
+        : pattern_(pattern), opt_(opt), nshard_(0), npage_(0), nrec_(0),
+          fbin_(NULL), flbl_(NULL), flst_(NULL) {}
+    ~ShardWriter(void) {
+        this->CloseShard();
+    }
+    inline void Push(const Record &r, const std::vector<unsigned char> &data) {
+        BinaryPage::Obj obj(const_cast<unsigned char*>(data.size() != 0 ? &data[0] : NULL),
+                            data.size());
+        if (fbin_ == NULL) this->OpenShard();
+        if (!page_.Push(obj)) {
+            this->FlushPage();
+            if (fbin_->Tell() >= opt_.shard_bytes) {
+                this->CloseShard();
+                this->OpenShard();
+            }
+            Check(page_.Push(obj), "image %s is too large to fit into a single page", r.path.c_str());
+        }
+        uint32_t idx = r.index;
+        flbl_->Write(&idx, sizeof(idx));
+        flbl_->Write(&r.label[0], sizeof(float) * r.label.size());
+        fputs(r.line.c_str(), flst_);
+        nrec_ += 1;
+    }
+    inline void Finish(void) {
+        this->CloseShard();
+    }
+    inline int NumShard(void) const {
+        return nshard_;
+    }
+
+ private:
+    inline std::string Name(const char *ext) const {
+        std::string tmp;
+        tmp.resize(pattern_.length() + 30);
+        sprintf(&tmp[0], pattern_.c_str(), nshard_);
+        tmp.resize(strlen(tmp.c_str()));
+        return tmp + ext;
+    }
+    inline void OpenShard(void) {
+        nshard_ += 1;
+        npage_ = 0; nrec_ = 0;
+        page_.Clear();
+        index_.entry.clear();
+        fbin_ = new StdFile(this->Name(".bin").c_str(), "wb");
+        flbl_ = new StdFile(this->Name(".lbl").c_str(), "wb");
+        // header is rewritten when number of records is known
+        BinaryLabelFile::WriteHeader(*flbl_, opt_.label_width, 0);
+        flst_ = FopenCheck(this->Name(".lst").c_str(), "w");
+    }
+    inline void FlushPage(void) {
+        index_.AddPage(static_cast<uint32_t>(npage_), page_);
+        if (opt_.compress != 0) {
+            page_.SaveCompressed(*fbin_, opt_.compress);
+        } else {
+            page_.Save(*fbin_);
+        }
+        page_.Clear();
+        npage_ += 1;
+    }
+    inline void CloseShard(void) {
+        if (fbin_ == NULL) return;
+        if (page_.Size() != 0) this->FlushPage();
+        const size_t nbytes = fbin_->Tell();
+        delete fbin_; fbin_ = NULL;
+        flbl_->Seek(0);
+        BinaryLabelFile::WriteHeader(*flbl_, opt_.label_width, nrec_);
+        delete flbl_; flbl_ = NULL;
+        fclose(flst_); flst_ = NULL;
+        // records of compressed pages can not be located by offset,
+        // remove the index of an earlier output so that it is not used
+        std::string path_idx = this->Name(".bin") + ".idx";
+        if (opt_.compress == 0) {
+            StdFile fidx(path_idx.c_str(), "wb");
+            index_.Save(fidx, this->Name(".bin").c_str());
+        } else {
+            std::remove(path_idx.c_str());
+        }
+        printf("\nshard %s: %lu images in %lu pages, %lu MB\n", this->Name(".bin").c_str(),
+               (unsigned long)nrec_, (unsigned long)npage_, (unsigned long)(nbytes >> 20UL));
+    }
+    std::string pattern_;
+    const Option &opt_;
+    int nshard_;
+    size_t npage_;
+    uint64_t nrec_;
+    BinaryPage page_;
+    BinaryPageIndex index_;
+    StdFile *fbin_, *flbl_;
+    FILE *flst_;
+};
+
+// parse a line of image list: index, label_width labels, path
+inline bool ParseLine(const char *line, int label_width, Record *r) {
+    const char *p = line;
+    char *end;
+    r->index = static_cast<unsigned>(strtoul(p, &end, 10));
+    if (end == p) return false;
+    p = end;
+    r->label.resize(label_width);
+    for (int j = 0; j < label_width; ++j) {
+        r->label[j] = static_cast<float>(strtod(p, &end));
+        Check(end != p, "ImageList format:label_width=%d but only have %d labels per line",
+              label_width, j);
+        p = end;
+    }
+    while (*p == ' ' || *p == '\t') ++p;
+    r->path = p;
+    while (r->path.length() != 0 &&
+           (r->path[r->path.length() - 1] == '\n' || r->path[r->path.length() - 1] == '\r')) {
+        r->path.resize(r->path.length() - 1);
+    }
+    r->line = line;
+    if (r->line.length() == 0 || r->line[r->line.length() - 1] != '\n') r->line += '\n';
+    return r->path.length() != 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: im2binx image.lst image_root_dir output_pattern [name=value ...]\n"\
+                "pack images into image binary shards, output_pattern is a printf pattern of shard id\n"\
+                "starting from 1, e.g. data/part%%03d, each shard has .bin, .lst, .lbl and .bin.idx\n"\
+                "options:\n"\
+                "  nthread=8: number of threads to read and resize images\n"\
+                "  shard_size=256: size of each shard in MB, a shard ends with the page that reaches it\n"\
+                "  resize=0: resize images so that the short side is this value, 0 means no resize\n"\
+                "  quality=95: jpeg quality of resized images\n"\
+                "  label_width=1: number of labels of each image\n"\
+                "  compress=0: zlib compression level of pages, 0 means no compression\n");
+        exit(-1);
+    }
+    Option opt;
+    for (int i = 4; i < argc; ++i) {
+        char name[256], val[256];
+        Check(sscanf(argv[i], "%255[^=]=%255s", name, val) == 2, "invalid option %s", argv[i]);
+        if (!strcmp(name, "nthread")) opt.nthread = atoi(val);
+        if (!strcmp(name, "resize")) opt.resize = atoi(val);
+        if (!strcmp(name, "quality")) opt.quality = atoi(val);
+        if (!strcmp(name, "label_width")) opt.label_width = atoi(val);
+        if (!strcmp(name, "compress")) opt.compress = atoi(val);
+        if (!strcmp(name, "shard_size")) {
+            opt.shard_bytes = static_cast<size_t>(atoi(val)) << 20UL;
+        }
+    }
+    Check(opt.nthread > 0 && opt.label_width > 0 && opt.shard_bytes > 0,
+          "nthread, label_width and shard_size must be positive");
+
+    time_t start = time(NULL);
+    printf("create image binary shards from %s, this will take some time...\n", argv[1]);
+    // records are read in chunks, so that the list of any size can be packed
+    const size_t kChunk = static_cast<size_t>(opt.nthread) * 64;
+    std::vector<Record> chunk;
+    ReadJob job;
+    job.opt = &opt;
+    job.root = argv[2];
+    ThreadPool<ReadJob> pool;
+    pool.Init(opt.nthread, &job);
+    ShardWriter writer(argv[3], opt);
+
+    FILE *fplst = FopenCheck(argv[1], "r");
+    char line[4096];
+    unsigned long imcnt = 0;
+    bool eof = false;
+    while (!eof) {
+        chunk.clear();
+        while (chunk.size() < kChunk) {
+            if (fgets(line, sizeof(line), fplst) == NULL) {
+                eof = true; break;
+            }
+            Record r;
+            if (ParseLine(line, opt.label_width, &r)) chunk.push_back(r);
+        }
+        if (chunk.size() == 0) break;
+        job.rec = &chunk[0];
+        job.count = chunk.size();
+        job.data.resize(chunk.size());
+        pool.Run();
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            writer.Push(chunk[i], job.data[i]);
+        }
+        imcnt += chunk.size();
+        long elapsed = (long)(time(NULL) - start);
+        printf("\r                                                               \r");
+        printf("[%8lu] images processed to %d shards, %ld sec elapsed", imcnt, writer.NumShard(), elapsed);
+        fflush(stdout);
+    }
+    fclose(fplst);
+    writer.Finish();
+    long elapsed = (long)(time(NULL) - start);
+    printf("finished [%8lu] images processed to %d shards, %ld sec elapsed\n",
+           imcnt, writer.NumShard(), elapsed);
+    return 0;
+}
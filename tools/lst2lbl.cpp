@@ -0,0 +1,45 @@
+#include "src/utils/io.h"
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    using namespace cxxnet::utils;
+    if (argc != 4) {
+        fprintf(stderr, "Usage: lst2lbl image.lst label_width output_file\n");
+        exit(-1);
+    }
+    int label_width = atoi(argv[2]);
+    Check(label_width > 0, "label_width must be positive");
+    std::vector<float> label(label_width);
+    unsigned index = 0;
+
+    FILE *fplst = FopenCheck(argv[1], "r");
+    StdFile writer(argv[3], "wb");
+    // header is rewritten when number of records is known
+    BinaryLabelFile::WriteHeader(writer, label_width, 0);
+
+    time_t start = time( NULL );
+    uint64_t cnt = 0;
+    printf( "create binary label file from %s\n", argv[1] );
+    while( fscanf( fplst, "%u", &index ) == 1 ) {
+        for (int j = 0; j < label_width; ++j) {
+            Check(fscanf(fplst, "%f", &label[j]) == 1,
+                  "ImageList format:label_width=%d but only have %d labels per line",
+                  label_width, j);
+        }
+        Assert(fscanf(fplst, "%*[^\n]\n") == 0, "ignore");
+        uint32_t idx = index;
+        writer.Write(&idx, sizeof(idx));
+        writer.Write(&label[0], sizeof(float) * label_width);
+        ++ cnt;
+    }
+    writer.Seek(0);
+    BinaryLabelFile::WriteHeader(writer, label_width, cnt);
+    writer.Close();
+    fclose(fplst);
+    long elapsed = (long)(time(NULL) - start);
+    printf("finished [%8lu] records, %ld sec elapsed\n", (unsigned long)cnt, elapsed );
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "src/utils/io.h"
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// row of attach text file, ordered by instance index, then by position in file
+struct Row {
+  uint32_t index;
+  size_t pos;
+  inline bool operator<(const Row &b) const {
+    return index < b.index || (index == b.index && pos < b.pos);
+  }
+};
+
+int main(int argc, char **argv) {
+    using namespace cxxnet::utils;
+    if (argc != 3) {
+        fprintf(stderr, "Usage: txt2attbin attach.txt output_file\n"\
+                "convert the extra data file of attachtxt iterator into binary file of attachbin iterator\n");
+        exit(-1);
+    }
+    FILE *fi = FopenCheck(argv[1], "r");
+    int dim;
+    Check(fscanf(fi, "%d", &dim) == 1 && dim > 0,
+          "AttachTxt: First line should indicate the data dim.");
+    time_t start = time(NULL);
+    printf("create binary attach file from %s\n", argv[1]);
+    std::vector<Row> rows;
+    std::vector<float> data;
+    unsigned index;
+    while (fscanf(fi, "%u", &index) == 1) {
+        Row r; r.index = index; r.pos = rows.size();
+        rows.push_back(r);
+        for (int i = 0; i < dim; ++i) {
+            float tmp;
+            Check(fscanf(fi, "%f", &tmp) == 1,
+                  "AttachTxt: data do not match dimension specified");
+            data.push_back(tmp);
+        }
+    }
+    fclose(fi);
+    std::sort(rows.begin(), rows.end());
+    // the last row wins when an index appears more than once, same as attachtxt
+    std::vector<Row> uniq;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i + 1 < rows.size() && rows[i + 1].index == rows[i].index) continue;
+        uniq.push_back(rows[i]);
+    }
+    if (uniq.size() != rows.size()) {
+        printf("%lu duplicated rows are dropped\n", (unsigned long)(rows.size() - uniq.size()));
+    }
+    StdFile writer(argv[2], "wb");
+    BinaryAttachFile::WriteHeader(writer, dim, uniq.size());
+    for (size_t i = 0; i < uniq.size(); ++i) {
+        writer.Write(&uniq[i].index, sizeof(uint32_t));
+    }
+    for (size_t i = 0; i < uniq.size(); ++i) {
+        writer.Write(&data[uniq[i].pos * dim], sizeof(float) * dim);
+    }
+    writer.Close();
+    long elapsed = (long)(time(NULL) - start);
+    printf("finished [%8lu] rows, %ld sec elapsed\n", (unsigned long)uniq.size(), elapsed);
+    return 0;
+}
@@ -101,6 +101,42 @@ class DataIter:
         ret = cxnlib.CXNIOGetLabel(self.handle,
                                    oshape, ctypes.byref(ostride))
         return ctypes2numpyT(ret, [x for x in oshape], 'float32', ostride.value)
+    def push(self, data, label, extra = None, num_batch_padd = 0):
+        """copy a batch into iterator created by iter=external,
+           can be called by other threads while the iterator is used
+        Parameters
+            data: float32 ndarray of (batch, channel, height, width)
+            label: float32 ndarray of (batch, label_width)
+            extra: list of float32 4 dimensional ndarray, extra data of the batch
+            num_batch_padd: number of padded instances at the end of batch
+        """
+        data = numpy.ascontiguousarray(data, dtype=numpy.float32)
+        label = numpy.ascontiguousarray(label, dtype=numpy.float32)
+        if label.ndim == 1:
+            label = label.reshape((label.shape[0], 1))
+        if data.ndim != 4 or label.ndim != 2 or label.shape[0] != data.shape[0]:
+            raise Exception('DataIter.push: need 4 dimensional data and label of same batch size')
+        if extra is None:
+            extra = []
+        extra = [numpy.ascontiguousarray(x, dtype=numpy.float32) for x in extra]
+        p_extra = (ctypes.POINTER(ctypes.c_float) * max(len(extra), 1))()
+        eshape = (ctypes.c_uint * max(len(extra) * 4, 1))()
+        for i, x in enumerate(extra):
+            if x.ndim != 4:
+                raise Exception('DataIter.push: extra data need to be 4 dimensional')
+            p_extra[i] = x.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+            for j in range(4):
+                eshape[i * 4 + j] = x.shape[j]
+        cxnlib.CXNIOPushBatch(self.handle,
+                              data.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                              shape2ctypes(data),
+                              label.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                              shape2ctypes(label),
+                              ctypes.c_uint(len(extra)), p_extra, eshape,
+                              ctypes.c_uint(num_batch_padd))
+    def push_end(self):
+        """mark the end of a round of batches pushed into iter=external"""
+        cxnlib.CXNIOPushEnd(self.handle)
 
 class Net:
     """neural net object"""
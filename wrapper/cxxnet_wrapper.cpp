@@ -5,6 +5,7 @@
 #include "../src/utils/config.h"
 #include "../src/nnet/nnet.h"
 #include "../src/io/data.h"
+#include "../src/io/iter_external-inl.hpp"
 
 namespace cxxnet {
 class WrapperIterator {
@@ -54,6 +55,8 @@ class WrapperIterator {
   }
   inline const cxx_real_t *GetData(cxx_uint dshape[4], cxx_uint *p_stride) const {
     const DataBatch &batch = iter_->Value();
+    utils::Check(batch.data_type == DataBatch::kFloat32,
+                 "GetData: only float32 batch is supported, do not set dtype=uint8");
     for (index_t i = 0; i < 4; ++i) {
       dshape[i] = batch.data.size(i);
     }
@@ -68,10 +71,44 @@ class WrapperIterator {
     *p_stride = batch.label.stride_;
     return batch.label.dptr_;    
   }
+  // push batch into iter=external, copied if release is not given
+  inline void Push(const cxx_real_t *p_data, const cxx_uint dshape[4],
+                   const cxx_real_t *p_label, const cxx_uint lshape[2],
+                   cxx_uint num_extra, const cxx_real_t **p_extra, const cxx_uint *eshape,
+                   cxx_uint num_batch_padd, bool handover,
+                   CXNIOReleaseFunc release, void *arg) {
+    DataBatch batch;
+    batch.batch_size = dshape[0];
+    batch.num_batch_padd = num_batch_padd;
+    batch.data = mshadow::Tensor<cpu, 4>
+        (const_cast<cxx_real_t*>(p_data),
+         mshadow::Shape4(dshape[0], dshape[1], dshape[2], dshape[3]));
+    batch.label = mshadow::Tensor<cpu, 2>
+        (const_cast<cxx_real_t*>(p_label), mshadow::Shape2(lshape[0], lshape[1]));
+    for (cxx_uint i = 0; i < num_extra; ++i) {
+      const cxx_uint *s = eshape + i * 4;
+      batch.extra_data.push_back(mshadow::Tensor<cpu, 4>
+          (const_cast<cxx_real_t*>(p_extra[i]), mshadow::Shape4(s[0], s[1], s[2], s[3])));
+    }
+    if (handover) {
+      this->external()->PushHandover(batch, release, arg);
+    } else {
+      this->external()->Push(batch);
+    }
+  }
+  inline void PushEnd(void) {
+    this->external()->PushEnd();
+  }
 
  private:
   friend class WrapperNet;
   IIterator<DataBatch> *iter_;
+  // the iterator as external iterator
+  inline ExternalIterator *external(void) const {
+    ExternalIterator *ext = dynamic_cast<ExternalIterator*>(iter_);
+    utils::Check(ext != NULL, "PushBatch: can only push into iterator created by iter=external");
+    return ext;
+  }
 };
 
 class WrapperNet {
@@ -256,6 +293,37 @@ extern "C" {
   void CXNIOFree(void *handle) {
     delete static_cast<WrapperIterator*>(handle);
   }
+  void CXNIOPushBatch(void *handle,
+                      const cxx_real_t *p_data,
+                      const cxx_uint dshape[4],
+                      const cxx_real_t *p_label,
+                      const cxx_uint lshape[2],
+                      cxx_uint num_extra,
+                      const cxx_real_t **p_extra,
+                      const cxx_uint *eshape,
+                      cxx_uint num_batch_padd) {
+    static_cast<WrapperIterator*>(handle)->Push(p_data, dshape, p_label, lshape,
+                                                num_extra, p_extra, eshape,
+                                                num_batch_padd, false, NULL, NULL);
+  }
+  void CXNIOPushBatchHandover(void *handle,
+                              const cxx_real_t *p_data,
+                              const cxx_uint dshape[4],
+                              const cxx_real_t *p_label,
+                              const cxx_uint lshape[2],
+                              cxx_uint num_extra,
+                              const cxx_real_t **p_extra,
+                              const cxx_uint *eshape,
+                              cxx_uint num_batch_padd,
+                              CXNIOReleaseFunc release,
+                              void *arg) {
+    static_cast<WrapperIterator*>(handle)->Push(p_data, dshape, p_label, lshape,
+                                                num_extra, p_extra, eshape,
+                                                num_batch_padd, true, release, arg);
+  }
+  void CXNIOPushEnd(void *handle) {
+    static_cast<WrapperIterator*>(handle)->PushEnd();
+  }
   void *CXNNetCreate(const char *device, const char *cfg) {
     return new WrapperNet(device, cfg);
   }
@@ -68,6 +68,57 @@ extern "C" {
    * \param handle the handle pointer to the data iterator
    */
   CXXNET_DLL void CXNIOFree(void *handle);
+  /*!
+   * \brief callback that gives back the memory of a batch handed over by CXNIOPushBatchHandover
+   * \param arg the argument given in CXNIOPushBatchHandover
+   */
+  typedef void (*CXNIOReleaseFunc)(void *arg);
+  /*!
+   * \brief copy a batch into an iterator created with iter=external, block while the queue
+   *        is full, can be called by multiple threads concurrently with CXNIONext
+   * \param handle the handle to iterator
+   * \param p_data pointer to the data tensor, shape=(nbatch, nchannel, height, width)
+   * \param dshape shape of input batch
+   * \param p_label pointer to the label field, shape=(nbatch, label_width)
+   * \param lshape shape of input label
+   * \param num_extra number of extra data tensors, can be 0
+   * \param p_extra pointers to the extra data tensors
+   * \param eshape shape of extra data tensors, 4 numbers for each tensor
+   * \param num_batch_padd number of padded instances at the end of batch
+   */
+  CXXNET_DLL void CXNIOPushBatch(void *handle,
+                                 const cxx_real_t *p_data,
+                                 const cxx_uint dshape[4],
+                                 const cxx_real_t *p_label,
+                                 const cxx_uint lshape[2],
+                                 cxx_uint num_extra,
+                                 const cxx_real_t **p_extra,
+                                 const cxx_uint *eshape,
+                                 cxx_uint num_batch_padd);
+  /*!
+   * \brief same as CXNIOPushBatch, but the batch is not copied, the memory must stay valid
+   *        until release is called; release is called by the thread that calls CXNIONext,
+   *        after it moves past the batch, or by CXNIOFree
+   * \param release callback to give back the memory, can be NULL
+   * \param arg argument of release
+   */
+  CXXNET_DLL void CXNIOPushBatchHandover(void *handle,
+                                         const cxx_real_t *p_data,
+                                         const cxx_uint dshape[4],
+                                         const cxx_real_t *p_label,
+                                         const cxx_uint lshape[2],
+                                         cxx_uint num_extra,
+                                         const cxx_real_t **p_extra,
+                                         const cxx_uint *eshape,
+                                         cxx_uint num_batch_padd,
+                                         CXNIOReleaseFunc release,
+                                         void *arg);
+  /*!
+   * \brief mark the end of a round of data pushed into iter=external,
+   *        CXNIONext returns 0 after the batches pushed before it
+   * \param handle the handle to iterator
+   */
+  CXXNET_DLL void CXNIOPushEnd(void *handle);
   /*!
    * \brief create a cxxnet neural net object
    * \param devcie the device type of the net, corresponds to parameter devices